@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include "nes.h"
+#include "ines.h"
+#include "gamecart.h"
+#include "rewind.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
+
+#define ROMS_DIR "roms/"
+#define NESTEST_ROM_PATH ROMS_DIR "nestest.nes"
+#define SMB_ROM_PATH ROMS_DIR "smb.nes"
+#define NESTEST_START_PC 0xC000
+#define NESTEST_INITIAL_SP 0xFD
+#define NESTEST_INITIAL_STATUS 0x24
+#define NESTEST_OFFICIAL_INSTRUCTIONS 5002
+
+#define DEFAULT_CPU_PASSES 2000
+#define DEFAULT_BUS_PASSES 20000
+#define BUS_BENCH_ADDRESSES 4096
+#define DEFAULT_FRAMES 600
+#define DEFAULT_STATE_PASSES 100000
+#define STATE_WARMUP_FRAMES 180
+#define REWIND_BENCH_CAPACITY (64 * 1024 * 1024)
+#define RUNAHEAD_BENCH_MAX_FRAMES 3
+#define NTSC_FPS 60.0988
+
+typedef struct {
+    const char *rom_path;
+    long iterations;
+    bool no_idle_skip;
+    bool no_block_cache;
+    bool no_jit;
+} bench_options_s;
+
+typedef struct {
+    const char *name;
+    const char *description;
+    const char *default_rom;
+    long default_iterations;
+    int (*run)(const bench_options_s *opts);
+} benchmark_s;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static nes_console_s *create_console_with_rom(const char *path, gamecart_s *cart) {
+    if (!gamecart_load(path, cart)) {
+        fprintf(stderr, "Failed to load ROM: %s\n", path);
+        return NULL;
+    }
+
+    nes_console_s *nes = nes_console_create();
+    if (!nes) {
+        fprintf(stderr, "Failed to create console\n");
+        gamecart_free(cart);
+        return NULL;
+    }
+
+    nes_attach_cart(nes, cart);
+    return nes;
+}
+
+static void print_block_cache_stats(const char *name, const cpu_s *cpu, double elapsed) {
+    const cpu_block_cache_s *cache = cpu->block_cache;
+    if (!cache) {
+        printf("%s: block cache off\n", name);
+        return;
+    }
+    size_t lookups = cache->hits + cache->misses;
+    printf("%s: block cache %.2f%% hits, %.2f M instructions/s\n",
+           name, 100.0 * cache->hits / lookups, lookups / elapsed / 1e6);
+}
+
+// Runs the official-opcode section of nestest over and over; every pass
+// starts from the same CPU and RAM state so the instruction mix is fixed.
+static int bench_cpu(const bench_options_s *opts) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return 1;
+    }
+    cpu_s *cpu = nes->cpu;
+    if (opts->no_block_cache) {
+        cpu->block_cache = NULL;
+    }
+
+    size_t instructions = 0;
+    size_t start_cycles = cpu->cycles;
+    double start = now_seconds();
+
+    for (long pass = 0; pass < opts->iterations; pass++) {
+        memset(nes->bus->ram, 0, BUS_RAM_SIZE);
+        cpu->PC = NESTEST_START_PC;
+        cpu->SP = NESTEST_INITIAL_SP;
+        cpu_set_status(cpu, NESTEST_INITIAL_STATUS);
+        cpu->A = cpu->X = cpu->Y = 0;
+
+        for (int i = 0; i < NESTEST_OFFICIAL_INSTRUCTIONS; i++) {
+            run_instruction(cpu);
+        }
+        instructions += NESTEST_OFFICIAL_INSTRUCTIONS;
+    }
+
+    double elapsed = now_seconds() - start;
+    size_t cycles = cpu->cycles - start_cycles;
+
+    printf("cpu: %zu instructions, %zu cycles in %.3f s\n", instructions, cycles, elapsed);
+    printf("cpu: %.2f M instructions/s, %.2f M cycles/s (%.1fx NTSC)\n",
+           instructions / elapsed / 1e6, cycles / elapsed / 1e6,
+           cycles / elapsed / 1789773.0);
+    print_block_cache_stats("cpu", cpu, elapsed);
+
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return 0;
+}
+
+// Reads a fixed pseudo-random mix of RAM, PRG RAM and PRG ROM addresses,
+// roughly the spread a game's instruction and operand fetches touch.
+static int bench_bus(const bench_options_s *opts) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return 1;
+    }
+    bus_s *bus = nes->bus;
+
+    static word_t addresses[BUS_BENCH_ADDRESSES];
+    uint32_t seed = 0x12345678;
+    for (int i = 0; i < BUS_BENCH_ADDRESSES; i++) {
+        seed = seed * 1103515245 + 12345;
+        word_t offset = (word_t)(seed >> 16);
+        switch (i % 8) {
+            case 0:
+            case 1:
+                addresses[i] = offset & 0x07FF;
+                break;
+            case 2:
+                addresses[i] = 0x6000 | (offset & 0x1FFF);
+                break;
+            default:
+                addresses[i] = 0x8000 | (offset & 0x7FFF);
+                break;
+        }
+    }
+
+    unsigned sum = 0;
+    double start = now_seconds();
+
+    for (long pass = 0; pass < opts->iterations; pass++) {
+        for (int i = 0; i < BUS_BENCH_ADDRESSES; i++) {
+            sum += bus_read(bus, addresses[i]);
+        }
+    }
+
+    double elapsed = now_seconds() - start;
+    double reads = (double)opts->iterations * BUS_BENCH_ADDRESSES;
+
+    printf("bus: %.0f reads in %.3f s (checksum %08X)\n", reads, elapsed, sum);
+    printf("bus: %.2f M reads/s, %.2f ns/read\n", reads / elapsed / 1e6, elapsed * 1e9 / reads);
+
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return 0;
+}
+
+// Runs the ROM headless from its reset vector with the PPU in lockstep.
+static int bench_frames(const bench_options_s *opts) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return 1;
+    }
+    cpu_s *cpu = nes->cpu;
+    cpu->PC = bus_read_word(nes->bus, 0xFFFC);
+    cpu->idle_loop_skip = !opts->no_idle_skip;
+    if (opts->no_block_cache) {
+        cpu->block_cache = NULL;
+    }
+    if (opts->no_jit) {
+        cpu->jit = NULL;
+    }
+
+    size_t start_cycles = cpu->cycles;
+    double start = now_seconds();
+
+    long frames = 0;
+    while (frames < opts->iterations) {
+        int result = nes_run_frame(nes);
+        if (result & STEP_RESULT_ILLEGAL_OPCODE) {
+            fprintf(stderr, "frames: illegal opcode at $%04X after %ld frames\n", cpu->PC, frames);
+            break;
+        }
+        if (result & STEP_RESULT_FRAME_COMPLETE) {
+            frames++;
+        }
+    }
+
+    double elapsed = now_seconds() - start;
+    size_t cycles = cpu->cycles - start_cycles;
+
+    printf("frames: %ld frames, %zu CPU cycles in %.3f s\n", frames, cycles, elapsed);
+    printf("frames: %.1f FPS (%.1fx real time), %.2f ms/frame\n",
+           frames / elapsed, frames / elapsed / NTSC_FPS, elapsed * 1e3 / frames);
+    printf("frames: %zu idle-loop cycles skipped (%.1f%%)\n",
+           cpu->idle_cycles_skipped, 100.0 * cpu->idle_cycles_skipped / cycles);
+    print_block_cache_stats("frames", cpu, elapsed);
+#if defined(CPU_JIT)
+    if (cpu->jit) {
+        printf("frames: JIT compiled %zu blocks, ran %zu\n",
+               cpu_jit_blocks_compiled(cpu->jit), cpu_jit_blocks_run(cpu->jit));
+    }
+#endif
+
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return 0;
+}
+
+// Saves and loads the state of a ROM a few seconds in, timing each half.
+static int bench_state(const bench_options_s *opts) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return 1;
+    }
+    nes->cpu->PC = bus_read_word(nes->bus, 0xFFFC);
+    for (int i = 0; i < STATE_WARMUP_FRAMES; i++) {
+        nes_run_frame(nes);
+    }
+
+    size_t size = nes_save_state_size(nes);
+    byte_t *state = malloc(size);
+    if (!state) {
+        nes_console_destroy(nes);
+        gamecart_free(&cart);
+        return 1;
+    }
+
+    double save_time = 0;
+    double load_time = 0;
+    for (long pass = 0; pass < opts->iterations; pass++) {
+        double start = now_seconds();
+        nes_save_state(nes, state, size);
+        double saved = now_seconds();
+        if (!nes_load_state(nes, state, size)) {
+            fprintf(stderr, "state: load rejected\n");
+            break;
+        }
+        save_time += saved - start;
+        load_time += now_seconds() - saved;
+    }
+
+    printf("state: %zu bytes, %ld saves and loads\n", size, opts->iterations);
+    printf("state: %.2f us/save, %.2f us/load\n",
+           save_time * 1e6 / opts->iterations, load_time * 1e6 / opts->iterations);
+
+    free(state);
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return 0;
+}
+
+// Runs a ROM from reset capturing a rewind snapshot every frame, timing the
+// captures apart from the frames themselves.
+static int bench_rewind(const bench_options_s *opts) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return 1;
+    }
+    nes->cpu->PC = bus_read_word(nes->bus, 0xFFFC);
+    rewind_buffer_s *history = rewind_buffer_create(nes, REWIND_BENCH_CAPACITY, 1);
+    if (!history) {
+        nes_console_destroy(nes);
+        gamecart_free(&cart);
+        return 1;
+    }
+
+    double frame_time = 0;
+    double capture_time = 0;
+    for (long frame = 0; frame < opts->iterations; frame++) {
+        double start = now_seconds();
+        nes_run_frame(nes);
+        double ran = now_seconds();
+        rewind_buffer_capture(history, nes);
+        frame_time += ran - start;
+        capture_time += now_seconds() - ran;
+    }
+
+    size_t snapshots = rewind_buffer_snapshots(history);
+    double delta_bytes = (double)rewind_buffer_bytes_used(history) / (snapshots > 1 ? snapshots - 1 : 1);
+    printf("rewind: %zu snapshots of a %zu byte state\n", snapshots, nes_save_state_size(nes));
+    printf("rewind: %.2f us/capture (%.1f%% of %.2f ms/frame)\n",
+           capture_time * 1e6 / opts->iterations, 100.0 * capture_time / frame_time,
+           frame_time * 1e3 / opts->iterations);
+    printf("rewind: %.0f bytes/snapshot, %.1f minutes of history per MB at 60 snapshots/s\n",
+           delta_bytes, 1024.0 * 1024.0 / delta_bytes / 60.0 / 60.0);
+
+    rewind_buffer_destroy(history);
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return 0;
+}
+
+// Runs a ROM from reset for opts->iterations host frames, each running
+// frames_ahead more; returns seconds per host frame, or a negative number
+static double time_run_ahead(const bench_options_s *opts, unsigned frames_ahead, bool skip_output) {
+    gamecart_s cart;
+    nes_console_s *nes = create_console_with_rom(opts->rom_path, &cart);
+    if (!nes) {
+        return -1;
+    }
+    nes->cpu->PC = bus_read_word(nes->bus, 0xFFFC);
+    nes->ppu->skip_output = skip_output;
+    size_t size = nes_save_state_size(nes);
+    byte_t *state = malloc(size);
+    if (!state) {
+        nes_console_destroy(nes);
+        gamecart_free(&cart);
+        return -1;
+    }
+
+    double start = now_seconds();
+    for (long frame = 0; frame < opts->iterations; frame++) {
+        nes_run_frame_ahead(nes, frames_ahead, state, size);
+    }
+    double elapsed = now_seconds() - start;
+
+    free(state);
+    nes_console_destroy(nes);
+    gamecart_free(&cart);
+    return elapsed / opts->iterations;
+}
+
+// Host frame cost for each number of run-ahead frames, and what the
+// speculative frames save by not drawing.
+static int bench_runahead(const bench_options_s *opts) {
+    double base = time_run_ahead(opts, 0, false);
+    double skipped = time_run_ahead(opts, 0, true);
+    if (base < 0 || skipped < 0) {
+        return 1;
+    }
+    printf("runahead: %.3f ms/frame drawn, %.3f ms/frame with output skipped (%.1f%% less)\n",
+           base * 1e3, skipped * 1e3, 100.0 * (base - skipped) / base);
+
+    for (unsigned k = 1; k <= RUNAHEAD_BENCH_MAX_FRAMES; k++) {
+        double t = time_run_ahead(opts, k, false);
+        if (t < 0) {
+            return 1;
+        }
+        printf("runahead: %u frame%s ahead: %.3f ms/frame, +%.3f ms per frame ahead (%.0f%% of real time)\n",
+               k, k == 1 ? "" : "s", t * 1e3, (t - base) * 1e3 / k, 100.0 * t * NTSC_FPS);
+    }
+    return 0;
+}
+
+static const benchmark_s benchmarks[] = {
+    {"cpu", "CPU instructions/s on nestest official opcodes (no PPU)",
+     NESTEST_ROM_PATH, DEFAULT_CPU_PASSES, bench_cpu},
+    {"bus", "bus_read throughput over RAM, PRG RAM and PRG ROM",
+     NESTEST_ROM_PATH, DEFAULT_BUS_PASSES, bench_bus},
+    {"frames", "Headless frames/s running a ROM from reset",
+     SMB_ROM_PATH, DEFAULT_FRAMES, bench_frames},
+    {"state", "Save state save and load time",
+     SMB_ROM_PATH, DEFAULT_STATE_PASSES, bench_state},
+    {"rewind", "Rewind snapshot capture cost and size per frame",
+     SMB_ROM_PATH, DEFAULT_FRAMES, bench_rewind},
+    {"runahead", "Host frame cost of running 0-3 frames ahead",
+     SMB_ROM_PATH, DEFAULT_FRAMES, bench_runahead},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s <benchmark> [options]\n\n", program_name);
+    printf("Benchmarks:\n");
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        printf("  %-8s %s\n", benchmarks[i].name, benchmarks[i].description);
+    }
+    printf("\nOptions:\n");
+    printf("  -r, --rom <path>      ROM to run (default depends on benchmark)\n");
+    printf("  -n, --iterations <n>  Passes, frames, reads or saves (default depends on benchmark)\n");
+    printf("      --no-idle-skip    Execute polling loops instead of skipping them (frames)\n");
+    printf("      --no-block-cache  Decode every instruction as it runs (cpu, frames)\n");
+    printf("      --no-jit          Interpret instead of running compiled blocks (frames)\n");
+    printf("  -h, --help            Show this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"rom",        required_argument, 0, 'r'},
+        {"iterations", required_argument, 0, 'n'},
+        {"no-idle-skip", no_argument,     0, 'S'},
+        {"no-block-cache", no_argument,   0, 'B'},
+        {"no-jit",     no_argument,       0, 'J'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    bench_options_s opts = {0};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:n:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r':
+                opts.rom_path = optarg;
+                break;
+            case 'n':
+                opts.iterations = strtol(optarg, NULL, 10);
+                if (opts.iterations <= 0) {
+                    fprintf(stderr, "Error: iterations must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'S':
+                opts.no_idle_skip = true;
+                break;
+            case 'B':
+                opts.no_block_cache = true;
+                break;
+            case 'J':
+                opts.no_jit = true;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const benchmark_s *bench = NULL;
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        if (strcmp(argv[optind], benchmarks[i].name) == 0) {
+            bench = &benchmarks[i];
+            break;
+        }
+    }
+
+    if (!bench) {
+        fprintf(stderr, "Unknown benchmark: %s\n\n", argv[optind]);
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (!opts.rom_path) opts.rom_path = bench->default_rom;
+    if (!opts.iterations) opts.iterations = bench->default_iterations;
+
+    return bench->run(&opts);
+}
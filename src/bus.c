@@ -1,16 +1,11 @@
 #include "bus.h"
+#include "cpu.h"
 #include "gamecart.h"
+#include "mapper.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 
-static bus_s s_bus;
-
-bus_s* bus_get_instance(void)
-{
-    return &s_bus;
-}
-
 #define RAM_START       0x0000
 #define RAM_END         0x1FFF
 #define RAM_MASK        0x07FF
@@ -31,99 +26,234 @@ bus_s* bus_get_instance(void)
 #define PRG_RAM_END     0x7FFF
 #define PRG_ROM_START   0x8000
 
+#define PAGE_OF(addr)   ((addr) >> BUS_PAGE_SHIFT)
+
 void bus_init(bus_s *bus)
 {
     assert(bus != NULL);
+    // Clears the padding in the saved block too, so equal consoles save equal states
+    memset(bus, 0, BUS_SAVED_BYTES);
     for (size_t i = 0; i < BUS_RAM_SIZE; i++) {
         bus->ram[i] = rand() & 0xFF;
     }
     bus->cart = NULL;
     bus->ppu = NULL;
+    bus->cpu = NULL;
+    bus->ppu_sync_cycle = 0;
+    bus->ppu_status_seen = 0;
+    scheduler_init(&bus->scheduler);
     bus->oam_dma_active = false;
+    bus->oam_dma_page = 0x00;
     bus->oam_dma_cycles = 0;
+    bus_map_pages(bus);
 }
 
-static byte_t read_prg_ram(bus_s *bus, word_t addr)
+static byte_t read_open_bus(bus_s *bus, word_t addr)
 {
-    if (bus->cart && bus->cart->prg_ram) {
-        return bus->cart->prg_ram[addr - PRG_RAM_START];
-    }
+    (void)bus;
+    (void)addr;
     return 0;
 }
 
-static byte_t read_prg_rom(bus_s *bus, word_t addr)
+static void write_ignored(bus_s *bus, word_t addr, byte_t value)
 {
-    if (bus->cart && bus->cart->rom.prg_rom != NULL) {
-        size_t prg_rom_size = bus->cart->rom.prg_rom_bytes;
-        size_t offset = addr - PRG_ROM_START;
-        if (prg_rom_size > 0) {
-            offset = offset % prg_rom_size;
-        }
-        return bus->cart->rom.prg_rom[offset];
-    }
-    return 0;
+    (void)bus;
+    (void)addr;
+    (void)value;
 }
 
-static void write_prg_ram(bus_s *bus, word_t addr, byte_t value)
+// The PPU runs lazily: it is only brought up to the CPU's cycle count when
+// the CPU is about to observe or change it. cpu->cycles still holds the start
+// of the current instruction during its accesses, which matches stepping the
+// PPU after every instruction.
+void bus_sync_ppu(bus_s *bus)
 {
-    if (bus->cart && bus->cart->prg_ram) {
-        bus->cart->prg_ram[addr - PRG_RAM_START] = value;
+    assert(bus != NULL);
+    if (!bus->cpu || !bus->ppu) {
+        return;
+    }
+
+    size_t now = bus->cpu->cycles;
+    if (now > bus->ppu_sync_cycle) {
+        ppu_run(bus->ppu, (now - bus->ppu_sync_cycle) * 3);
     }
+    bus->ppu_sync_cycle = now;
 }
 
-byte_t bus_read(bus_s *bus, word_t addr)
+// Sets an event's deadline, cutting the CPU's current timeslice short if
+// the event falls inside it
+void bus_schedule(bus_s *bus, scheduler_event_e event, size_t cycle)
 {
     assert(bus != NULL);
-
-    if (addr <= RAM_END) {
-        return bus->ram[addr & RAM_MASK];
-    }
-    else if (addr <= PPU_REG_END) {
-        return ppu_read(bus->ppu, (ppu_register_e)(addr & PPU_REG_MASK));
+    scheduler_set(&bus->scheduler, event, cycle);
+    if (bus->cpu && cycle < bus->cpu->cycle_limit) {
+        bus->cpu->cycle_limit = cycle;
     }
-    else if (addr <= APU_IO_END) {
+}
+
+// First CPU cycle at which a $2002 read could return something other than
+// the last read did. The PPU may have been synced past that read, so a
+// change it already made counts as happening now.
+size_t bus_ppu_status_change_cycle(bus_s *bus)
+{
+    assert(bus != NULL && bus->ppu != NULL);
+    if (bus->ppu->status_register != bus->ppu_status_seen) {
         return 0;
     }
-    else if (addr <= APU_TEST_END) {
-        return 0;
+    return bus->ppu_sync_cycle + (ppu_dots_until_status_change(bus->ppu) + 2) / 3;
+}
+
+static byte_t read_ppu_register(bus_s *bus, word_t addr)
+{
+    bus_sync_ppu(bus);
+    byte_t value = ppu_read(bus->ppu, (ppu_register_e)(addr & PPU_REG_MASK));
+    if ((addr & PPU_REG_MASK) == PPU_REGISTER_STATUS) {
+        bus->ppu_status_seen = value;
     }
-    else {
-        if (addr >= PRG_RAM_START && addr <= PRG_RAM_END) {
-            return read_prg_ram(bus, addr);
-        }
-        if (addr >= PRG_ROM_START) {
-            return read_prg_rom(bus, addr);
+    return value;
+}
+
+static void write_ppu_register(bus_s *bus, word_t addr, byte_t value)
+{
+    bus_sync_ppu(bus);
+    ppu_write(bus->ppu, (ppu_register_e)(addr & PPU_REG_MASK), value);
+
+    // Enabling NMI during vblank raises it immediately; it is taken after
+    // this instruction
+    if (bus->ppu->nmi_pending && bus->cpu) {
+        bus_schedule(bus, SCHEDULER_EVENT_NMI, bus->cpu->cycles);
+    }
+}
+
+static void write_mapper_register(bus_s *bus, word_t addr, byte_t value)
+{
+    // Bank switches change what the PPU fetches, so it has to be caught up
+    // with the old banks first
+    bus_sync_ppu(bus);
+    mapper_write(bus, addr, value);
+}
+
+static void write_apu_io_register(bus_s *bus, word_t addr, byte_t value)
+{
+    if (addr == OAM_DMA_REG) {
+        bus_sync_ppu(bus);
+        bus_oam_dma(bus, value);
+        if (bus->cpu) {
+            bus_schedule(bus, SCHEDULER_EVENT_OAM_DMA, bus->cpu->cycles);
         }
-        return 0;
     }
 }
 
-void bus_write(bus_s *bus, word_t addr, byte_t value)
+// Rebuilds the page tables from the current cart. Mirrors and PRG ROM
+// wrap-around are resolved here once instead of on every access.
+static void map_pages(bus_s *bus);
+
+// Rebuilds the page tables, dropping the CPU's instruction fetch page and
+// any code it decoded from pages whose backing memory changed
+void bus_map_pages(bus_s *bus)
 {
     assert(bus != NULL);
 
-    if (addr <= RAM_END) {
-        bus->ram[addr & RAM_MASK] = value;
+    cpu_block_cache_s *cache = bus->cpu ? bus->cpu->block_cache : NULL;
+    byte_t *old_pages[BUS_PAGE_COUNT];
+    memcpy(old_pages, bus->read_pages, sizeof(old_pages));
+
+    map_pages(bus);
+
+    if (bus->cpu) {
+        cpu_invalidate_fetch_page(bus->cpu);
     }
-    else if (addr <= PPU_REG_END) {
-        ppu_write(bus->ppu, (ppu_register_e)(addr & PPU_REG_MASK), value);
+    if (!cache) {
+        return;
     }
-    else if (addr == OAM_DMA_REG) {
-        bus_oam_dma(bus, value);
+    for (int page = 0; page < BUS_PAGE_COUNT; page++) {
+        if (bus->read_pages[page] != old_pages[page]) {
+            cpu_block_cache_invalidate_page(cache, page);
+        }
     }
-    else if (addr >= PRG_RAM_START && addr <= PRG_RAM_END) {
-        write_prg_ram(bus, addr, value);
+}
+
+static void map_pages(bus_s *bus)
+{
+    for (int page = 0; page < BUS_PAGE_COUNT; page++) {
+        bus->read_pages[page] = NULL;
+        bus->write_pages[page] = NULL;
+        bus->read_handlers[page] = read_open_bus;
+        bus->write_handlers[page] = write_ignored;
+    }
+
+    for (int page = PAGE_OF(RAM_START); page <= PAGE_OF(RAM_END); page++) {
+        byte_t *mem = &bus->ram[(page << BUS_PAGE_SHIFT) & RAM_MASK];
+        bus->read_pages[page] = mem;
+        bus->write_pages[page] = mem;
+    }
+
+    for (int page = PAGE_OF(PPU_REG_START); page <= PAGE_OF(PPU_REG_END); page++) {
+        bus->read_handlers[page] = read_ppu_register;
+        bus->write_handlers[page] = write_ppu_register;
+    }
+
+    // $4000-$40FF: APU/IO registers, APU test registers, then cart space
+    bus->write_handlers[PAGE_OF(APU_IO_START)] = write_apu_io_register;
+
+    gamecart_s *cart = bus->cart;
+    if (!cart) {
+        return;
+    }
+
+    if (cart->prg_ram && cart->prg_ram_size >= BUS_PAGE_SIZE) {
+        for (int page = PAGE_OF(PRG_RAM_START); page <= PAGE_OF(PRG_RAM_END); page++) {
+            size_t offset = ((size_t)(page - PAGE_OF(PRG_RAM_START)) << BUS_PAGE_SHIFT) % cart->prg_ram_size;
+            bus->read_pages[page] = &cart->prg_ram[offset];
+            bus->write_pages[page] = &cart->prg_ram[offset];
+        }
+    }
+
+    if (cart->mapper) {
+        for (int page = PAGE_OF(PRG_ROM_START); page < BUS_PAGE_COUNT; page++) {
+            int window = (page - PAGE_OF(PRG_ROM_START)) / (MAPPER_PRG_WINDOW_SIZE / BUS_PAGE_SIZE);
+            size_t offset = ((size_t)page << BUS_PAGE_SHIFT) % MAPPER_PRG_WINDOW_SIZE;
+            bus->read_pages[page] = &cart->mapper->prg_windows[window][offset];
+            bus->write_handlers[page] = write_mapper_register;
+        }
+    } else if (cart->rom.prg_rom && cart->rom.prg_rom_bytes >= BUS_PAGE_SIZE) {
+        for (int page = PAGE_OF(PRG_ROM_START); page < BUS_PAGE_COUNT; page++) {
+            size_t offset = ((size_t)(page - PAGE_OF(PRG_ROM_START)) << BUS_PAGE_SHIFT) % cart->rom.prg_rom_bytes;
+            bus->read_pages[page] = &cart->rom.prg_rom[offset];
+        }
     }
-    (void)value;
 }
 
 void bus_attach_cart(bus_s *bus, gamecart_s *cart)
 {
     assert(bus != NULL);
     bus->cart = cart;
+    bus_map_pages(bus);
     if (cart && bus->ppu) {
-        ppu_load_chr_rom(bus->ppu, cart->rom.chr_rom, cart->rom.chr_rom_bytes);
+        if (cart->chr_ram) {
+            ppu_load_chr_ram(bus->ppu, cart->chr_ram, cart->chr_ram_size);
+        } else {
+            ppu_load_chr_rom(bus->ppu, cart->rom.chr_rom, cart->rom.chr_rom_bytes);
+        }
+        bus_map_chr(bus);
         ppu_set_mirroring(bus->ppu, cart->mirroring);
+
+        bool counts_scanlines = mapper_has_scanline_counter(cart);
+        bus->ppu->scanline_hook = counts_scanlines ? mapper_clock_scanline : NULL;
+        bus->ppu->scanline_hook_context = counts_scanlines ? bus : NULL;
+    }
+}
+
+// Points the PPU's pattern tables at the cart's current CHR banks
+void bus_map_chr(bus_s *bus)
+{
+    assert(bus != NULL);
+    gamecart_s *cart = bus->cart;
+    if (!cart || !cart->mapper || !bus->ppu) {
+        return;
+    }
+    for (int bank = 0; bank < MAPPER_CHR_WINDOWS; bank++) {
+        ppu_set_chr_bank(bus->ppu, bank, cart->mapper->chr_windows[bank]);
     }
 }
 
@@ -150,5 +280,11 @@ void bus_oam_dma(bus_s *bus, byte_t page)
     for (int i = 0; i < 256; i++) {
         ppu->oam[i] = bus_read(bus, src_addr + i);
     }
+    // https://www.nesdev.org/wiki/PPU_registers#OAMDMA
+    // 513 cycles, plus one to align when the write lands on an odd cycle
     bus->oam_dma_cycles = 513;
+    if (bus->cpu && (bus->cpu->cycles & 1)) {
+        bus->oam_dma_cycles++;
+    }
+    bus->oam_dma_active = true;
 }
@@ -3,7 +3,9 @@
 
 #include "cpu_defs.h"
 #include "ppu.h"
+#include "scheduler.h"
 #include <stddef.h>
+#include <assert.h>
 
 // https://www.nesdev.org/wiki/CPU_memory_map
 //
@@ -18,23 +20,77 @@
 
 #define BUS_RAM_SIZE 2048
 
+#define BUS_PAGE_SHIFT 8
+#define BUS_PAGE_SIZE  (1 << BUS_PAGE_SHIFT)
+#define BUS_PAGE_MASK  (BUS_PAGE_SIZE - 1)
+#define BUS_PAGE_COUNT 256
+
 typedef struct gamecart_s gamecart_s;
+typedef struct bus bus_s;
+
+typedef byte_t (*bus_read_handler_t)(bus_s *bus, word_t addr);
+typedef void (*bus_write_handler_t)(bus_s *bus, word_t addr, byte_t value);
 
-typedef struct bus {
+struct bus {
     byte_t ram[BUS_RAM_SIZE];
-    gamecart_s *cart;
 
-    ppu_s *ppu;
+    // CPU cycle the PPU has been run up to; see bus_sync_ppu
+    size_t ppu_sync_cycle;
+    // Value the last $2002 read returned
+    byte_t ppu_status_seen;
+
+    // Events the console runs between CPU timeslices; see nes.c
+    scheduler_s scheduler;
 
     bool oam_dma_active;
     byte_t oam_dma_page;
     uint16_t oam_dma_cycles;
-} bus_s;
 
-bus_s* bus_get_instance(void);
+    // Everything above is saved in save states as one block (see
+    // BUS_SAVED_BYTES); everything below is wiring
+
+    gamecart_s *cart;
+    ppu_s *ppu;
+    cpu_s *cpu;
+
+    // One entry per 256-byte CPU page. Pages backed by plain memory (RAM,
+    // PRG RAM, PRG ROM) have a host pointer; the rest go through a handler.
+    byte_t *read_pages[BUS_PAGE_COUNT];
+    byte_t *write_pages[BUS_PAGE_COUNT];
+    bus_read_handler_t read_handlers[BUS_PAGE_COUNT];
+    bus_write_handler_t write_handlers[BUS_PAGE_COUNT];
+};
+
+#define BUS_SAVED_BYTES offsetof(bus_s, cart)
+
 void bus_init(bus_s *bus);
-byte_t bus_read(bus_s *bus, word_t addr);
-void bus_write(bus_s *bus, word_t addr, byte_t value);
+void bus_map_pages(bus_s *bus);
+void bus_map_chr(bus_s *bus);
+void bus_sync_ppu(bus_s *bus);
+size_t bus_ppu_status_change_cycle(bus_s *bus);
+void bus_schedule(bus_s *bus, scheduler_event_e event, size_t cycle);
+
+static inline byte_t bus_read(bus_s *bus, word_t addr)
+{
+    assert(bus != NULL);
+    byte_t *page = bus->read_pages[addr >> BUS_PAGE_SHIFT];
+    if (page) {
+        return page[addr & BUS_PAGE_MASK];
+    }
+    return bus->read_handlers[addr >> BUS_PAGE_SHIFT](bus, addr);
+}
+
+static inline void bus_write(bus_s *bus, word_t addr, byte_t value)
+{
+    assert(bus != NULL);
+    byte_t *page = bus->write_pages[addr >> BUS_PAGE_SHIFT];
+    if (page) {
+        page[addr & BUS_PAGE_MASK] = value;
+        return;
+    }
+    bus->write_handlers[addr >> BUS_PAGE_SHIFT](bus, addr, value);
+}
+
 word_t bus_read_word(bus_s *bus, word_t addr);
 void bus_attach_cart(bus_s *bus, gamecart_s *cart);
 void bus_set_mirroring(bus_s *bus, mirroring_mode_e mode);
@@ -1,2258 +1,52 @@
 #include "cpu.h"
 #include "bus.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-static cpu_s s_cpu;
-
-cpu_s* cpu_get_instance(void)
-{
-    return &s_cpu;
-}
-
-#define UNIMPLEMENTED()                                                                   \
-    fprintf(stderr, "%s:%d: %s: Unimplemented function\n", __FILE__, __LINE__, __func__); \
-    abort();
-
-
-#define MEM_SIZE (1024 * 1024 * 64)
-
-
-
-
-byte_t ILLEGAL(cpu_s *cpu)
-{
-    fprintf(stderr, "WARNING: Illegal opcode 0x%02X at PC=0x%04X\n",
-            cpu->current_opcode, cpu->PC - 1);
-    return 0;
-}
-
-bool is_illegal_opcode(cpu_s *cpu, byte_t opcode)
-{
-    cpu_instruction_s *instr = get_instruction(cpu, opcode);
-    return instr->execute == ILLEGAL;
-}
-
-word_t address;
-offset_t address_rel;
-byte_t value;
-byte_t current_instruction_length;
-bool acc_mode;
-
-static void init_instruction_table(cpu_s *cpu)
-{
-    cpu_instruction_s *table = &cpu->table[0];
-
-    // https://www.nesdev.org/wiki/CPU_Opcode_matrix
-    table[INSTRUCTION_BRK_IMP] = (cpu_instruction_s)
-    {
-        .name = "BRK",
-        .opcode = 0x00,
-        .cycles = 7,
-        .length = 2,
-        .data_fetch = IMP,
-        .execute = BRK,
-    };
-    table[INSTRUCTION_ORA_IZX] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x01,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = ORA,
-    };
-    table[OPCODE_UNDEFINED_0x02] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x02,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x03] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x03,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x04] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x04,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ORA_ZP0] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x05,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = ORA,
-    };
-    table[INSTRUCTION_ASL_ZP0] = (cpu_instruction_s)
-    {
-        .name = "ASL",
-        .opcode = 0x06,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = ASL,
-    };
-    table[OPCODE_UNDEFINED_0x07] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x07,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_PHP_IMP] = (cpu_instruction_s)
-    {
-        .name = "PHP",
-        .opcode = 0x08,
-        .cycles = 3,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = PHP,
-    };
-    table[INSTRUCTION_ORA_IMM] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x09,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = ORA,
-    };
-    table[INSTRUCTION_ASL_ACC] = (cpu_instruction_s)
-    {
-        .name = "ASL",
-        .opcode = 0x0A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = ACC,
-        .execute = ASL,
-    };
-    table[OPCODE_UNDEFINED_0x0B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x0B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x0C] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x0C,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ORA_ABS] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x0D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = ORA,
-    };
-    table[INSTRUCTION_ASL_ABS] = (cpu_instruction_s)
-    {
-        .name = "ASL",
-        .opcode = 0x0E,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = ASL,
-    };
-    table[OPCODE_UNDEFINED_0x0F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x0F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BPL_REL] = (cpu_instruction_s)
-    {
-        .name = "BPL",
-        .opcode = 0x10,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BPL,
-    };
-    table[INSTRUCTION_ORA_IZY] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x11,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = ORA,
-    };
-    table[OPCODE_UNDEFINED_0x12] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x12,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x13] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x13,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x14] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x14,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ORA_ZPX] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x15,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = ORA,
-    };
-    table[INSTRUCTION_ASL_ZPX] = (cpu_instruction_s)
-    {
-        .name = "ASL",
-        .opcode = 0x16,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = ASL,
-    };
-    table[OPCODE_UNDEFINED_0x17] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x17,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CLC_IMP] = (cpu_instruction_s)
-    {
-        .name = "CLC",
-        .opcode = 0x18,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = CLC,
-    };
-    table[INSTRUCTION_ORA_ABY] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x19,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = ORA,
-    };
-    table[OPCODE_UNDEFINED_0x1A] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x1A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x1B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x1B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x1C] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x1C,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ORA_ABX] = (cpu_instruction_s)
-    {
-        .name = "ORA",
-        .opcode = 0x1D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = ORA,
-    };
-    table[INSTRUCTION_ASL_ABX] = (cpu_instruction_s)
-    {
-        .name = "ASL",
-        .opcode = 0x1E,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = ASL,
-    };
-    table[OPCODE_UNDEFINED_0x1F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x1F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_JSR_ABS] = (cpu_instruction_s)
-    {
-        .name = "JSR",
-        .opcode = 0x20,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = JSR,
-    };
-    table[INSTRUCTION_AND_IZX] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x21,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = AND,
-    };
-    table[OPCODE_UNDEFINED_0x22] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x22,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x23] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x23,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BIT_ZP0] = (cpu_instruction_s)
-    {
-        .name = "BIT",
-        .opcode = 0x24,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = BIT,
-    };
-    table[INSTRUCTION_AND_ZP0] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x25,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = AND,
-    };
-    table[INSTRUCTION_ROL_ZP0] = (cpu_instruction_s)
-    {
-        .name = "ROL",
-        .opcode = 0x26,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = ROL,
-    };
-    table[OPCODE_UNDEFINED_0x27] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x27,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_PLP_IMP] = (cpu_instruction_s)
-    {
-        .name = "PLP",
-        .opcode = 0x28,
-        .cycles = 4,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = PLP,
-    };
-    table[INSTRUCTION_AND_IMM] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x29,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = AND,
-    };
-    table[INSTRUCTION_ROL_ACC] = (cpu_instruction_s)
-    {
-        .name = "ROL",
-        .opcode = 0x2A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = ACC,
-        .execute = ROL,
-    };
-    table[OPCODE_UNDEFINED_0x2B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x2B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BIT_ABS] = (cpu_instruction_s)
-    {
-        .name = "BIT",
-        .opcode = 0x2C,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = BIT,
-    };
-    table[INSTRUCTION_AND_ABS] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x2D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = AND,
-    };
-    table[INSTRUCTION_ROL_ABS] = (cpu_instruction_s)
-    {
-        .name = "ROL",
-        .opcode = 0x2E,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = ROL,
-    };
-    table[OPCODE_UNDEFINED_0x2F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x2F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BMI_REL] = (cpu_instruction_s)
-    {
-        .name = "BMI",
-        .opcode = 0x30,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BMI,
-    };
-    table[INSTRUCTION_AND_IZY] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x31,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = AND,
-    };
-    table[OPCODE_UNDEFINED_0x32] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x32,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x33] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x33,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_AND_ZPX] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x35,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = AND,
-    };
-    table[INSTRUCTION_ROL_ZPX] = (cpu_instruction_s)
-    {
-        .name = "ROL",
-        .opcode = 0x36,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = ROL,
-    };
-    table[OPCODE_UNDEFINED_0x37] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x37,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_SEC_IMP] = (cpu_instruction_s)
-    {
-        .name = "SEC",
-        .opcode = 0x38,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = SEC,
-    };
-    table[INSTRUCTION_AND_ABY] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x39,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = AND,
-    };
-    table[OPCODE_UNDEFINED_0x3A] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x3A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x3B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x3B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_AND_ABX] = (cpu_instruction_s)
-    {
-        .name = "AND",
-        .opcode = 0x3D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = AND,
-    };
-    table[INSTRUCTION_ROL_ABX] = (cpu_instruction_s)
-    {
-        .name = "ROL",
-        .opcode = 0x3E,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = ROL,
-    };
-    table[OPCODE_UNDEFINED_0x3F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x3F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_RTI_IMP] = (cpu_instruction_s)
-    {
-        .name = "RTI",
-        .opcode = 0x40,
-        .cycles = 6,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = RTI,
-    };
-    table[INSTRUCTION_EOR_IZX] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x41,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = EOR,
-    };
-    table[OPCODE_UNDEFINED_0x42] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x42,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x43] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x43,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_EOR_ZP0] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x45,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = EOR,
-    };
-    table[INSTRUCTION_LSR_ZP0] = (cpu_instruction_s)
-    {
-        .name = "LSR",
-        .opcode = 0x46,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = LSR,
-    };
-    table[OPCODE_UNDEFINED_0x47] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x47,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_PHA_IMP] = (cpu_instruction_s)
-    {
-        .name = "PHA",
-        .opcode = 0x48,
-        .cycles = 3,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = PHA,
-    };
-    table[INSTRUCTION_EOR_IMM] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x49,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = EOR,
-    };
-    table[INSTRUCTION_LSR_ACC] = (cpu_instruction_s)
-    {
-        .name = "LSR",
-        .opcode = 0x4A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = ACC,
-        .execute = LSR,
-    };
-    table[OPCODE_UNDEFINED_0x4B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x4B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_JMP_ABS] = (cpu_instruction_s)
-    {
-        .name = "JMP",
-        .opcode = 0x4C,
-        .cycles = 3,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = JMP,
-    };
-    table[INSTRUCTION_EOR_ABS] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x4D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = EOR,
-    };
-    table[INSTRUCTION_LSR_ABS] = (cpu_instruction_s)
-    {
-        .name = "LSR",
-        .opcode = 0x4E,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = LSR,
-    };
-    table[OPCODE_UNDEFINED_0x4F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x4F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BVC_REL] = (cpu_instruction_s)
-    {
-        .name = "BVC",
-        .opcode = 0x50,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BVC,
-    };
-    table[INSTRUCTION_EOR_IZY] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x51,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = EOR,
-    };
-    table[OPCODE_UNDEFINED_0x52] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x52,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x53] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x53,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_EOR_ZPX] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x55,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = EOR,
-    };
-    table[INSTRUCTION_LSR_ZPX] = (cpu_instruction_s)
-    {
-        .name = "LSR",
-        .opcode = 0x56,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = LSR,
-    };
-    table[OPCODE_UNDEFINED_0x57] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x57,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CLI_IMP] = (cpu_instruction_s)
-    {
-        .name = "CLI",
-        .opcode = 0x58,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = CLI,
-    };
-    table[INSTRUCTION_EOR_ABY] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x59,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = EOR,
-    };
-    table[OPCODE_UNDEFINED_0x5A] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x5A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x5B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x5B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_EOR_ABX] = (cpu_instruction_s)
-    {
-        .name = "EOR",
-        .opcode = 0x5D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = EOR,
-    };
-    table[INSTRUCTION_LSR_ABX] = (cpu_instruction_s)
-    {
-        .name = "LSR",
-        .opcode = 0x5E,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = LSR,
-    };
-    table[OPCODE_UNDEFINED_0x5F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x5F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_RTS_IMP] = (cpu_instruction_s)
-    {
-        .name = "RTS",
-        .opcode = 0x60,
-        .cycles = 6,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = RTS,
-    };
-    table[INSTRUCTION_ADC_IZX] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x61,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = ADC,
-    };
-    table[OPCODE_UNDEFINED_0x62] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x62,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x63] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x63,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x64] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x64,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ADC_ZP0] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x65,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = ADC,
-    };
-    table[INSTRUCTION_ROR_ZP0] = (cpu_instruction_s)
-    {
-        .name = "ROR",
-        .opcode = 0x66,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = ROR,
-    };
-    table[OPCODE_UNDEFINED_0x67] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x67,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_PLA_IMP] = (cpu_instruction_s)
-    {
-        .name = "PLA",
-        .opcode = 0x68,
-        .cycles = 4,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = PLA,
-    };
-    table[INSTRUCTION_ADC_IMM] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x69,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = ADC,
-    };
-    table[INSTRUCTION_ROR_ACC] = (cpu_instruction_s)
-    {
-        .name = "ROR",
-        .opcode = 0x6A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = ACC,
-        .execute = ROR,
-    };
-    table[OPCODE_UNDEFINED_0x6B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x6B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_JMP_IND] = (cpu_instruction_s)
-    {
-        .name = "JMP",
-        .opcode = 0x6C,
-        .cycles = 5,
-        .length = 3,
-        .data_fetch = IND,
-        .execute = JMP,
-    };
-    table[INSTRUCTION_ADC_ABS] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x6D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = ADC,
-    };
-    table[INSTRUCTION_ROR_ABS] = (cpu_instruction_s)
-    {
-        .name = "ROR",
-        .opcode = 0x6E,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = ROR,
-    };
-    table[OPCODE_UNDEFINED_0x6F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x6F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BVS_REL] = (cpu_instruction_s)
-    {
-        .name = "BVS",
-        .opcode = 0x70,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BVS,
-    };
-    table[INSTRUCTION_ADC_IZY] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x71,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = ADC,
-    };
-    table[OPCODE_UNDEFINED_0x72] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x72,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x73] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x73,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x74] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x74,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ADC_ZPX] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x75,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = ADC,
-    };
-    table[INSTRUCTION_ROR_ZPX] = (cpu_instruction_s)
-    {
-        .name = "ROR",
-        .opcode = 0x76,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = ROR,
-    };
-    table[OPCODE_UNDEFINED_0x77] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x77,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_SEI_IMP] = (cpu_instruction_s)
-    {
-        .name = "SEI",
-        .opcode = 0x78,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = SEI,
-    };
-    table[INSTRUCTION_ADC_ABY] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x79,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = ADC,
-    };
-    table[OPCODE_UNDEFINED_0x7A] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x7A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x7B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x7B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x7C] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x7C,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_ADC_ABX] = (cpu_instruction_s)
-    {
-        .name = "ADC",
-        .opcode = 0x7D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = ADC,
-    };
-    table[INSTRUCTION_ROR_ABX] = (cpu_instruction_s)
-    {
-        .name = "ROR",
-        .opcode = 0x7E,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = ROR,
-    };
-    table[OPCODE_UNDEFINED_0x7F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x7F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_STA_IZX] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x81,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = STA,
-    };
-    table[OPCODE_UNDEFINED_0x82] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x82,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_STY_ZP0] = (cpu_instruction_s)
-    {
-        .name = "STY",
-        .opcode = 0x84,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = STY,
-    };
-    table[INSTRUCTION_STA_ZP0] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x85,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = STA,
-    };
-    table[INSTRUCTION_STX_ZP0] = (cpu_instruction_s)
-    {
-        .name = "STX",
-        .opcode = 0x86,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = STX,
-    };
-    table[OPCODE_UNDEFINED_0x87] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x87,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_DEY_IMP] = (cpu_instruction_s)
-    {
-        .name = "DEY",
-        .opcode = 0x88,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = DEY,
-    };
-    table[OPCODE_UNDEFINED_0x89] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x89,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_TXA_IMP] = (cpu_instruction_s)
-    {
-        .name = "TXA",
-        .opcode = 0x8A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TXA,
-    };
-    table[OPCODE_UNDEFINED_0x8B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x8B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_STY_ABS] = (cpu_instruction_s)
-    {
-        .name = "STY",
-        .opcode = 0x8C,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = STY,
-    };
-    table[INSTRUCTION_STA_ABS] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x8D,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = STA,
-    };
-    table[INSTRUCTION_STX_ABS] = (cpu_instruction_s)
-    {
-        .name = "STX",
-        .opcode = 0x8E,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = STX,
-    };
-    table[OPCODE_UNDEFINED_0x8F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x8F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BCC_REL] = (cpu_instruction_s)
-    {
-        .name = "BCC",
-        .opcode = 0x90,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BCC,
-    };
-    table[INSTRUCTION_STA_IZY] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x91,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = STA,
-    };
-    table[OPCODE_UNDEFINED_0x92] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x92,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x93] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x93,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_STY_ZPX] = (cpu_instruction_s)
-    {
-        .name = "STY",
-        .opcode = 0x94,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = STY,
-    };
-    table[INSTRUCTION_STA_ZPX] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x95,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = STA,
-    };
-    table[INSTRUCTION_STX_ZPY] = (cpu_instruction_s)
-    {
-        .name = "STX",
-        .opcode = 0x96,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPY,
-        .execute = STX,
-    };
-    table[OPCODE_UNDEFINED_0x97] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x97,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_TYA_IMP] = (cpu_instruction_s)
-    {
-        .name = "TYA",
-        .opcode = 0x98,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TYA,
-    };
-    table[INSTRUCTION_STA_ABY] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x99,
-        .cycles = 5,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = STA,
-    };
-    table[INSTRUCTION_TXS_IMP] = (cpu_instruction_s)
-    {
-        .name = "TXS",
-        .opcode = 0x9A,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TXS,
-    };
-    table[OPCODE_UNDEFINED_0x9B] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x9B,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x9C] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x9C,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_STA_ABX] = (cpu_instruction_s)
-    {
-        .name = "STA",
-        .opcode = 0x9D,
-        .cycles = 5,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = STA,
-    };
-    table[OPCODE_UNDEFINED_0x9E] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x9E,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0x9F] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0x9F,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_LDY_IMM] = (cpu_instruction_s)
-    {
-        .name = "LDY",
-        .opcode = 0xA0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = LDY,
-    };
-    table[INSTRUCTION_LDA_IZX] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xA1,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_LDX_IMM] = (cpu_instruction_s)
-    {
-        .name = "LDX",
-        .opcode = 0xA2,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = LDX,
-    };
-    table[OPCODE_UNDEFINED_0xA3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xA3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_LDY_ZP0] = (cpu_instruction_s)
-    {
-        .name = "LDY",
-        .opcode = 0xA4,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = LDY,
-    };
-    table[INSTRUCTION_LDA_ZP0] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xA5,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_LDX_ZP0] = (cpu_instruction_s)
-    {
-        .name = "LDX",
-        .opcode = 0xA6,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = LDX,
-    };
-    table[OPCODE_UNDEFINED_0xA7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xA7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_TAY_IMP] = (cpu_instruction_s)
-    {
-        .name = "TAY",
-        .opcode = 0xA8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TAY,
-    };
-    table[INSTRUCTION_LDA_IMM] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xA9,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_TAX_IMP] = (cpu_instruction_s)
-    {
-        .name = "TAX",
-        .opcode = 0xAA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TAX,
-    };
-    table[OPCODE_UNDEFINED_0xAB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xAB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_LDY_ABS] = (cpu_instruction_s)
-    {
-        .name = "LDY",
-        .opcode = 0xAC,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = LDY,
-    };
-    table[INSTRUCTION_LDA_ABS] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xAD,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_LDX_ABS] = (cpu_instruction_s)
-    {
-        .name = "LDX",
-        .opcode = 0xAE,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = LDX,
-    };
-    table[OPCODE_UNDEFINED_0xAF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xAF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BCS_REL] = (cpu_instruction_s)
-    {
-        .name = "BCS",
-        .opcode = 0xB0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BCS,
-    };
-    table[INSTRUCTION_LDA_IZY] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xB1,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = LDA,
-    };
-    table[OPCODE_UNDEFINED_0xB2] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xB2,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xB3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xB3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_LDY_ZPX] = (cpu_instruction_s)
-    {
-        .name = "LDY",
-        .opcode = 0xB4,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = LDY,
-    };
-    table[INSTRUCTION_LDA_ZPX] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xB5,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_LDX_ZPY] = (cpu_instruction_s)
-    {
-        .name = "LDX",
-        .opcode = 0xB6,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPY,
-        .execute = LDX,
-    };
-    table[OPCODE_UNDEFINED_0xB7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xB7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CLV_IMP] = (cpu_instruction_s)
-    {
-        .name = "CLV",
-        .opcode = 0xB8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = CLV,
-    };
-    table[INSTRUCTION_LDA_ABY] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xB9,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_TSX_IMP] = (cpu_instruction_s)
-    {
-        .name = "TSX",
-        .opcode = 0xBA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = TSX,
-    };
-    table[OPCODE_UNDEFINED_0xBB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xBB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_LDY_ABX] = (cpu_instruction_s)
-    {
-        .name = "LDY",
-        .opcode = 0xBC,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = LDY,
-    };
-    table[INSTRUCTION_LDA_ABX] = (cpu_instruction_s)
-    {
-        .name = "LDA",
-        .opcode = 0xBD,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = LDA,
-    };
-    table[INSTRUCTION_LDX_ABY] = (cpu_instruction_s)
-    {
-        .name = "LDX",
-        .opcode = 0xBE,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = LDX,
-    };
-    table[OPCODE_UNDEFINED_0xBF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xBF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPY_IMM] = (cpu_instruction_s)
-    {
-        .name = "CPY",
-        .opcode = 0xC0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = CPY,
-    };
-    table[INSTRUCTION_CMP_IZX] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xC1,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = CMP,
-    };
-    table[OPCODE_UNDEFINED_0xC2] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xC2,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xC3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xC3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPY_ZP0] = (cpu_instruction_s)
-    {
-        .name = "CPY",
-        .opcode = 0xC4,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = CPY,
-    };
-    table[INSTRUCTION_CMP_ZP0] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xC5,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = CMP,
-    };
-    table[INSTRUCTION_DEC_ZP0] = (cpu_instruction_s)
-    {
-        .name = "DEC",
-        .opcode = 0xC6,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = DEC,
-    };
-    table[OPCODE_UNDEFINED_0xC7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xC7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_INY_IMP] = (cpu_instruction_s)
-    {
-        .name = "INY",
-        .opcode = 0xC8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = INY,
-    };
-    table[INSTRUCTION_CMP_IMM] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xC9,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = CMP,
-    };
-    table[INSTRUCTION_DEX_IMP] = (cpu_instruction_s)
-    {
-        .name = "DEX",
-        .opcode = 0xCA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = DEX,
-    };
-    table[OPCODE_UNDEFINED_0xCB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xCB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPY_ABS] = (cpu_instruction_s)
-    {
-        .name = "CPY",
-        .opcode = 0xCC,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = CPY,
-    };
-    table[INSTRUCTION_CMP_ABS] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xCD,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = CMP,
-    };
-    table[INSTRUCTION_DEC_ABS] = (cpu_instruction_s)
-    {
-        .name = "DEC",
-        .opcode = 0xCE,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = DEC,
-    };
-    table[OPCODE_UNDEFINED_0xCF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xCF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BNE_REL] = (cpu_instruction_s)
-    {
-        .name = "BNE",
-        .opcode = 0xD0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BNE,
-    };
-    table[INSTRUCTION_CMP_IZY] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xD1,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = CMP,
-    };
-    table[OPCODE_UNDEFINED_0xD2] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xD2,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xD3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xD3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CMP_ZPX] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xD5,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = CMP,
-    };
-    table[INSTRUCTION_DEC_ZPX] = (cpu_instruction_s)
-    {
-        .name = "DEC",
-        .opcode = 0xD6,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = DEC,
-    };
-    table[OPCODE_UNDEFINED_0xD7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xD7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CLD_IMP] = (cpu_instruction_s)
-    {
-        .name = "CLD",
-        .opcode = 0xD8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = CLD,
-    };
-    table[INSTRUCTION_CMP_ABY] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xD9,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = CMP,
-    };
-    table[OPCODE_UNDEFINED_0xDA] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xDA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xDB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xDB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CMP_ABX] = (cpu_instruction_s)
-    {
-        .name = "CMP",
-        .opcode = 0xDD,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = CMP,
-    };
-    table[INSTRUCTION_DEC_ABX] = (cpu_instruction_s)
-    {
-        .name = "DEC",
-        .opcode = 0xDE,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = DEC,
-    };
-    table[OPCODE_UNDEFINED_0xDF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xDF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPX_IMM] = (cpu_instruction_s)
-    {
-        .name = "CPX",
-        .opcode = 0xE0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = CPX,
-    };
-    table[INSTRUCTION_SBC_IZX] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xE1,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = IZX,
-        .execute = SBC,
-    };
-    table[OPCODE_UNDEFINED_0xE2] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xE2,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xE3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xE3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPX_ZP0] = (cpu_instruction_s)
-    {
-        .name = "CPX",
-        .opcode = 0xE4,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = CPX,
-    };
-    table[INSTRUCTION_SBC_ZP0] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xE5,
-        .cycles = 3,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = SBC,
-    };
-    table[INSTRUCTION_INC_ZP0] = (cpu_instruction_s)
-    {
-        .name = "INC",
-        .opcode = 0xE6,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = ZP0,
-        .execute = INC,
-    };
-    table[OPCODE_UNDEFINED_0xE7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xE7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_INX_IMP] = (cpu_instruction_s)
-    {
-        .name = "INX",
-        .opcode = 0xE8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = INX,
-    };
-    table[INSTRUCTION_SBC_IMM] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xE9,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = IMM,
-        .execute = SBC,
-    };
-    table[INSTRUCTION_NOP_IMP] = (cpu_instruction_s)
-    {
-        .name = "NOP",
-        .opcode = 0xEA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = NOP,
-    };
-    table[OPCODE_UNDEFINED_0xEB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xEB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_CPX_ABS] = (cpu_instruction_s)
-    {
-        .name = "CPX",
-        .opcode = 0xEC,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = CPX,
-    };
-    table[INSTRUCTION_SBC_ABS] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xED,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = SBC,
-    };
-    table[INSTRUCTION_INC_ABS] = (cpu_instruction_s)
-    {
-        .name = "INC",
-        .opcode = 0xEE,
-        .cycles = 6,
-        .length = 3,
-        .data_fetch = ABS,
-        .execute = INC,
-    };
-    table[OPCODE_UNDEFINED_0xEF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xEF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_BEQ_REL] = (cpu_instruction_s)
-    {
-        .name = "BEQ",
-        .opcode = 0xF0,
-        .cycles = 2,
-        .length = 2,
-        .data_fetch = REL,
-        .execute = BEQ,
-    };
-    table[INSTRUCTION_SBC_IZY] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xF1,
-        .cycles = 5,
-        .length = 2,
-        .data_fetch = IZY,
-        .execute = SBC,
-    };
-    table[OPCODE_UNDEFINED_0xF2] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xF2,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xF3] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xF3,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_SBC_ZPX] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xF5,
-        .cycles = 4,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = SBC,
-    };
-    table[INSTRUCTION_INC_ZPX] = (cpu_instruction_s)
-    {
-        .name = "INC",
-        .opcode = 0xF6,
-        .cycles = 6,
-        .length = 2,
-        .data_fetch = ZPX,
-        .execute = INC,
-    };
-    table[OPCODE_UNDEFINED_0xF7] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xF7,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_SED_IMP] = (cpu_instruction_s)
-    {
-        .name = "SED",
-        .opcode = 0xF8,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = SED,
-    };
-    table[INSTRUCTION_SBC_ABY] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xF9,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABY,
-        .execute = SBC,
-    };
-    table[OPCODE_UNDEFINED_0xFA] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xFA,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[OPCODE_UNDEFINED_0xFB] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xFB,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
-    table[INSTRUCTION_SBC_ABX] = (cpu_instruction_s)
-    {
-        .name = "SBC",
-        .opcode = 0xFD,
-        .cycles = 4,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = SBC,
-    };
-    table[INSTRUCTION_INC_ABX] = (cpu_instruction_s)
-    {
-        .name = "INC",
-        .opcode = 0xFE,
-        .cycles = 7,
-        .length = 3,
-        .data_fetch = ABX,
-        .execute = INC,
-    };
-    table[OPCODE_UNDEFINED_0xFF] = (cpu_instruction_s)
-    {
-        .name = "???",
-        .opcode = 0xFF,
-        .cycles = 2,
-        .length = 1,
-        .data_fetch = IMP,
-        .execute = ILLEGAL,
-    };
+#define UNIMPLEMENTED()                                                                   \
+    fprintf(stderr, "%s:%d: %s: Unimplemented function\n", __FILE__, __LINE__, __func__); \
+    abort();
+
+
+#define MEM_SIZE (1024 * 1024 * 64)
+
+#if defined(CPU_DISPATCH_GOTO) && !defined(__GNUC__)
+#error "CPU_DISPATCH_GOTO requires a compiler with labels-as-values (GCC or Clang)"
+#endif
+
+
+
+
+byte_t ILLEGAL(cpu_s *cpu)
+{
+    fprintf(stderr, "WARNING: Illegal opcode 0x%02X at PC=0x%04X\n",
+            cpu->current_opcode, cpu->PC - 1);
+    return 0;
+}
+
+bool is_illegal_opcode(byte_t opcode)
+{
+    const cpu_instruction_s *instr = get_instruction(opcode);
+    return instr->execute == ILLEGAL;
 }
 
+// https://www.nesdev.org/wiki/CPU_Opcode_matrix
+static const cpu_instruction_s instruction_table[256] = {
+    #define X(ins, mode, op, cyc, len) \
+    [op] = { .name = #ins, .opcode = op, .cycles = cyc, .length = len, .data_fetch = mode, .execute = ins },
+    INSTRUCTION_OPCODE_TABLE
+    #undef X
+    #define X(op) \
+    [op] = { .name = "???", .opcode = op, .cycles = 2, .length = 1, .data_fetch = IMP, .execute = ILLEGAL },
+    UNDEFINED_OPCODES
+    #undef X
+};
+
 bool crosses_page(word_t addr1, word_t addr2)
 {
     return (addr1 & 0xFF00) != (addr2 & 0xFF00);
@@ -2260,8 +54,8 @@ bool crosses_page(word_t addr1, word_t addr2)
 
 void set_zn(cpu_s *cpu, byte_t value)
 {
-    set_flag(cpu, STATUS_FLAG_Z, value == 0);
-    set_flag(cpu, STATUS_FLAG_N, value & 0x80);
+    cpu->n_result = value;
+    cpu->z_result = value;
 }
 
 word_t assemble_word(byte_t high, byte_t low)
@@ -2269,89 +63,153 @@ word_t assemble_word(byte_t high, byte_t low)
     return (high << 8) | low;
 }
 
-void push_address(cpu_s *cpu, word_t addr)
+
+byte_t cpu_get_status(const cpu_s *cpu)
 {
-    push_byte_to_stack(cpu, ((addr) & 0xFF00) >> 8);
-    push_byte_to_stack(cpu, (addr) & 0x00FF);
+    assert(cpu != NULL);
+    byte_t status = cpu->P & ~(STATUS_FLAG_N | STATUS_FLAG_Z | STATUS_FLAG_C | STATUS_FLAG_V);
+    if (get_flag(cpu, STATUS_FLAG_N)) status |= STATUS_FLAG_N;
+    if (get_flag(cpu, STATUS_FLAG_Z)) status |= STATUS_FLAG_Z;
+    if (get_flag(cpu, STATUS_FLAG_C)) status |= STATUS_FLAG_C;
+    if (get_flag(cpu, STATUS_FLAG_V)) status |= STATUS_FLAG_V;
+    return status;
 }
 
-
-void reset_globals()
+void cpu_set_status(cpu_s *cpu, byte_t status)
 {
-    address = 0x0000;
-    address_rel = 0x00;
-    value = 0;
-    return;
+    assert(cpu != NULL);
+    cpu->P = status & ~(STATUS_FLAG_N | STATUS_FLAG_Z | STATUS_FLAG_C | STATUS_FLAG_V);
+    set_flag(cpu, STATUS_FLAG_N, status & STATUS_FLAG_N);
+    set_flag(cpu, STATUS_FLAG_Z, status & STATUS_FLAG_Z);
+    set_flag(cpu, STATUS_FLAG_C, status & STATUS_FLAG_C);
+    set_flag(cpu, STATUS_FLAG_V, status & STATUS_FLAG_V);
+}
+byte_t branch_pc(cpu_s *cpu)
+{
+    cpu->PC += cpu->address_rel;
+    return 0;
 }
 
-bool get_flag(cpu_s *cpu, cpu_status_flag_e flag)
+byte_t read_from_addr(cpu_s *cpu, word_t address)
 {
-    return (cpu->STATUS & flag) > 0;
+    assert(cpu != NULL && cpu->bus != NULL);
+    return bus_read(cpu->bus, address);
 }
 
-void set_flag(cpu_s *cpu, cpu_status_flag_e flag, bool value)
+// Instruction bytes are read through the page PC was last fetched from, so
+// the page table is only consulted again when PC moves to another page.
+// Pages without plain memory behind them are never cached.
+static inline byte_t fetch_pc_byte(cpu_s *cpu, word_t offset)
 {
-    if (value)
-        cpu->STATUS |= flag;
-    else
-        cpu->STATUS &= ~flag;
-    return;
+    assert(cpu != NULL && cpu->bus != NULL);
+    word_t addr = cpu->PC + offset;
+    if (cpu->fetch_page && (addr >> BUS_PAGE_SHIFT) == (cpu->fetch_page_addr >> BUS_PAGE_SHIFT)) {
+        return cpu->fetch_page[addr & BUS_PAGE_MASK];
+    }
+    cpu->fetch_page = cpu->bus->read_pages[addr >> BUS_PAGE_SHIFT];
+    cpu->fetch_page_addr = addr;
+    return cpu->fetch_page ? cpu->fetch_page[addr & BUS_PAGE_MASK] : bus_read(cpu->bus, addr);
 }
-byte_t branch_pc(cpu_s *cpu)
+
+static inline word_t fetch_pc_word(cpu_s *cpu)
 {
-    cpu->PC += address_rel;
-    return 0;
+    byte_t low = fetch_pc_byte(cpu, 1);
+    byte_t high = fetch_pc_byte(cpu, 2);
+    return assemble_word(high, low);
 }
 
-static byte_t peek(cpu_s *cpu)
+// https://www.nesdev.org/wiki/CPU_memory_map
+// $0000-$00FF is always internal RAM, so zero page pointers skip the bus
+static inline byte_t read_zero_page(cpu_s *cpu, byte_t address)
 {
     assert(cpu != NULL && cpu->bus != NULL);
-    return bus_read(cpu->bus, cpu->PC);
+    return cpu->bus->ram[address];
 }
 
-byte_t read_from_addr(cpu_s *cpu, word_t address)
+void cpu_invalidate_fetch_page(cpu_s *cpu)
 {
-    assert(cpu != NULL && cpu->bus != NULL);
-    return bus_read(cpu->bus, address);
+    assert(cpu != NULL);
+    cpu->fetch_page = NULL;
 }
 
+static void invalidate_written_code(cpu_s *cpu, word_t address);
+
 void write_to_addr(cpu_s *cpu, word_t address, byte_t value)
 {
     assert(cpu != NULL && cpu->bus != NULL);
     bus_write(cpu->bus, address, value);
+    if (cpu->block_cache && cpu->block_cache->code_pages[address >> BUS_PAGE_SHIFT]) {
+        invalidate_written_code(cpu, address);
+    }
     return;
 }
 
-void push_byte_to_stack(cpu_s *cpu, byte_t byte)
+// https://www.nesdev.org/wiki/Stack
+// The stack is always page 1 of internal RAM, so it is indexed directly
+// rather than through the bus; SP wraps within the page as a byte.
+#define STACK_PAGE 0x0100
+
+static inline byte_t *stack_page(cpu_s *cpu)
 {
-    assert(cpu != NULL && bus_get_instance() != NULL);
-    if (cpu->SP == 0x00)
-    {
-        cpu->SP = 0xFF;
+    return &cpu->bus->ram[STACK_PAGE];
+}
+
+static inline void stack_written(cpu_s *cpu)
+{
+    if (cpu->block_cache && cpu->block_cache->code_pages[STACK_PAGE >> BUS_PAGE_SHIFT]) {
+        invalidate_written_code(cpu, STACK_PAGE);
     }
-    word_t stack_addr = 0x0100 + cpu->SP;
-    write_to_addr(cpu, stack_addr, byte);
-    cpu->SP--;
-    return;
+}
+
+void push_byte_to_stack(cpu_s *cpu, byte_t byte)
+{
+    assert(cpu != NULL && cpu->bus != NULL);
+    stack_page(cpu)[cpu->SP--] = byte;
+    stack_written(cpu);
 }
 
 byte_t pop_byte(cpu_s *cpu)
 {
-    assert(cpu != NULL && bus_get_instance() != NULL);
-    cpu->SP++;
-    if (cpu->SP == 0xFF)
-    {
-        cpu->SP = 0x00;
-    }
-    word_t stack_addr = 0x0100 + cpu->SP;
-    byte_t byte = read_from_addr(cpu, stack_addr);
-    return byte;
+    assert(cpu != NULL && cpu->bus != NULL);
+    return stack_page(cpu)[++cpu->SP];
+}
+
+// High byte first, so the low byte ends up at the lower address
+static void push_address(cpu_s *cpu, word_t addr)
+{
+    assert(cpu != NULL && cpu->bus != NULL);
+    byte_t *stack = stack_page(cpu);
+    stack[cpu->SP] = addr >> 8;
+    stack[(byte_t)(cpu->SP - 1)] = addr & 0xFF;
+    cpu->SP -= 2;
+    stack_written(cpu);
+}
+
+static word_t pop_address(cpu_s *cpu)
+{
+    assert(cpu != NULL && cpu->bus != NULL);
+    const byte_t *stack = stack_page(cpu);
+    byte_t low = stack[(byte_t)(cpu->SP + 1)];
+    byte_t high = stack[(byte_t)(cpu->SP + 2)];
+    cpu->SP += 2;
+    return assemble_word(high, low);
+}
+
+// Return address then status, as BRK, IRQ and NMI push them
+static void push_interrupt_frame(cpu_s *cpu, word_t return_addr, byte_t status)
+{
+    byte_t *stack = stack_page(cpu);
+    stack[cpu->SP] = return_addr >> 8;
+    stack[(byte_t)(cpu->SP - 1)] = return_addr & 0xFF;
+    stack[(byte_t)(cpu->SP - 2)] = status;
+    cpu->SP -= 3;
+    stack_written(cpu);
 }
 
 bool fetch_and_execute(cpu_s *cpu)
 {
     assert(cpu != NULL && cpu->instruction_pending);
-    cpu_instruction_s *instruction = get_current_instruction(cpu);
+    const cpu_instruction_s *instruction = get_current_instruction(cpu);
     bool result = instruction->data_fetch(cpu);
     result = instruction->execute(cpu) && result;
     return result;
@@ -2364,23 +222,29 @@ void cpu_init(cpu_s *cpu)
     cpu->X = 0x00;
     cpu->Y = 0x00;
     cpu->SP = 0xFD;
-    cpu->STATUS = 0x00 | STATUS_FLAG_U;
+    cpu_set_status(cpu, 0x00 | STATUS_FLAG_U);
     cpu->PC = 0x0000;
     cpu->cycles = 7;
     cpu->current_opcode = 0x00;
     cpu->instruction_pending = false;
-    init_instruction_table(cpu);
-
-    reset_globals();
+    cpu->address = 0x0000;
+    cpu->address_rel = 0x00;
+    cpu->acc_mode = false;
+    cpu->fetch_page = NULL;
+    cpu->fetch_page_addr = 0x0000;
+    cpu->cycle_limit = 0;
+    cpu->breakpoints = NULL;
+    cpu->idle_loop_skip = true;
+    cpu->idle_cycles_skipped = 0;
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
     return;
 }
 
 void reset(cpu_s *cpu)
 {
     cpu_init(cpu);
-    reset_globals();
     cpu->PC = assemble_word(read_from_addr(cpu, 0xFFFD), read_from_addr(cpu, 0xFFFC));
-    cpu->STATUS = (rand() % 256) | STATUS_FLAG_U;
+    cpu_set_status(cpu, (rand() % 256) | STATUS_FLAG_U);
     return;
 }
 
@@ -2390,21 +254,22 @@ void irq(cpu_s *cpu)
     {
         return;
     }
-    push_address(cpu, cpu->PC);
-    push_byte_to_stack(cpu, cpu->STATUS);
+    push_interrupt_frame(cpu, cpu->PC, cpu_get_status(cpu));
     set_flag(cpu, STATUS_FLAG_I, true);
     cpu->PC = (read_from_addr(cpu, 0xFFFF) << 8) | read_from_addr(cpu, 0xFFFE);
     cpu->cycles += 7;
+    // The handler may change what an interrupted polling loop reads
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
     return;
 }
 
 void nmi(cpu_s *cpu)
 {
-    push_address(cpu, cpu->PC);
-    push_byte_to_stack(cpu, cpu->STATUS);
+    push_interrupt_frame(cpu, cpu->PC, cpu_get_status(cpu));
     set_flag(cpu, STATUS_FLAG_I, 1);
     cpu->PC = (read_from_addr(cpu, 0xFFFB) << 8) | read_from_addr(cpu, 0xFFFA);
     cpu->cycles += 7;
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
     return;
 }
 
@@ -2414,37 +279,42 @@ void adjust_pc(cpu_s *cpu, byte_t length)
     return;
 }
 
-cpu_instruction_s *get_instruction(cpu_s *cpu, byte_t opcode)
+const cpu_instruction_s *get_instruction(byte_t opcode)
 {
-    return &cpu->table[opcode];
+    return &instruction_table[opcode];
 }
 
-cpu_instruction_s *get_current_instruction(cpu_s *cpu)
+const cpu_instruction_s *get_current_instruction(cpu_s *cpu)
 {
-    return get_instruction(cpu, cpu->current_opcode);
+    return get_instruction(cpu->current_opcode);
 }
 
+// Only instructions that consume an operand read it; stores and jumps use
+// cpu->address alone so they never touch the effective address on the bus
+static inline byte_t fetch_operand(cpu_s *cpu)
+{
+    return cpu->acc_mode ? cpu->A : read_from_addr(cpu, cpu->address);
+}
 
 byte_t IMP(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
+    cpu->acc_mode = false;
     return 0;
 }
 
 byte_t ACC(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    value = cpu->A;
-    acc_mode = true;
+    cpu->acc_mode = true;
     return 0;
 }
 
 byte_t IMM(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    value = read_from_addr(cpu, cpu->PC + 1);
+    cpu->acc_mode = false;
+    cpu->address = cpu->PC + 1;
     return 0;
 }
 
@@ -2452,51 +322,44 @@ byte_t IMM(cpu_s *cpu)
 byte_t ZP0(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    address = read_from_addr(cpu, cpu->PC + 1);
-    address = address & 0x00FF;
-    value = read_from_addr(cpu, address);
+    cpu->acc_mode = false;
+    word_t address = fetch_pc_byte(cpu, 1);
+    cpu->address = address;
     return 0;
 }
 
 byte_t ZPX(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    address = read_from_addr(cpu, cpu->PC + 1) & 0x00FF;
-    address += cpu->X;
-    address = address & 0x00FF;
-    value = read_from_addr(cpu, address);
+    cpu->acc_mode = false;
+    word_t address = (fetch_pc_byte(cpu, 1) + cpu->X) & 0x00FF;
+    cpu->address = address;
     return 0;
 }
 
 byte_t ZPY(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    address = read_from_addr(cpu, cpu->PC + 1) & 0x00FF;
-    address += cpu->Y;
-    address = address & 0x00FF;
-    value = read_from_addr(cpu, address);
+    cpu->acc_mode = false;
+    word_t address = (fetch_pc_byte(cpu, 1) + cpu->Y) & 0x00FF;
+    cpu->address = address;
     return 0;
 }
 
 byte_t REL(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    address_rel = read_from_addr(cpu, cpu->PC + 1);
+    cpu->acc_mode = false;
+    cpu->address_rel = fetch_pc_byte(cpu, 1);
     return 0;
 }
 
 byte_t ABS(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    byte_t low_byte = read_from_addr(cpu, cpu->PC + 1);
-    byte_t high_byte = read_from_addr(cpu, cpu->PC + 2);
-    address = assemble_word(high_byte, low_byte);
-    value = read_from_addr(cpu, address);
+    cpu->acc_mode = false;
+    word_t address = fetch_pc_word(cpu);
+    cpu->address = address;
     return 0;
 }
 
@@ -2504,42 +367,36 @@ byte_t ABS(cpu_s *cpu)
 byte_t ABX(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    byte_t low_byte = read_from_addr(cpu, cpu->PC + 1);
-    byte_t high_byte = read_from_addr(cpu, cpu->PC + 2);
-    address = assemble_word(high_byte, low_byte);
-    address += cpu->X;
-    value = read_from_addr(cpu, address);
-    return crosses_page(address - cpu->X, address) ? 1 : 0;
+    cpu->acc_mode = false;
+    word_t base = fetch_pc_word(cpu);
+    word_t address = base + cpu->X;
+    cpu->address = address;
+    return crosses_page(base, address) ? 1 : 0;
 }
 
 
 byte_t ABY(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    byte_t low_byte = read_from_addr(cpu, cpu->PC + 1);
-    byte_t high_byte = read_from_addr(cpu, cpu->PC + 2);
-    address = assemble_word(high_byte, low_byte);
-    address += cpu->Y;
-    value = read_from_addr(cpu, address);
-    return crosses_page(address - cpu->Y, address) ? 1 : 0;
+    cpu->acc_mode = false;
+    word_t base = fetch_pc_word(cpu);
+    word_t address = base + cpu->Y;
+    cpu->address = address;
+    return crosses_page(base, address) ? 1 : 0;
 }
 
 
 byte_t IND(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    byte_t low_byte = read_from_addr(cpu, cpu->PC + 1);
-    byte_t high_byte = read_from_addr(cpu, cpu->PC + 2);
-    word_t ptr = assemble_word(high_byte, low_byte);
+    cpu->acc_mode = false;
+    word_t ptr = fetch_pc_word(cpu);
 
-    low_byte = read_from_addr(cpu, ptr);
-    high_byte = (ptr & 0x00FF) == 0x00FF ? read_from_addr(cpu, ptr & 0xFF00) : read_from_addr(cpu, ptr + 1);
+    byte_t low_byte = read_from_addr(cpu, ptr);
+    byte_t high_byte = (ptr & 0x00FF) == 0x00FF ? read_from_addr(cpu, ptr & 0xFF00) : read_from_addr(cpu, ptr + 1);
 
-    address = assemble_word(high_byte, low_byte);
-    value = read_from_addr(cpu, address);
+    word_t address = assemble_word(high_byte, low_byte);
+    cpu->address = address;
     return 0;
 }
 
@@ -2547,25 +404,24 @@ byte_t IND(cpu_s *cpu)
 byte_t IZX(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    byte_t zp_addr = read_from_addr(cpu, cpu->PC + 1);
-    byte_t low = read_from_addr(cpu, (zp_addr + cpu->X) & 0x00FF);
-    byte_t high = read_from_addr(cpu, (zp_addr + cpu->X + 1) & 0x00FF);
-    address = assemble_word(high, low);
-    value = read_from_addr(cpu, address);
+    cpu->acc_mode = false;
+    byte_t zp_addr = fetch_pc_byte(cpu, 1);
+    byte_t low = read_zero_page(cpu, zp_addr + cpu->X);
+    byte_t high = read_zero_page(cpu, zp_addr + cpu->X + 1);
+    word_t address = assemble_word(high, low);
+    cpu->address = address;
     return 0;
 }
 
 byte_t IZY(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    acc_mode = false;
-    word_t ptr = (word_t)read_from_addr(cpu, cpu->PC + 1);
-    ptr = ptr & 0x00FF;
-    address = assemble_word(read_from_addr(cpu, (ptr + 1) & 0x00FF), read_from_addr(cpu, ptr));
-    address += cpu->Y;
-    value = read_from_addr(cpu, address);
-    return crosses_page(address - cpu->Y, address) ? 1 : 0;
+    cpu->acc_mode = false;
+    byte_t ptr = fetch_pc_byte(cpu, 1);
+    word_t base = assemble_word(read_zero_page(cpu, ptr + 1), read_zero_page(cpu, ptr));
+    word_t address = base + cpu->Y;
+    cpu->address = address;
+    return crosses_page(base, address) ? 1 : 0;
 }
 
 
@@ -2573,9 +429,7 @@ byte_t BRK(cpu_s *cpu)
 {
     assert(cpu != NULL);
     cpu->PC++;
-    push_address(cpu, cpu->PC);
-    set_flag(cpu, STATUS_FLAG_B, true);
-    push_byte_to_stack(cpu, cpu->STATUS);
+    push_interrupt_frame(cpu, cpu->PC, cpu_get_status(cpu) | STATUS_FLAG_B);
     set_flag(cpu, STATUS_FLAG_B, false);
     set_flag(cpu, STATUS_FLAG_I, true);
     cpu->PC = assemble_word(read_from_addr(cpu, 0xFFFF), read_from_addr(cpu, 0xFFFE));
@@ -2585,6 +439,7 @@ byte_t BRK(cpu_s *cpu)
 
 byte_t ORA(cpu_s *cpu)
 {
+    byte_t value = fetch_operand(cpu);
     cpu->A |= value;
     set_zn(cpu, cpu->A);
     return 1;
@@ -2594,22 +449,23 @@ byte_t ORA(cpu_s *cpu)
 byte_t ASL(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     set_flag(cpu, STATUS_FLAG_C, value & 0x80);
     value <<= 1;
     set_zn(cpu, value);
-    if (acc_mode)
+    if (cpu->acc_mode)
     {
         cpu->A = value;
     }
     else
     {
-        write_to_addr(cpu, address, value);
+        write_to_addr(cpu, cpu->address, value);
     }
     return 0;
 }
 byte_t PHP(cpu_s *cpu)
 {
-    push_byte_to_stack(cpu, cpu->STATUS | STATUS_FLAG_B | STATUS_FLAG_U);
+    push_byte_to_stack(cpu, cpu_get_status(cpu) | STATUS_FLAG_B | STATUS_FLAG_U);
     return 0;
 }
 
@@ -2620,7 +476,7 @@ byte_t branch_on_flag(cpu_s *cpu, cpu_status_flag_e flag, byte_t flag_value)
     {
         cpu->PC += 2;
         word_t old_PC = cpu->PC;
-        cpu->PC += address_rel;
+        cpu->PC += cpu->address_rel;
         cpu->pc_changed = true;
         if (crosses_page(old_PC, cpu->PC))
         {
@@ -2653,7 +509,7 @@ byte_t JSR(cpu_s *cpu)
     assert(cpu != NULL);
     word_t val = cpu->PC + 2;
     push_address(cpu, val);
-    cpu->PC = address;
+    cpu->PC = cpu->address;
     cpu->pc_changed = true;
     return 0;
 }
@@ -2661,6 +517,7 @@ byte_t JSR(cpu_s *cpu)
 byte_t AND(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     cpu->A &= value;
     set_zn(cpu, cpu->A);
     return 1;
@@ -2669,6 +526,7 @@ byte_t AND(cpu_s *cpu)
 byte_t BIT(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t result = cpu->A & value;
     set_flag(cpu, STATUS_FLAG_Z, result == 0x00);
     set_flag(cpu, STATUS_FLAG_N, value & 0x80);
@@ -2679,18 +537,19 @@ byte_t BIT(cpu_s *cpu)
 byte_t ROL(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t carry = (byte_t) get_flag(cpu, STATUS_FLAG_C);
     set_flag(cpu, STATUS_FLAG_C, value & 0x80);
     value <<= 1;
     value |= carry;
     set_zn(cpu, value);
-    if (acc_mode)
+    if (cpu->acc_mode)
     {
         cpu->A = value;
     }
     else
     {
-        write_to_addr(cpu, address, value);
+        write_to_addr(cpu, cpu->address, value);
     }
     return 0;
 }
@@ -2698,7 +557,7 @@ byte_t ROL(cpu_s *cpu)
 byte_t PLP(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    cpu->STATUS = pop_byte(cpu);
+    cpu_set_status(cpu, pop_byte(cpu));
     set_flag(cpu, STATUS_FLAG_U, true);
     set_flag(cpu, STATUS_FLAG_B, false);
     return 0;
@@ -2721,10 +580,8 @@ byte_t SEC(cpu_s *cpu)
 byte_t RTI(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    cpu->STATUS = pop_byte(cpu);
-    byte_t low = pop_byte(cpu);
-    byte_t high = pop_byte(cpu);
-    cpu->PC = assemble_word(high, low);
+    cpu_set_status(cpu, pop_byte(cpu));
+    cpu->PC = pop_address(cpu);
     set_flag(cpu, STATUS_FLAG_U, true);
     set_flag(cpu, STATUS_FLAG_B, false);
     cpu->pc_changed = true;
@@ -2735,6 +592,7 @@ byte_t RTI(cpu_s *cpu)
 byte_t EOR(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     cpu->A ^= value;
     set_zn(cpu, cpu->A);
     return 1;
@@ -2743,16 +601,17 @@ byte_t EOR(cpu_s *cpu)
 byte_t LSR(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     set_flag(cpu, STATUS_FLAG_C, value & 0x01);
     value >>= 1;
     set_zn(cpu, value);
-    if (acc_mode)
+    if (cpu->acc_mode)
     {
         cpu->A = value;
     }
     else
     {
-        write_to_addr(cpu, address, value);
+        write_to_addr(cpu, cpu->address, value);
     }
     return 0;
 }
@@ -2767,7 +626,7 @@ byte_t PHA(cpu_s *cpu)
 byte_t JMP(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    cpu->PC = address;
+    cpu->PC = cpu->address;
     cpu->pc_changed = true;
     return 0;
 }
@@ -2789,9 +648,7 @@ byte_t CLI(cpu_s *cpu)
 byte_t RTS(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    cpu->PC = pop_byte(cpu);
-    cpu->PC |= (pop_byte(cpu) << 8);
-    cpu->PC++;
+    cpu->PC = pop_address(cpu) + 1;
     cpu->pc_changed = true;
     return 0;
 }
@@ -2800,6 +657,7 @@ byte_t RTS(cpu_s *cpu)
 byte_t ADC(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     word_t result = cpu->A + value + get_flag(cpu, STATUS_FLAG_C);
     set_flag(cpu, STATUS_FLAG_C, result > 0xFF);
     set_flag(cpu, STATUS_FLAG_Z, (result & 0x00FF) == 0x0000);
@@ -2816,18 +674,19 @@ byte_t ADC(cpu_s *cpu)
 byte_t ROR(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t carry = (byte_t) get_flag(cpu, STATUS_FLAG_C);
     set_flag(cpu, STATUS_FLAG_C, value & 0x01);
     value >>= 1;
     value |= (carry << 7);
     set_zn(cpu, value);
-    if (acc_mode)
+    if (cpu->acc_mode)
     {
         cpu->A = value;
     }
     else
     {
-        write_to_addr(cpu, address, value);
+        write_to_addr(cpu, cpu->address, value);
     }
     return 0;
 }
@@ -2857,21 +716,21 @@ byte_t SEI(cpu_s *cpu)
 byte_t STA(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    write_to_addr(cpu, address, cpu->A);
+    write_to_addr(cpu, cpu->address, cpu->A);
     return 0;
 }
 
 byte_t STY(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    write_to_addr(cpu, address, cpu->Y);
+    write_to_addr(cpu, cpu->address, cpu->Y);
     return 0;
 }
 
 byte_t STX(cpu_s *cpu)
 {
     assert(cpu != NULL);
-    write_to_addr(cpu, address, cpu->X);
+    write_to_addr(cpu, cpu->address, cpu->X);
     return 0;
 }
 
@@ -2917,6 +776,7 @@ byte_t TXS(cpu_s *cpu)
 byte_t LDY(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     cpu->Y = value;
     set_zn(cpu, cpu->Y);
     return 1;
@@ -2925,6 +785,7 @@ byte_t LDY(cpu_s *cpu)
 byte_t LDA(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     cpu->A = value;
     set_zn(cpu, cpu->A);
     return 1;
@@ -2933,6 +794,7 @@ byte_t LDA(cpu_s *cpu)
 byte_t LDX(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     cpu->X = value;
     set_zn(cpu, cpu->X);
     return 1;
@@ -2979,6 +841,7 @@ byte_t TSX(cpu_s *cpu)
 byte_t CPY(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t result = cpu->Y - value;
     set_flag(cpu, STATUS_FLAG_C, cpu->Y >= value);
     set_zn(cpu, result);
@@ -2988,6 +851,7 @@ byte_t CPY(cpu_s *cpu)
 byte_t CMP(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t result = cpu->A - value;
     set_flag(cpu, STATUS_FLAG_C, cpu->A >= value);
     set_zn(cpu, result);
@@ -2997,9 +861,10 @@ byte_t CMP(cpu_s *cpu)
 byte_t DEC(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     value--;
     set_zn(cpu, value);
-    write_to_addr(cpu, address, value);
+    write_to_addr(cpu, cpu->address, value);
     return 0;
 }
 
@@ -3028,6 +893,7 @@ byte_t CLD(cpu_s *cpu)
 byte_t CPX(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     byte_t result = cpu->X - value;
     set_flag(cpu, STATUS_FLAG_C, cpu->X >= value);
     set_zn(cpu, result);
@@ -3037,6 +903,7 @@ byte_t CPX(cpu_s *cpu)
 byte_t SBC(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     word_t result = cpu->A - value - (1 - ((byte_t) get_flag(cpu, STATUS_FLAG_C)));
     set_flag(cpu, STATUS_FLAG_C, result < 0x100);
     set_flag(cpu, STATUS_FLAG_Z, (result & 0x00FF) == 0x0000);
@@ -3053,9 +920,10 @@ byte_t SBC(cpu_s *cpu)
 byte_t INC(cpu_s *cpu)
 {
     assert(cpu != NULL);
+    byte_t value = fetch_operand(cpu);
     value++;
     set_zn(cpu, value);
-    write_to_addr(cpu, address, value);
+    write_to_addr(cpu, cpu->address, value);
     return 0;
 }
 
@@ -3096,25 +964,49 @@ byte_t NOP(cpu_s *cpu)
     return 0;
 }
 
-void run_instruction(cpu_s *cpu)
+static inline void execute_opcode(cpu_s *cpu, byte_t opcode)
 {
-    assert(cpu != NULL);
-
-    cpu->current_opcode = bus_read(bus_get_instance(), cpu->PC);
+    cpu->current_opcode = opcode;
     cpu->instruction_pending = true;
     cpu->pc_changed = false;
 
-    cpu_instruction_s *instr = get_current_instruction(cpu);
+    const cpu_instruction_s *instr = &instruction_table[opcode];
 
     byte_t page_crossed = 0;
-    if (instr->data_fetch) {
-        page_crossed = instr->data_fetch(cpu);
-    }
-
     byte_t can_take_penalty = 0;
-    if (instr->execute) {
-        can_take_penalty = instr->execute(cpu);
+
+#if defined(CPU_DISPATCH_SWITCH)
+    switch (opcode) {
+        #define X(name, mode, opcode, cycles, length) \
+        case opcode: page_crossed = mode(cpu); can_take_penalty = name(cpu); break;
+        INSTRUCTION_OPCODE_TABLE
+        #undef X
+        default: page_crossed = IMP(cpu); can_take_penalty = ILLEGAL(cpu); break;
     }
+#elif defined(CPU_DISPATCH_GOTO)
+    static const void *const dispatch[256] = {
+        #define X(name, mode, opcode, cycles, length) [opcode] = &&op_##name##_##mode,
+        INSTRUCTION_OPCODE_TABLE
+        #undef X
+        #define X(opcode) [opcode] = &&op_illegal,
+        UNDEFINED_OPCODES
+        #undef X
+    };
+
+    goto *dispatch[opcode];
+
+    #define X(name, mode, opcode, cycles, length) \
+    op_##name##_##mode: page_crossed = mode(cpu); can_take_penalty = name(cpu); goto dispatched;
+    INSTRUCTION_OPCODE_TABLE
+    #undef X
+op_illegal:
+    page_crossed = IMP(cpu);
+    can_take_penalty = ILLEGAL(cpu);
+dispatched:
+#else
+    page_crossed = instr->data_fetch(cpu);
+    can_take_penalty = instr->execute(cpu);
+#endif
 
     cpu->cycles += instr->cycles;
 
@@ -3128,3 +1020,347 @@ void run_instruction(cpu_s *cpu)
 
     cpu->instruction_pending = false;
 }
+
+// Same as execute_opcode, minus the fetch and decode
+static inline void execute_decoded(cpu_s *cpu, const cpu_decoded_op_s *op)
+{
+    cpu->current_opcode = op->opcode;
+    cpu->instruction_pending = true;
+    cpu->pc_changed = false;
+
+    byte_t page_crossed = 0;
+    if (op->data_fetch) {
+        page_crossed = op->data_fetch(cpu);
+    } else {
+        cpu->acc_mode = op->acc_mode;
+        cpu->address = op->address;
+        cpu->address_rel = op->address_rel;
+    }
+    byte_t can_take_penalty = op->execute(cpu);
+
+    cpu->cycles += op->cycles;
+
+    if (page_crossed && can_take_penalty) {
+        cpu->cycles += 1;
+    }
+
+    if (!cpu->pc_changed) {
+        cpu->PC += op->length;
+    }
+
+    cpu->instruction_pending = false;
+}
+
+static bool ends_basic_block(const cpu_instruction_s *instr)
+{
+    return instr->data_fetch == REL || instr->execute == JMP || instr->execute == JSR ||
+           instr->execute == RTS || instr->execute == RTI || instr->execute == BRK;
+}
+
+// Flags every page that maps the same memory as page, so a write through
+// any mirror of it drops the code decoded there
+static void mark_code_page(cpu_s *cpu, int page)
+{
+    bus_s *bus = cpu->bus;
+    const byte_t *mem = bus->read_pages[page];
+    for (int alias = 0; alias < CPU_PAGE_COUNT; alias++) {
+        if (bus->write_pages[alias] == mem) {
+            cpu->block_cache->code_pages[alias] = true;
+        }
+    }
+}
+
+static bool decode_op(cpu_s *cpu, word_t pc, cpu_decoded_op_s *op)
+{
+    bus_s *bus = cpu->bus;
+
+    // Only plain memory reads the same every time; I/O is never cached, and
+    // never read here either, since its handlers have side effects
+    const byte_t *mem = bus->read_pages[pc >> BUS_PAGE_SHIFT];
+    if (!mem) {
+        return false;
+    }
+    byte_t opcode = mem[pc & BUS_PAGE_MASK];
+    const cpu_instruction_s *instr = &instruction_table[opcode];
+    if (instr->execute == ILLEGAL) {
+        return false;
+    }
+
+    byte_t bytes[3] = {opcode, 0, 0};
+    for (int i = 0; i < instr->length; i++) {
+        word_t addr = pc + i;
+        int page = addr >> BUS_PAGE_SHIFT;
+        mem = bus->read_pages[page];
+        if (!mem) {
+            return false;
+        }
+        if (bus->write_pages[page]) {
+            mark_code_page(cpu, page);
+        }
+        bytes[i] = mem[addr & BUS_PAGE_MASK];
+    }
+
+    byte_t low = bytes[1];
+    byte_t high = bytes[2];
+
+    op->data_fetch = NULL;
+    op->execute = instr->execute;
+    op->address = 0;
+    op->address_rel = 0;
+    op->acc_mode = instr->data_fetch == ACC;
+    op->opcode = opcode;
+    op->cycles = instr->cycles;
+    op->length = instr->length;
+    op->block_end = ends_basic_block(instr);
+
+    if (instr->data_fetch == IMM) {
+        op->address = pc + 1;
+    } else if (instr->data_fetch == ZP0) {
+        op->address = low;
+    } else if (instr->data_fetch == ABS) {
+        op->address = assemble_word(high, low);
+    } else if (instr->data_fetch == REL) {
+        op->address_rel = (offset_t)low;
+    } else if (instr->data_fetch != IMP && instr->data_fetch != ACC) {
+        op->data_fetch = instr->data_fetch;
+    }
+    return true;
+}
+
+#define BASIC_BLOCK_MAX_OPS 64
+
+// Decodes the basic block starting at pc, stopping early where it runs into
+// code decoded before. Returns false when nothing at pc could be decoded.
+static bool decode_block(cpu_s *cpu, word_t pc)
+{
+    cpu_decoded_op_s *ops = cpu->block_cache->ops;
+    for (int i = 0; i < BASIC_BLOCK_MAX_OPS; i++) {
+        if (i > 0 && ops[pc].execute) {
+            break;
+        }
+        if (!decode_op(cpu, pc, &ops[pc])) {
+            return i > 0;
+        }
+        if (ops[pc].block_end) {
+            break;
+        }
+        pc += ops[pc].length;
+    }
+    return true;
+}
+
+// Returns the decoded instruction at PC, or NULL when it can't be cached
+static inline const cpu_decoded_op_s *lookup_decoded(cpu_s *cpu)
+{
+    cpu_block_cache_s *cache = cpu->block_cache;
+    const cpu_decoded_op_s *op = &cache->ops[cpu->PC];
+    if (op->execute) {
+        cache->hits++;
+        return op;
+    }
+    cache->misses++;
+    return decode_block(cpu, cpu->PC) ? op : NULL;
+}
+
+void cpu_block_cache_flush(cpu_block_cache_s *cache)
+{
+    assert(cache != NULL);
+    memset(cache->ops, 0, sizeof(cache->ops));
+    memset(cache->code_pages, 0, sizeof(cache->code_pages));
+}
+
+// Drops the code decoded in page, and any instruction straddling into it
+void cpu_block_cache_invalidate_page(cpu_block_cache_s *cache, byte_t page)
+{
+    assert(cache != NULL);
+    int start = (page << 8) - 2;
+    int end = (page << 8) + 0x100;
+    for (int addr = start < 0 ? 0 : start; addr < end; addr++) {
+        cache->ops[addr].execute = NULL;
+    }
+}
+
+// Drops all code decoded from writable memory, for when any of it may have
+// changed at once
+void cpu_block_cache_invalidate_writable(cpu_block_cache_s *cache)
+{
+    assert(cache != NULL);
+    for (int page = 0; page < CPU_PAGE_COUNT; page++) {
+        if (cache->code_pages[page]) {
+            cpu_block_cache_invalidate_page(cache, page);
+            cache->code_pages[page] = false;
+        }
+    }
+}
+
+static void invalidate_written_code(cpu_s *cpu, word_t address)
+{
+    bus_s *bus = cpu->bus;
+    cpu_block_cache_s *cache = cpu->block_cache;
+    const byte_t *mem = bus->write_pages[address >> BUS_PAGE_SHIFT];
+    for (int page = 0; page < CPU_PAGE_COUNT; page++) {
+        if (mem && bus->read_pages[page] == mem) {
+            cpu_block_cache_invalidate_page(cache, page);
+            cache->code_pages[page] = false;
+        }
+    }
+}
+
+void run_instruction(cpu_s *cpu)
+{
+    assert(cpu != NULL);
+    const cpu_decoded_op_s *op = cpu->block_cache ? lookup_decoded(cpu) : NULL;
+    if (op) {
+        execute_decoded(cpu, op);
+    } else {
+        execute_opcode(cpu, fetch_pc_byte(cpu, 0));
+    }
+}
+
+#define IDLE_LOOP_MAX_BYTES 16
+
+static bool is_io_address(word_t addr)
+{
+    return addr >= 0x2000 && addr < 0x6000;
+}
+
+// A loop body qualifies when it only loads, compares and branches, and its
+// memory operands are RAM, cartridge space or PPUSTATUS. Such a loop can't
+// change anything but registers, so once an iteration starts and ends with
+// the same registers it repeats until memory changes under it.
+static bool scan_idle_loop(cpu_s *cpu, word_t head, word_t jump_pc, bool *reads_ppu_status)
+{
+    *reads_ppu_status = false;
+    if (is_io_address(head) || jump_pc - head > IDLE_LOOP_MAX_BYTES) {
+        return false;
+    }
+
+    word_t pc = head;
+    for (;;) {
+        const cpu_instruction_s *instr = &instruction_table[bus_read(cpu->bus, pc)];
+        instruction_func_t op = instr->execute;
+        instruction_func_t mode = instr->data_fetch;
+
+        if (pc == jump_pc) {
+            return mode == REL || (op == JMP && mode == ABS);
+        }
+
+        bool reads_only = op == LDA || op == LDX || op == LDY || op == BIT ||
+                          op == CMP || op == CPX || op == CPY ||
+                          op == AND || op == ORA || op == EOR;
+        bool branch = mode == REL;
+        if (!reads_only && !branch && op != NOP) {
+            return false;
+        }
+
+        if (mode == ABS || mode == ABX || mode == ABY) {
+            word_t addr = assemble_word(bus_read(cpu->bus, pc + 2), bus_read(cpu->bus, pc + 1));
+            if (mode == ABS && (addr & 0xE007) == 0x2002) {
+                *reads_ppu_status = true;
+            } else if (is_io_address(addr) || (mode != ABS && is_io_address(addr + 0xFF))) {
+                return false;
+            }
+        } else if (mode == IND || mode == IZX || mode == IZY) {
+            return false;
+        }
+
+        pc += instr->length;
+        if (pc > jump_pc || pc < head) {
+            return false;
+        }
+    }
+}
+
+static bool loop_has_breakpoint(cpu_s *cpu, word_t head, word_t jump_pc)
+{
+    if (!cpu->breakpoints) {
+        return false;
+    }
+    for (int offset = 0; offset <= jump_pc - head; offset++) {
+        if (cpu_breakpoint_is_set(cpu->breakpoints, (word_t)(head + offset))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called after a jump from jump_pc back to cpu->PC. The second time the loop
+// head is reached with the same registers, the iterations that would finish
+// before the budget runs out, or before PPUSTATUS can change, are skipped in
+// one step. The remainder runs normally, so timing is unchanged.
+static void check_idle_loop(cpu_s *cpu, word_t jump_pc)
+{
+    cpu_idle_loop_s *loop = &cpu->idle_loop;
+    word_t head = cpu->PC;
+
+    if (loop->head != head || loop->jump_pc != jump_pc || loop->cycles == 0) {
+        loop->head = head;
+        loop->jump_pc = jump_pc;
+        loop->idle = scan_idle_loop(cpu, head, jump_pc, &loop->reads_ppu_status);
+    } else if (loop->idle &&
+               loop->A == cpu->A && loop->X == cpu->X && loop->Y == cpu->Y &&
+               loop->SP == cpu->SP && loop->STATUS == cpu_get_status(cpu) &&
+               !loop_has_breakpoint(cpu, head, jump_pc)) {
+        size_t period = cpu->cycles - loop->cycles;
+        size_t until = cpu->cycle_limit;
+        if (loop->reads_ppu_status) {
+            size_t change = bus_ppu_status_change_cycle(cpu->bus);
+            if (change < until) {
+                until = change;
+            }
+        }
+        if (until > cpu->cycles) {
+            size_t skipped = (until - cpu->cycles) / period * period;
+            cpu->cycles += skipped;
+            cpu->idle_cycles_skipped += skipped;
+        }
+    }
+
+    loop->cycles = cpu->cycles;
+    loop->A = cpu->A;
+    loop->X = cpu->X;
+    loop->Y = cpu->Y;
+    loop->SP = cpu->SP;
+    loop->STATUS = cpu_get_status(cpu);
+}
+
+cpu_run_result_e cpu_run_cycles(cpu_s *cpu, size_t budget)
+{
+    assert(cpu != NULL);
+
+    cpu->cycle_limit = cpu->cycles + budget;
+
+    while (cpu->cycles < cpu->cycle_limit) {
+#if defined(CPU_JIT)
+        // Breakpoints are only checked between instructions by the interpreter
+        word_t last_pc;
+        if (cpu->jit && cpu->block_cache && !cpu->breakpoints && cpu_jit_run(cpu->jit, cpu, &last_pc)) {
+            if (cpu->PC <= last_pc && cpu->idle_loop_skip) {
+                check_idle_loop(cpu, last_pc);
+            }
+            continue;
+        }
+#endif
+        word_t pc = cpu->PC;
+        const cpu_decoded_op_s *op = cpu->block_cache ? lookup_decoded(cpu) : NULL;
+        if (op) {
+            execute_decoded(cpu, op);
+        } else {
+            byte_t opcode = bus_read(cpu->bus, pc);
+            if (instruction_table[opcode].execute == ILLEGAL) {
+                return CPU_RUN_RESULT_ILLEGAL_OPCODE;
+            }
+            execute_opcode(cpu, opcode);
+        }
+
+        if (cpu->PC <= pc && cpu->idle_loop_skip) {
+            check_idle_loop(cpu, pc);
+        }
+
+        if (cpu->breakpoints && cpu_breakpoint_is_set(cpu->breakpoints, cpu->PC)) {
+            return CPU_RUN_RESULT_BREAKPOINT;
+        }
+    }
+
+    return CPU_RUN_RESULT_BUDGET_SPENT;
+}
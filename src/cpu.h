@@ -7,6 +7,15 @@
 #include "cpu_defs.h"
 
 typedef struct bus bus_s;
+typedef struct cpu_jit_s cpu_jit_s;
+
+#define CPU_BREAKPOINT_BITMAP_SIZE (0x10000 / 8)
+
+typedef enum {
+    CPU_RUN_RESULT_BUDGET_SPENT,
+    CPU_RUN_RESULT_BREAKPOINT,
+    CPU_RUN_RESULT_ILLEGAL_OPCODE,
+} cpu_run_result_e;
 
 typedef struct {
     const char *name;
@@ -17,45 +26,162 @@ typedef struct {
     instruction_func_t execute;
 } cpu_instruction_s;
 
+// A short backward loop seen by cpu_run_cycles; see check_idle_loop in cpu.c
+typedef struct {
+    word_t head;
+    word_t jump_pc;
+    bool idle;
+    bool reads_ppu_status;
+    size_t cycles;
+    byte_t A, X, Y, SP, STATUS;
+} cpu_idle_loop_s;
+
+// An instruction decoded from plain memory. Operand addresses that can't
+// change (immediate, zero page, absolute, relative) are resolved up front
+// and data_fetch is NULL; the rest keep their addressing mode function.
+typedef struct {
+    instruction_func_t data_fetch;
+    instruction_func_t execute;
+    word_t address;
+    offset_t address_rel;
+    bool acc_mode;
+    byte_t opcode;
+    byte_t cycles;
+    byte_t length;
+    // Branch, jump, call, return or BRK: the last op of its basic block
+    bool block_end;
+} cpu_decoded_op_s;
+
+#define CPU_PAGE_COUNT 256
+
+// Decoded instructions indexed by address. A miss decodes the whole basic
+// block from there, up to the next jump, branch or return, so the following
+// instructions hit. Pages of CPU-writable memory that hold decoded code are
+// flagged and dropped when the CPU writes to them.
+typedef struct {
+    cpu_decoded_op_s ops[0x10000];
+    bool code_pages[CPU_PAGE_COUNT];
+    size_t hits;
+    size_t misses;
+} cpu_block_cache_s;
+
 struct cpu_s {
     byte_t A;
     byte_t X;
     byte_t Y;
     byte_t SP;
     word_t PC;
-    byte_t STATUS;
+
+    // https://www.nesdev.org/wiki/Status_flags
+    // P is split up so ALU ops store results instead of masking bits in and
+    // out: N is bit 7 of n_result and Z is set when z_result is 0, as last
+    // computed; C and V are plain booleans; P holds I, D, B and U. Use
+    // cpu_get_status/cpu_set_status for the assembled register.
+    byte_t P;
+    byte_t n_result;
+    byte_t z_result;
+    bool carry;
+    bool overflow;
 
     size_t cycles;
     byte_t current_opcode;
     bool instruction_pending;
     bool pc_changed;
-    cpu_instruction_s table[256];
+
+    word_t address;
+    offset_t address_rel;
+    bool acc_mode;
+
+    // Everything above is saved in save states as one block (see
+    // CPU_SAVED_BYTES); everything below is configuration or caches
+
+    // Memory behind the page instruction bytes were last fetched from, or
+    // NULL; cleared whenever the bus page tables change
+    const byte_t *fetch_page;
+    word_t fetch_page_addr;
+
+    size_t cycle_limit;
+    // Optional bitmap of CPU_BREAKPOINT_BITMAP_SIZE bytes, one bit per address
+    const byte_t *breakpoints;
+
+    // Fast-forward through loops that only poll memory; off for accuracy tests
+    bool idle_loop_skip;
+    size_t idle_cycles_skipped;
+    cpu_idle_loop_s idle_loop;
+
+    // Optional; NULL decodes every instruction from the bus as it runs
+    cpu_block_cache_s *block_cache;
+    // Optional, CPU_JIT builds only; runs hot PRG ROM blocks as native code
+    cpu_jit_s *jit;
 
     bus_s *bus;
 };
 
-cpu_s* cpu_get_instance(void);
+#define CPU_SAVED_BYTES offsetof(cpu_s, fetch_page)
 
 void irq(cpu_s *cpu);
 void nmi(cpu_s *cpu);
 void reset(cpu_s *cpu);
 void adjust_pc(cpu_s *cpu, byte_t instruction_length);
 
-bool get_flag(cpu_s *cpu, cpu_status_flag_e flag);
-void set_flag(cpu_s *cpu, cpu_status_flag_e flag, bool value);
+static inline bool get_flag(const cpu_s *cpu, cpu_status_flag_e flag)
+{
+    switch (flag) {
+        case STATUS_FLAG_N: return cpu->n_result & 0x80;
+        case STATUS_FLAG_Z: return cpu->z_result == 0;
+        case STATUS_FLAG_C: return cpu->carry;
+        case STATUS_FLAG_V: return cpu->overflow;
+        default:            return cpu->P & flag;
+    }
+}
+
+static inline void set_flag(cpu_s *cpu, cpu_status_flag_e flag, bool value)
+{
+    switch (flag) {
+        case STATUS_FLAG_N: cpu->n_result = value ? 0x80 : 0x00; break;
+        case STATUS_FLAG_Z: cpu->z_result = value ? 0x00 : 0x01; break;
+        case STATUS_FLAG_C: cpu->carry = value; break;
+        case STATUS_FLAG_V: cpu->overflow = value; break;
+        default:
+            if (value) {
+                cpu->P |= flag;
+            } else {
+                cpu->P &= ~flag;
+            }
+            break;
+    }
+}
+
+byte_t cpu_get_status(const cpu_s *cpu);
+void cpu_set_status(cpu_s *cpu, byte_t status);
 
 void push_byte_to_stack(cpu_s *cpu, byte_t value);
 byte_t pop_byte(cpu_s *cpu);
 
 void cpu_init(cpu_s *cpu);
 
-cpu_instruction_s *get_instruction(cpu_s *cpu, byte_t opcode);
-cpu_instruction_s *get_current_instruction(cpu_s *cpu);
+const cpu_instruction_s *get_instruction(byte_t opcode);
+const cpu_instruction_s *get_current_instruction(cpu_s *cpu);
 
 byte_t read_from_addr(cpu_s *cpu, word_t address);
 void write_to_addr(cpu_s *cpu, word_t address, byte_t value);
 
 void run_instruction(cpu_s *cpu);
-bool is_illegal_opcode(cpu_s *cpu, byte_t opcode);
+// Runs until at least budget cycles have elapsed. Stops early in front of an
+// illegal opcode, or after an instruction that lands on a breakpoint.
+// Iterations of a polling loop that can't see a change before the budget is
+// spent are skipped rather than executed, unless idle_loop_skip is off.
+cpu_run_result_e cpu_run_cycles(cpu_s *cpu, size_t budget);
+
+static inline bool cpu_breakpoint_is_set(const byte_t *bitmap, word_t addr)
+{
+    return bitmap[addr >> 3] & (1 << (addr & 7));
+}
+bool is_illegal_opcode(byte_t opcode);
+
+void cpu_invalidate_fetch_page(cpu_s *cpu);
+void cpu_block_cache_flush(cpu_block_cache_s *cache);
+void cpu_block_cache_invalidate_page(cpu_block_cache_s *cache, byte_t page);
+void cpu_block_cache_invalidate_writable(cpu_block_cache_s *cache);
 
 #endif
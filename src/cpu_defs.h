@@ -82,158 +82,158 @@ X(IND)                  \
 X(IZX)                  \
 X(IZY)
 
-#define INSTRUCTION_OPCODE_TABLE    \
-X(BRK, IMP, 0x00)       \
-X(ORA, IZX, 0x01)       \
-X(ORA, ZP0, 0x05)       \
-X(ASL, ZP0, 0x06)       \
-X(PHP, IMP, 0x08)       \
-X(ORA, IMM, 0x09)       \
-X(ASL, ACC, 0x0A)       \
-X(ASL, ABS, 0x0E)       \
-X(ORA, ABS, 0x0D)       \
-X(BPL, REL, 0x10)       \
-X(ORA, IZY, 0x11)       \
-X(ORA, ZPX, 0x15)       \
-X(ASL, ZPX, 0x16)       \
-X(CLC, IMP, 0x18)       \
-X(ORA, ABY, 0x19)       \
-X(ORA, ABX, 0x1D)       \
-X(ASL, ABX, 0x1E)       \
-X(JSR, ABS, 0x20)       \
-X(AND, IZX, 0x21)       \
-X(BIT, ZP0, 0x24)       \
-X(AND, ZP0, 0x25)       \
-X(ROL, ZP0, 0x26)       \
-X(PLP, IMP, 0x28)       \
-X(AND, IMM, 0x29)       \
-X(ROL, ACC, 0x2A)       \
-X(BIT, ABS, 0x2C)       \
-X(AND, ABS, 0x2D)       \
-X(ROL, ABS, 0x2E)       \
-X(BMI, REL, 0x30)       \
-X(AND, IZY, 0x31)       \
-X(AND, ZPX, 0x35)       \
-X(ROL, ZPX, 0x36)       \
-X(SEC, IMP, 0x38)       \
-X(AND, ABY, 0x39)       \
-X(AND, ABX, 0x3D)       \
-X(ROL, ABX, 0x3E)       \
-X(RTI, IMP, 0x40)       \
-X(EOR, IZX, 0x41)       \
-X(EOR, ZP0, 0x45)       \
-X(LSR, ZP0, 0x46)       \
-X(PHA, IMP, 0x48)       \
-X(EOR, IMM, 0x49)       \
-X(LSR, ACC, 0x4A)       \
-X(JMP, ABS, 0x4C)       \
-X(EOR, ABS, 0x4D)       \
-X(LSR, ABS, 0x4E)       \
-X(BVC, REL, 0x50)       \
-X(EOR, IZY, 0x51)       \
-X(EOR, ZPX, 0x55)       \
-X(LSR, ZPX, 0x56)       \
-X(CLI, IMP, 0x58)       \
-X(EOR, ABY, 0x59)       \
-X(EOR, ABX, 0x5D)       \
-X(LSR, ABX, 0x5E)       \
-X(RTS, IMP, 0x60)       \
-X(ADC, IZX, 0x61)       \
-X(ADC, ZP0, 0x65)       \
-X(ROR, ZP0, 0x66)       \
-X(PLA, IMP, 0x68)       \
-X(ADC, IMM, 0x69)       \
-X(ROR, ACC, 0x6A)       \
-X(JMP, IND, 0x6C)       \
-X(ADC, ABS, 0x6D)       \
-X(ROR, ABS, 0x6E)       \
-X(BVS, REL, 0x70)       \
-X(ADC, IZY, 0x71)       \
-X(ADC, ZPX, 0x75)       \
-X(ROR, ZPX, 0x76)       \
-X(SEI, IMP, 0x78)       \
-X(ADC, ABY, 0x79)       \
-X(ADC, ABX, 0x7D)       \
-X(ROR, ABX, 0x7E)       \
-X(STA, IZX, 0x81)       \
-X(STY, ZP0, 0x84)       \
-X(STA, ZP0, 0x85)       \
-X(STX, ZP0, 0x86)       \
-X(DEY, IMP, 0x88)       \
-X(TXA, IMP, 0x8A)       \
-X(STY, ABS, 0x8C)       \
-X(STA, ABS, 0x8D)       \
-X(STX, ABS, 0x8E)       \
-X(BCC, REL, 0x90)       \
-X(STA, IZY, 0x91)       \
-X(STY, ZPX, 0x94)       \
-X(STA, ZPX, 0x95)       \
-X(STX, ZPY, 0x96)       \
-X(TYA, IMP, 0x98)       \
-X(STA, ABY, 0x99)       \
-X(TXS, IMP, 0x9A)       \
-X(STA, ABX, 0x9D)       \
-X(LDY, IMM, 0xA0)       \
-X(LDA, IZX, 0xA1)       \
-X(LDX, IMM, 0xA2)       \
-X(LDY, ZP0, 0xA4)       \
-X(LDA, ZP0, 0xA5)       \
-X(LDX, ZP0, 0xA6)       \
-X(TAY, IMP, 0xA8)       \
-X(LDA, IMM, 0xA9)       \
-X(TAX, IMP, 0xAA)       \
-X(LDY, ABS, 0xAC)       \
-X(LDA, ABS, 0xAD)       \
-X(LDX, ABS, 0xAE)       \
-X(BCS, REL, 0xB0)       \
-X(LDA, IZY, 0xB1)       \
-X(LDY, ZPX, 0xB4)       \
-X(LDA, ZPX, 0xB5)       \
-X(LDX, ZPY, 0xB6)       \
-X(CLV, IMP, 0xB8)       \
-X(LDA, ABY, 0xB9)       \
-X(TSX, IMP, 0xBA)       \
-X(LDY, ABX, 0xBC)       \
-X(LDA, ABX, 0xBD)       \
-X(LDX, ABY, 0xBE)       \
-X(CPY, IMM, 0xC0)       \
-X(CMP, IZX, 0xC1)       \
-X(CPY, ZP0, 0xC4)       \
-X(CMP, ZP0, 0xC5)       \
-X(DEC, ZP0, 0xC6)       \
-X(INY, IMP, 0xC8)       \
-X(CMP, IMM, 0xC9)       \
-X(DEX, IMP, 0xCA)       \
-X(CPY, ABS, 0xCC)       \
-X(CMP, ABS, 0xCD)       \
-X(DEC, ABS, 0xCE)       \
-X(BNE, REL, 0xD0)       \
-X(CMP, IZY, 0xD1)       \
-X(CMP, ZPX, 0xD5)       \
-X(DEC, ZPX, 0xD6)       \
-X(CLD, IMP, 0xD8)       \
-X(CMP, ABY, 0xD9)       \
-X(CMP, ABX, 0xDD)       \
-X(DEC, ABX, 0xDE)       \
-X(CPX, IMM, 0xE0)       \
-X(SBC, IZX, 0xE1)       \
-X(CPX, ZP0, 0xE4)       \
-X(SBC, ZP0, 0xE5)       \
-X(INC, ZP0, 0xE6)       \
-X(INX, IMP, 0xE8)       \
-X(SBC, IMM, 0xE9)       \
-X(NOP, IMP, 0xEA)       \
-X(CPX, ABS, 0xEC)       \
-X(SBC, ABS, 0xED)       \
-X(INC, ABS, 0xEE)       \
-X(BEQ, REL, 0xF0)       \
-X(SBC, IZY, 0xF1)       \
-X(SBC, ZPX, 0xF5)       \
-X(INC, ZPX, 0xF6)       \
-X(SED, IMP, 0xF8)       \
-X(SBC, ABY, 0xF9)       \
-X(SBC, ABX, 0xFD)       \
-X(INC, ABX, 0xFE)
+#define INSTRUCTION_OPCODE_TABLE        \
+X(BRK, IMP, 0x00, 7, 2)         \
+X(ORA, IZX, 0x01, 6, 2)         \
+X(ORA, ZP0, 0x05, 3, 2)         \
+X(ASL, ZP0, 0x06, 5, 2)         \
+X(PHP, IMP, 0x08, 3, 1)         \
+X(ORA, IMM, 0x09, 2, 2)         \
+X(ASL, ACC, 0x0A, 2, 1)         \
+X(ASL, ABS, 0x0E, 6, 3)         \
+X(ORA, ABS, 0x0D, 4, 3)         \
+X(BPL, REL, 0x10, 2, 2)         \
+X(ORA, IZY, 0x11, 5, 2)         \
+X(ORA, ZPX, 0x15, 4, 2)         \
+X(ASL, ZPX, 0x16, 6, 2)         \
+X(CLC, IMP, 0x18, 2, 1)         \
+X(ORA, ABY, 0x19, 4, 3)         \
+X(ORA, ABX, 0x1D, 4, 3)         \
+X(ASL, ABX, 0x1E, 7, 3)         \
+X(JSR, ABS, 0x20, 6, 3)         \
+X(AND, IZX, 0x21, 6, 2)         \
+X(BIT, ZP0, 0x24, 3, 2)         \
+X(AND, ZP0, 0x25, 3, 2)         \
+X(ROL, ZP0, 0x26, 5, 2)         \
+X(PLP, IMP, 0x28, 4, 1)         \
+X(AND, IMM, 0x29, 2, 2)         \
+X(ROL, ACC, 0x2A, 2, 1)         \
+X(BIT, ABS, 0x2C, 4, 3)         \
+X(AND, ABS, 0x2D, 4, 3)         \
+X(ROL, ABS, 0x2E, 6, 3)         \
+X(BMI, REL, 0x30, 2, 2)         \
+X(AND, IZY, 0x31, 5, 2)         \
+X(AND, ZPX, 0x35, 4, 2)         \
+X(ROL, ZPX, 0x36, 6, 2)         \
+X(SEC, IMP, 0x38, 2, 1)         \
+X(AND, ABY, 0x39, 4, 3)         \
+X(AND, ABX, 0x3D, 4, 3)         \
+X(ROL, ABX, 0x3E, 7, 3)         \
+X(RTI, IMP, 0x40, 6, 1)         \
+X(EOR, IZX, 0x41, 6, 2)         \
+X(EOR, ZP0, 0x45, 3, 2)         \
+X(LSR, ZP0, 0x46, 5, 2)         \
+X(PHA, IMP, 0x48, 3, 1)         \
+X(EOR, IMM, 0x49, 2, 2)         \
+X(LSR, ACC, 0x4A, 2, 1)         \
+X(JMP, ABS, 0x4C, 3, 3)         \
+X(EOR, ABS, 0x4D, 4, 3)         \
+X(LSR, ABS, 0x4E, 6, 3)         \
+X(BVC, REL, 0x50, 2, 2)         \
+X(EOR, IZY, 0x51, 5, 2)         \
+X(EOR, ZPX, 0x55, 4, 2)         \
+X(LSR, ZPX, 0x56, 6, 2)         \
+X(CLI, IMP, 0x58, 2, 1)         \
+X(EOR, ABY, 0x59, 4, 3)         \
+X(EOR, ABX, 0x5D, 4, 3)         \
+X(LSR, ABX, 0x5E, 7, 3)         \
+X(RTS, IMP, 0x60, 6, 1)         \
+X(ADC, IZX, 0x61, 6, 2)         \
+X(ADC, ZP0, 0x65, 3, 2)         \
+X(ROR, ZP0, 0x66, 5, 2)         \
+X(PLA, IMP, 0x68, 4, 1)         \
+X(ADC, IMM, 0x69, 2, 2)         \
+X(ROR, ACC, 0x6A, 2, 1)         \
+X(JMP, IND, 0x6C, 5, 3)         \
+X(ADC, ABS, 0x6D, 4, 3)         \
+X(ROR, ABS, 0x6E, 6, 3)         \
+X(BVS, REL, 0x70, 2, 2)         \
+X(ADC, IZY, 0x71, 5, 2)         \
+X(ADC, ZPX, 0x75, 4, 2)         \
+X(ROR, ZPX, 0x76, 6, 2)         \
+X(SEI, IMP, 0x78, 2, 1)         \
+X(ADC, ABY, 0x79, 4, 3)         \
+X(ADC, ABX, 0x7D, 4, 3)         \
+X(ROR, ABX, 0x7E, 7, 3)         \
+X(STA, IZX, 0x81, 6, 2)         \
+X(STY, ZP0, 0x84, 3, 2)         \
+X(STA, ZP0, 0x85, 3, 2)         \
+X(STX, ZP0, 0x86, 3, 2)         \
+X(DEY, IMP, 0x88, 2, 1)         \
+X(TXA, IMP, 0x8A, 2, 1)         \
+X(STY, ABS, 0x8C, 4, 3)         \
+X(STA, ABS, 0x8D, 4, 3)         \
+X(STX, ABS, 0x8E, 4, 3)         \
+X(BCC, REL, 0x90, 2, 2)         \
+X(STA, IZY, 0x91, 6, 2)         \
+X(STY, ZPX, 0x94, 4, 2)         \
+X(STA, ZPX, 0x95, 4, 2)         \
+X(STX, ZPY, 0x96, 4, 2)         \
+X(TYA, IMP, 0x98, 2, 1)         \
+X(STA, ABY, 0x99, 5, 3)         \
+X(TXS, IMP, 0x9A, 2, 1)         \
+X(STA, ABX, 0x9D, 5, 3)         \
+X(LDY, IMM, 0xA0, 2, 2)         \
+X(LDA, IZX, 0xA1, 6, 2)         \
+X(LDX, IMM, 0xA2, 2, 2)         \
+X(LDY, ZP0, 0xA4, 3, 2)         \
+X(LDA, ZP0, 0xA5, 3, 2)         \
+X(LDX, ZP0, 0xA6, 3, 2)         \
+X(TAY, IMP, 0xA8, 2, 1)         \
+X(LDA, IMM, 0xA9, 2, 2)         \
+X(TAX, IMP, 0xAA, 2, 1)         \
+X(LDY, ABS, 0xAC, 4, 3)         \
+X(LDA, ABS, 0xAD, 4, 3)         \
+X(LDX, ABS, 0xAE, 4, 3)         \
+X(BCS, REL, 0xB0, 2, 2)         \
+X(LDA, IZY, 0xB1, 5, 2)         \
+X(LDY, ZPX, 0xB4, 4, 2)         \
+X(LDA, ZPX, 0xB5, 4, 2)         \
+X(LDX, ZPY, 0xB6, 4, 2)         \
+X(CLV, IMP, 0xB8, 2, 1)         \
+X(LDA, ABY, 0xB9, 4, 3)         \
+X(TSX, IMP, 0xBA, 2, 1)         \
+X(LDY, ABX, 0xBC, 4, 3)         \
+X(LDA, ABX, 0xBD, 4, 3)         \
+X(LDX, ABY, 0xBE, 4, 3)         \
+X(CPY, IMM, 0xC0, 2, 2)         \
+X(CMP, IZX, 0xC1, 6, 2)         \
+X(CPY, ZP0, 0xC4, 3, 2)         \
+X(CMP, ZP0, 0xC5, 3, 2)         \
+X(DEC, ZP0, 0xC6, 5, 2)         \
+X(INY, IMP, 0xC8, 2, 1)         \
+X(CMP, IMM, 0xC9, 2, 2)         \
+X(DEX, IMP, 0xCA, 2, 1)         \
+X(CPY, ABS, 0xCC, 4, 3)         \
+X(CMP, ABS, 0xCD, 4, 3)         \
+X(DEC, ABS, 0xCE, 6, 3)         \
+X(BNE, REL, 0xD0, 2, 2)         \
+X(CMP, IZY, 0xD1, 5, 2)         \
+X(CMP, ZPX, 0xD5, 4, 2)         \
+X(DEC, ZPX, 0xD6, 6, 2)         \
+X(CLD, IMP, 0xD8, 2, 1)         \
+X(CMP, ABY, 0xD9, 4, 3)         \
+X(CMP, ABX, 0xDD, 4, 3)         \
+X(DEC, ABX, 0xDE, 7, 3)         \
+X(CPX, IMM, 0xE0, 2, 2)         \
+X(SBC, IZX, 0xE1, 6, 2)         \
+X(CPX, ZP0, 0xE4, 3, 2)         \
+X(SBC, ZP0, 0xE5, 3, 2)         \
+X(INC, ZP0, 0xE6, 5, 2)         \
+X(INX, IMP, 0xE8, 2, 1)         \
+X(SBC, IMM, 0xE9, 2, 2)         \
+X(NOP, IMP, 0xEA, 2, 1)         \
+X(CPX, ABS, 0xEC, 4, 3)         \
+X(SBC, ABS, 0xED, 4, 3)         \
+X(INC, ABS, 0xEE, 6, 3)         \
+X(BEQ, REL, 0xF0, 2, 2)         \
+X(SBC, IZY, 0xF1, 5, 2)         \
+X(SBC, ZPX, 0xF5, 4, 2)         \
+X(INC, ZPX, 0xF6, 6, 2)         \
+X(SED, IMP, 0xF8, 2, 1)         \
+X(SBC, ABY, 0xF9, 4, 3)         \
+X(SBC, ABX, 0xFD, 4, 3)         \
+X(INC, ABX, 0xFE, 7, 3)
 
 #define UNDEFINED_OPCODES \
 X(0x02) X(0x03) X(0x04) X(0x07) X(0x0B) X(0x0C) X(0x0F) \
@@ -262,7 +262,7 @@ typedef enum
 
 typedef enum
 {
-    #define X(name, mode, opcode) INSTRUCTION_##name##_##mode = opcode,
+    #define X(name, mode, opcode, cycles, length) INSTRUCTION_##name##_##mode = opcode,
     INSTRUCTION_OPCODE_TABLE
     #undef X
 } cpu_ins_e;
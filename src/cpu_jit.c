@@ -0,0 +1,372 @@
+#include "cpu_jit.h"
+#include "bus.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#if !defined(__x86_64__)
+#error "CPU_JIT emits x86-64 code"
+#endif
+
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCKS 16384
+#define JIT_MAX_BLOCK_OPS 64
+// Worst case code for one op, plus the prologue and epilogue
+#define JIT_MAX_OP_BYTES 128
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_OPS * JIT_MAX_OP_BYTES + 64)
+// Mapper registers, where a store can switch the bank a block runs from
+#define JIT_MAPPER_REGISTERS_START 0x8000
+
+typedef word_t (*jit_block_fn)(cpu_s *cpu);
+
+typedef struct {
+    jit_block_fn code;
+    // Memory the block was compiled from; a remapped page makes it stale
+    byte_t first_page;
+    byte_t last_page;
+    const byte_t *first_mem;
+    const byte_t *last_mem;
+} jit_block_s;
+
+struct cpu_jit_s {
+    byte_t *code;
+    size_t code_used;
+    jit_block_s blocks[JIT_MAX_BLOCKS];
+    size_t block_count;
+    jit_block_s *entries[0x10000];
+    uint16_t heat[0x10000];
+    unsigned threshold;
+
+    size_t blocks_compiled;
+    size_t blocks_run;
+};
+
+typedef struct {
+    byte_t *start;
+    byte_t *pos;
+} emitter_s;
+
+static void emit8(emitter_s *e, byte_t value)
+{
+    *e->pos++ = value;
+}
+
+static void emit16(emitter_s *e, uint16_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+static void emit32(emitter_s *e, uint32_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+static void emit64(emitter_s *e, uint64_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+// rbx holds the cpu_s pointer for the whole block; fields are addressed as
+// [rbx + disp32] (ModRM mod=10, rm=011)
+#define MODRM_RBX_DISP32(reg) (0x80 | ((reg) << 3) | 3)
+#define CPU_FIELD(field) ((uint32_t)offsetof(cpu_s, field))
+
+// mov byte [rbx + disp], imm8
+static void emit_store8(emitter_s *e, uint32_t disp, byte_t value)
+{
+    emit8(e, 0xC6);
+    emit8(e, MODRM_RBX_DISP32(0));
+    emit32(e, disp);
+    emit8(e, value);
+}
+
+// mov word [rbx + disp], imm16
+static void emit_store16(emitter_s *e, uint32_t disp, uint16_t value)
+{
+    emit8(e, 0x66);
+    emit8(e, 0xC7);
+    emit8(e, MODRM_RBX_DISP32(0));
+    emit32(e, disp);
+    emit16(e, value);
+}
+
+// add qword [rbx + cycles], imm8
+static void emit_add_cycles(emitter_s *e, byte_t cycles)
+{
+    emit8(e, 0x48);
+    emit8(e, 0x83);
+    emit8(e, MODRM_RBX_DISP32(0));
+    emit32(e, CPU_FIELD(cycles));
+    emit8(e, cycles);
+}
+
+// mov rdi, rbx; mov rax, imm64; call rax
+static void emit_call(emitter_s *e, instruction_func_t func)
+{
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);
+    emit8(e, 0x48); emit8(e, 0xB8);
+    emit64(e, (uint64_t)(uintptr_t)func);
+    emit8(e, 0xFF); emit8(e, 0xD0);
+}
+
+// mov eax, imm32
+static void emit_mov_eax(emitter_s *e, uint32_t value)
+{
+    emit8(e, 0xB8);
+    emit32(e, value);
+}
+
+// jmp rel32, returning where the offset goes so it can be patched
+static byte_t *emit_jmp32(emitter_s *e)
+{
+    emit8(e, 0xE9);
+    byte_t *rel = e->pos;
+    emit32(e, 0);
+    return rel;
+}
+
+static void patch_rel32(byte_t *rel, const byte_t *target)
+{
+    int32_t offset = (int32_t)(target - (rel + 4));
+    memcpy(rel, &offset, sizeof(offset));
+}
+
+// Mirrors execute_decoded in cpu.c. Operand addresses known at decode time
+// are stored directly; the rest call the addressing mode and take the page
+// crossing penalty the same way.
+static void emit_op(emitter_s *e, const cpu_decoded_op_s *op)
+{
+    emit_store8(e, CPU_FIELD(current_opcode), op->opcode);
+    emit_store8(e, CPU_FIELD(pc_changed), 0);
+
+    if (!op->data_fetch) {
+        emit_store8(e, CPU_FIELD(acc_mode), op->acc_mode);
+        emit_store16(e, CPU_FIELD(address), op->address);
+        emit_store8(e, CPU_FIELD(address_rel), (byte_t)op->address_rel);
+        emit_call(e, op->execute);
+    } else {
+        emit_call(e, op->data_fetch);
+        emit8(e, 0x41); emit8(e, 0x89); emit8(e, 0xC4);    // mov r12d, eax
+        emit_call(e, op->execute);
+        emit8(e, 0x45); emit8(e, 0x84); emit8(e, 0xE4);    // test r12b, r12b
+        emit8(e, 0x74); emit8(e, 12);                      // je past the add
+        emit8(e, 0x84); emit8(e, 0xC0);                    // test al, al
+        emit8(e, 0x74); emit8(e, 8);                       // je past the add
+        emit_add_cycles(e, 1);
+    }
+    emit_add_cycles(e, op->cycles);
+}
+
+static bool writes_memory(const cpu_decoded_op_s *op)
+{
+    instruction_func_t f = op->execute;
+    return !op->acc_mode && (f == STA || f == STX || f == STY || f == INC || f == DEC ||
+                             f == ASL || f == LSR || f == ROL || f == ROR);
+}
+
+static bool is_rom_page(const bus_s *bus, int page)
+{
+    return bus->read_pages[page] != NULL && bus->write_pages[page] == NULL;
+}
+
+static void reset_code(cpu_jit_s *jit)
+{
+    memset(jit->entries, 0, sizeof(jit->entries));
+    jit->block_count = 0;
+    jit->code_used = 0;
+}
+
+static jit_block_s *compile_block(cpu_jit_s *jit, cpu_s *cpu, word_t pc)
+{
+    bus_s *bus = cpu->bus;
+    const cpu_decoded_op_s *ops = cpu->block_cache->ops;
+
+    // Collect the ops of the block, all from ROM
+    word_t addrs[JIT_MAX_BLOCK_OPS];
+    int count = 0;
+    word_t addr = pc;
+    while (count < JIT_MAX_BLOCK_OPS && ops[addr].execute) {
+        const cpu_decoded_op_s *op = &ops[addr];
+        if (!is_rom_page(bus, addr >> BUS_PAGE_SHIFT) ||
+            !is_rom_page(bus, (word_t)(addr + op->length - 1) >> BUS_PAGE_SHIFT)) {
+            break;
+        }
+        addrs[count++] = addr;
+        // A store to a known mapper register address ends the block; one
+        // through an indexed or indirect address is checked as it runs
+        if (op->block_end || (writes_memory(op) && !op->data_fetch &&
+                              op->address >= JIT_MAPPER_REGISTERS_START)) {
+            break;
+        }
+        addr += op->length;
+    }
+    if (count == 0) {
+        return NULL;
+    }
+
+    if (jit->block_count == JIT_MAX_BLOCKS || jit->code_used + JIT_MAX_BLOCK_BYTES > JIT_CODE_SIZE) {
+        reset_code(jit);
+    }
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    emitter_s e = {jit->code + jit->code_used, jit->code + jit->code_used};
+    byte_t *exits[JIT_MAX_BLOCK_OPS];
+    int exit_count = 0;
+
+    // push rbx; push r12; push rbp; mov rbx, rdi
+    emit8(&e, 0x53);
+    emit8(&e, 0x41); emit8(&e, 0x54);
+    emit8(&e, 0x55);
+    emit8(&e, 0x48); emit8(&e, 0x89); emit8(&e, 0xFB);
+    emit_store8(&e, CPU_FIELD(instruction_pending), 1);
+    emit_store16(&e, CPU_FIELD(PC), pc);
+
+    for (int i = 0; i < count; i++) {
+        const cpu_decoded_op_s *op = &ops[addrs[i]];
+        word_t next = addrs[i] + op->length;
+        emit_op(&e, op);
+
+        if (op->block_end) {
+            // cmp byte [rbx + pc_changed], 0; jne past the PC store
+            emit8(&e, 0x80);
+            emit8(&e, MODRM_RBX_DISP32(7));
+            emit32(&e, CPU_FIELD(pc_changed));
+            emit8(&e, 0);
+            emit8(&e, 0x75); emit8(&e, 9);
+            emit_store16(&e, CPU_FIELD(PC), next);
+        } else {
+            emit_store16(&e, CPU_FIELD(PC), next);
+        }
+
+        if (i + 1 < count && writes_memory(op) && op->data_fetch) {
+            // cmp word [rbx + address], JIT_MAPPER_REGISTERS_START; jae past
+            // the cycle check to the exit
+            emit8(&e, 0x66); emit8(&e, 0x81); emit8(&e, MODRM_RBX_DISP32(7));
+            emit32(&e, CPU_FIELD(address));
+            emit16(&e, JIT_MAPPER_REGISTERS_START);
+            emit8(&e, 0x73); emit8(&e, 16);
+        }
+        if (i + 1 < count) {
+            // mov rax, [rbx + cycles]; cmp rax, [rbx + cycle_limit]; jb over
+            // the exit to the next op
+            emit8(&e, 0x48); emit8(&e, 0x8B); emit8(&e, MODRM_RBX_DISP32(0));
+            emit32(&e, CPU_FIELD(cycles));
+            emit8(&e, 0x48); emit8(&e, 0x3B); emit8(&e, MODRM_RBX_DISP32(0));
+            emit32(&e, CPU_FIELD(cycle_limit));
+            emit8(&e, 0x72); emit8(&e, 10);
+        }
+        emit_mov_eax(&e, addrs[i]);
+        if (i + 1 < count) {
+            exits[exit_count++] = emit_jmp32(&e);
+        }
+    }
+
+    byte_t *epilogue = e.pos;
+    for (int i = 0; i < exit_count; i++) {
+        patch_rel32(exits[i], epilogue);
+    }
+    // mov byte [rbx + instruction_pending], 0; pop rbp; pop r12; pop rbx; ret
+    emit_store8(&e, CPU_FIELD(instruction_pending), 0);
+    emit8(&e, 0x5D);
+    emit8(&e, 0x41); emit8(&e, 0x5C);
+    emit8(&e, 0x5B);
+    emit8(&e, 0xC3);
+
+    assert((size_t)(e.pos - e.start) <= JIT_MAX_BLOCK_BYTES);
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        reset_code(jit);
+        return NULL;
+    }
+
+    jit_block_s *block = &jit->blocks[jit->block_count++];
+    block->code = (jit_block_fn)(uintptr_t)e.start;
+    block->first_page = pc >> BUS_PAGE_SHIFT;
+    block->last_page = (word_t)(addrs[count - 1] + ops[addrs[count - 1]].length - 1) >> BUS_PAGE_SHIFT;
+    block->first_mem = bus->read_pages[block->first_page];
+    block->last_mem = bus->read_pages[block->last_page];
+    jit->code_used += (size_t)(e.pos - e.start);
+    jit->entries[pc] = block;
+    jit->blocks_compiled++;
+    return block;
+}
+
+static bool block_is_current(const jit_block_s *block, const bus_s *bus)
+{
+    return bus->read_pages[block->first_page] == block->first_mem &&
+           bus->read_pages[block->last_page] == block->last_mem;
+}
+
+cpu_jit_s *cpu_jit_create(unsigned threshold)
+{
+    cpu_jit_s *jit = calloc(1, sizeof(*jit));
+    if (!jit) {
+        return NULL;
+    }
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    jit->code = code;
+    jit->threshold = threshold;
+    return jit;
+}
+
+void cpu_jit_destroy(cpu_jit_s *jit)
+{
+    if (!jit) {
+        return;
+    }
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+}
+
+void cpu_jit_set_threshold(cpu_jit_s *jit, unsigned threshold)
+{
+    assert(jit != NULL);
+    jit->threshold = threshold;
+}
+
+bool cpu_jit_run(cpu_jit_s *jit, cpu_s *cpu, word_t *last_pc)
+{
+    assert(jit != NULL && cpu != NULL && cpu->block_cache != NULL);
+
+    word_t pc = cpu->PC;
+    jit_block_s *block = jit->entries[pc];
+    if (!block || !block_is_current(block, cpu->bus)) {
+        jit->entries[pc] = NULL;
+        if (++jit->heat[pc] < jit->threshold || !cpu->block_cache->ops[pc].execute) {
+            return false;
+        }
+        jit->heat[pc] = 0;
+        block = compile_block(jit, cpu, pc);
+        if (!block) {
+            return false;
+        }
+    }
+
+    jit->blocks_run++;
+    *last_pc = block->code(cpu);
+    return true;
+}
+
+size_t cpu_jit_blocks_compiled(const cpu_jit_s *jit)
+{
+    assert(jit != NULL);
+    return jit->blocks_compiled;
+}
+
+size_t cpu_jit_blocks_run(const cpu_jit_s *jit)
+{
+    assert(jit != NULL);
+    return jit->blocks_run;
+}
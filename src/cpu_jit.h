@@ -0,0 +1,36 @@
+#ifndef CPU_JIT_H
+#define CPU_JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+
+// x86-64 recompiler for basic blocks in PRG ROM, built with -DCPU_JIT=ON.
+//
+// A block is compiled once its first address has been entered threshold
+// times. The native code calls the same addressing mode and instruction
+// functions as the interpreter, with operand addresses, PC updates and cycle
+// costs baked in, so I/O still goes through the bus handlers. After every
+// instruction it returns to the interpreter if the CPU has used up
+// cycle_limit, which is also how scheduled interrupts cut a block short.
+//
+// Blocks only come from pages the CPU can't write, and are dropped when the
+// page they were compiled from is mapped to different memory. Since that is
+// only checked on entry, a block also returns after any store to $8000-$FFFF,
+// where a mapper register write can switch the bank it is running from.
+
+#define CPU_JIT_DEFAULT_THRESHOLD 16
+
+cpu_jit_s *cpu_jit_create(unsigned threshold);
+void cpu_jit_destroy(cpu_jit_s *jit);
+void cpu_jit_set_threshold(cpu_jit_s *jit, unsigned threshold);
+
+// Runs the compiled block at cpu->PC, compiling it if it has become hot.
+// Returns false, without running anything, when there is no block to run;
+// otherwise stores the address of the last instruction run in last_pc.
+bool cpu_jit_run(cpu_jit_s *jit, cpu_s *cpu, word_t *last_pc);
+
+size_t cpu_jit_blocks_compiled(const cpu_jit_s *jit);
+size_t cpu_jit_blocks_run(const cpu_jit_s *jit);
+
+#endif
@@ -13,6 +13,7 @@
 static cpu_s test_cpu;
 static bus_s test_bus;
 static gamecart_s test_cart;
+static ppu_s test_ppu;
 
 
 static byte_t test_prg_rom[32 * 1024];
@@ -58,7 +59,8 @@ cpu_s *get_test_cpu(void) {
     bus_attach_cart(&test_bus, &test_cart);
     cpu_init(&test_cpu);
     test_cpu.bus = &test_bus;
-    test_bus.ppu = ppu_get_instance();
+    ppu_init(&test_ppu);
+    test_bus.ppu = &test_ppu;
     return &test_cpu;
 }
 
@@ -67,7 +69,7 @@ void load_instruction(cpu_s *cpu, const byte_t *instruction, size_t len) {
     const byte_t op_code = instruction[0];
     cpu->current_opcode = op_code;
     cpu->instruction_pending = true;
-    cpu_instruction_s *current_instruction = get_current_instruction(cpu);
+    const cpu_instruction_s *current_instruction = get_current_instruction(cpu);
     assert(current_instruction->length == len);
     word_t pc = cpu->PC;
     for (size_t i = 0; i < len; i++) {
@@ -77,7 +79,7 @@ void load_instruction(cpu_s *cpu, const byte_t *instruction, size_t len) {
 
 
 static void execute_instruction(cpu_s *cpu) {
-    cpu_instruction_s *current_instruction = get_current_instruction(cpu);
+    const cpu_instruction_s *current_instruction = get_current_instruction(cpu);
     if (current_instruction->data_fetch != NULL) {
         current_instruction->data_fetch(cpu);
     }
@@ -158,7 +160,7 @@ void test_0x08_PHP(void) {
     byte_t instr[] = {INSTRUCTION_PHP_IMP};
     load_instruction(cpu, instr, sizeof(instr));
     execute_instruction(cpu);
-    TEST_ASSERT_EQUAL_HEX8((cpu->STATUS | STATUS_FLAG_B | STATUS_FLAG_U), *test_mem_ptr(0x01FD));
+    TEST_ASSERT_EQUAL_HEX8((cpu_get_status(cpu) | STATUS_FLAG_B | STATUS_FLAG_U), *test_mem_ptr(0x01FD));
 }
 
 
@@ -2107,6 +2109,111 @@ void test_LDA_IZY_page_cross(void) {
     TEST_ASSERT_EQUAL_HEX8(expected_value, cpu->A);
 }
 
+void test_STA_does_not_read_target(void) {
+    cpu_s *cpu = get_test_cpu();
+    ppu_set_status_flag(&test_ppu, PPUSTATUS_VBLANK, true);
+    cpu->A = 0x00;
+    byte_t instr[] = {INSTRUCTION_STA_ABS, 0x02, 0x20};
+    load_instruction(cpu, instr, sizeof(instr));
+    execute_instruction(cpu);
+    TEST_ASSERT_TRUE(ppu_get_status_flag(&test_ppu, PPUSTATUS_VBLANK));
+}
+
+void test_JMP_does_not_read_target(void) {
+    cpu_s *cpu = get_test_cpu();
+    ppu_set_status_flag(&test_ppu, PPUSTATUS_VBLANK, true);
+    byte_t instr[] = {INSTRUCTION_JMP_ABS, 0x02, 0x20};
+    load_instruction(cpu, instr, sizeof(instr));
+    execute_instruction(cpu);
+    TEST_ASSERT_EQUAL_HEX16(0x2002, cpu->PC);
+    TEST_ASSERT_TRUE(ppu_get_status_flag(&test_ppu, PPUSTATUS_VBLANK));
+}
+
+void test_LDA_ABS_reads_target(void) {
+    cpu_s *cpu = get_test_cpu();
+    ppu_set_status_flag(&test_ppu, PPUSTATUS_VBLANK, true);
+    byte_t instr[] = {INSTRUCTION_LDA_ABS, 0x02, 0x20};
+    load_instruction(cpu, instr, sizeof(instr));
+    execute_instruction(cpu);
+    TEST_ASSERT_TRUE(cpu->A & PPUSTATUS_VBLANK);
+    TEST_ASSERT_FALSE(ppu_get_status_flag(&test_ppu, PPUSTATUS_VBLANK));
+}
+
+void test_stack_push_pop_at_top_of_page(void) {
+    cpu_s *cpu = get_test_cpu();
+    cpu->SP = 0xFF;
+    push_byte_to_stack(cpu, 0x12);
+    TEST_ASSERT_EQUAL_HEX8(0x12, *test_mem_ptr(0x01FF));
+    TEST_ASSERT_EQUAL_HEX8(0xFE, cpu->SP);
+    TEST_ASSERT_EQUAL_HEX8(0x12, pop_byte(cpu));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, cpu->SP);
+}
+
+void test_stack_wraps_within_page(void) {
+    cpu_s *cpu = get_test_cpu();
+    cpu->SP = 0x00;
+    push_byte_to_stack(cpu, 0x34);
+    TEST_ASSERT_EQUAL_HEX8(0x34, *test_mem_ptr(0x0100));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, cpu->SP);
+    TEST_ASSERT_EQUAL_HEX8(0x34, pop_byte(cpu));
+    TEST_ASSERT_EQUAL_HEX8(0x00, cpu->SP);
+}
+
+void test_RTS_from_top_of_stack(void) {
+    cpu_s *cpu = get_test_cpu();
+    *test_mem_ptr(0x0100) = 0xAA;
+    *test_mem_ptr(0x01FE) = 0x02;
+    *test_mem_ptr(0x01FF) = 0x03;
+    cpu->SP = 0xFD;
+    byte_t instr[] = {INSTRUCTION_RTS_IMP};
+    load_instruction(cpu, instr, sizeof(instr));
+    execute_instruction(cpu);
+    TEST_ASSERT_EQUAL_HEX16(0x0303, cpu->PC);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, cpu->SP);
+}
+
+void test_operand_fetch_follows_remapped_prg_rom(void) {
+    static byte_t other_prg_rom[32 * 1024];
+    cpu_s *cpu = get_test_cpu();
+    test_bus.cpu = cpu;
+    test_bus.ram[0x10] = 0x11;
+    test_bus.ram[0x20] = 0x22;
+
+    cpu->PC = 0x8000;
+    byte_t instr[] = {INSTRUCTION_LDA_ZP0, 0x10};
+    load_instruction(cpu, instr, sizeof(instr));
+    execute_instruction(cpu);
+    TEST_ASSERT_EQUAL_HEX8(0x11, cpu->A);
+
+    other_prg_rom[0] = INSTRUCTION_LDA_ZP0;
+    other_prg_rom[1] = 0x20;
+    gamecart_s other_cart = test_cart;
+    other_cart.rom.prg_rom = other_prg_rom;
+    bus_attach_cart(&test_bus, &other_cart);
+    execute_instruction(cpu);
+    TEST_ASSERT_EQUAL_HEX8(0x22, cpu->A);
+}
+
+void test_instruction_table_covers_all_opcodes(void) {
+    for (int opcode = 0; opcode < 256; opcode++) {
+        const cpu_instruction_s *instr = get_instruction((byte_t)opcode);
+        TEST_ASSERT_EQUAL_HEX8(opcode, instr->opcode);
+        TEST_ASSERT_TRUE(instr->name != NULL);
+        TEST_ASSERT_TRUE(instr->cycles > 0);
+        TEST_ASSERT_TRUE(instr->length > 0);
+        TEST_ASSERT_TRUE(instr->data_fetch != NULL);
+        TEST_ASSERT_TRUE(instr->execute != NULL);
+    }
+}
+
+void test_undefined_opcodes_are_illegal(void) {
+    TEST_ASSERT_TRUE(is_illegal_opcode(0x02));
+    TEST_ASSERT_TRUE(is_illegal_opcode(0x80));
+    TEST_ASSERT_TRUE(is_illegal_opcode(0xFC));
+    TEST_ASSERT_FALSE(is_illegal_opcode(INSTRUCTION_LDA_IMM));
+    TEST_ASSERT_EQUAL(1, get_instruction(0x80)->length);
+}
+
 
 int main(void) {
     UNITY_BEGIN();
@@ -2288,5 +2395,17 @@ int main(void) {
     RUN_TEST(test_LDA_ABY_page_cross);
     RUN_TEST(test_LDA_IZY_page_cross);
 
+    RUN_TEST(test_STA_does_not_read_target);
+    RUN_TEST(test_JMP_does_not_read_target);
+    RUN_TEST(test_LDA_ABS_reads_target);
+
+    RUN_TEST(test_stack_push_pop_at_top_of_page);
+    RUN_TEST(test_stack_wraps_within_page);
+    RUN_TEST(test_RTS_from_top_of_stack);
+    RUN_TEST(test_operand_fetch_follows_remapped_prg_rom);
+
+    RUN_TEST(test_instruction_table_covers_all_opcodes);
+    RUN_TEST(test_undefined_opcodes_are_illegal);
+
     return UNITY_END();
 }
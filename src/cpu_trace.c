@@ -8,6 +8,9 @@
 #include "nes.h"
 #include "ines.h"
 #include "gamecart.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
 
 #define MEMORY_SIZE (64 * 1024)
 #define DEFAULT_MAX_INSTRUCTIONS 10000
@@ -34,6 +37,7 @@ typedef struct options_t {
     bool official_only;
     bool quiet;
     bool step;
+    bool jit;
 } options_t;
 
 typedef struct {
@@ -108,6 +112,7 @@ static void print_usage(const char *program_name) {
     printf("  -o, --output <file>   Write trace to file instead of stdout\n");
     printf("  -q, --quiet           Suppress trace output (useful with --compare)\n");
     printf("  -s, --step            Step mode: Enter=step, c=continue, q=quit\n");
+    printf("  --jit                 Run each instruction through the JIT (CPU_JIT builds)\n");
     printf("\nExamples:\n");
     printf("  %s roms/game.nes\n", program_name);
     printf("  %s roms/game.nes --pc 8000\n", program_name);
@@ -125,6 +130,7 @@ static bool parse_args(int argc, char *argv[], options_t *opts) {
         {"output",  required_argument, NULL, 'o'},
         {"quiet",   no_argument,       NULL, 'q'},
         {"step",    no_argument,       NULL, 's'},
+        {"jit",     no_argument,       NULL, 'J'},
         {"help",    no_argument,       NULL, 'h'},
         {NULL, 0, NULL, 0}
     };
@@ -138,6 +144,7 @@ static bool parse_args(int argc, char *argv[], options_t *opts) {
     opts->official_only = false;
     opts->quiet = false;
     opts->step = false;
+    opts->jit = false;
 
     int opt;
     while ((opt = getopt_long(argc, argv, "c:n:o:qsh", long_options, NULL)) != -1) {
@@ -173,6 +180,9 @@ static bool parse_args(int argc, char *argv[], options_t *opts) {
             case 's':
                 opts->step = true;
                 break;
+            case 'J':
+                opts->jit = true;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 exit(0);
@@ -216,7 +226,7 @@ static bool parse_args(int argc, char *argv[], options_t *opts) {
 
 static void format_log_line(cpu_s *cpu, char *buffer, size_t size) {
     bus_s *bus = cpu->bus;
-    cpu_instruction_s *instr = get_instruction(cpu, bus_read(bus, cpu->PC));
+    const cpu_instruction_s *instr = get_instruction(bus_read(bus, cpu->PC));
 
     byte_t bytes[3] = {0};
     bytes[0] = bus_read(bus, cpu->PC);
@@ -242,7 +252,7 @@ static void format_log_line(cpu_s *cpu, char *buffer, size_t size) {
     snprintf(buffer, size,
              "%04X  %s  %-4s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%zu",
              cpu->PC, byte_str, instr->name ? instr->name : "???",
-             cpu->A, cpu->X, cpu->Y, cpu->STATUS, cpu->SP, cpu->cycles);
+             cpu->A, cpu->X, cpu->Y, cpu_get_status(cpu), cpu->SP, cpu->cycles);
 }
 
 static bool parse_log_line(const char *line, log_entry_t *entry) {
@@ -290,9 +300,9 @@ static bool compare_state(cpu_s *cpu, const log_entry_t *expected, int line_num,
                 line_num, expected->y, cpu->Y);
         match = false;
     }
-    if (cpu->STATUS != expected->p) {
+    if (cpu_get_status(cpu) != expected->p) {
         fprintf(error_log, "Line %d: P mismatch - expected %02X, got %02X\n",
-                line_num, expected->p, cpu->STATUS);
+                line_num, expected->p, cpu_get_status(cpu));
         match = false;
     }
     if (cpu->SP != expected->sp) {
@@ -309,6 +319,15 @@ static bool compare_state(cpu_s *cpu, const log_entry_t *expected, int line_num,
     return match;
 }
 
+// With --jit, a budget of one cycle makes the compiled block hand back after
+// its first instruction, so the trace can still be compared line by line
+static void step_instruction(cpu_s *cpu, bool jit) {
+    if (jit && cpu_run_cycles(cpu, 1) != CPU_RUN_RESULT_ILLEGAL_OPCODE) {
+        return;
+    }
+    run_instruction(cpu);
+}
+
 int main(int argc, char *argv[]) {
     options_t opts;
     if (!parse_args(argc, argv, &opts)) {
@@ -325,13 +344,36 @@ int main(int argc, char *argv[]) {
         ines_print_info(&cart.rom);
     }
 
-    nes_console_s *nes = nes_get_instance();
-    nes_init(nes);
+    nes_console_s *nes = nes_console_create();
+    if (!nes) {
+        fprintf(stderr, "Failed to create console\n");
+        gamecart_free(&cart);
+        return 1;
+    }
     cpu_s *cpu = nes->cpu;
     bus_s *bus = nes->bus;
 
     nes_attach_cart(nes, &cart);
 
+    if (opts.jit) {
+#if defined(CPU_JIT)
+        if (!nes->jit) {
+            fprintf(stderr, "Failed to create JIT\n");
+            nes_console_destroy(nes);
+            gamecart_free(&cart);
+            return 1;
+        }
+        // Compile every block the first time it is reached
+        cpu_jit_set_threshold(nes->jit, 1);
+        cpu->idle_loop_skip = false;
+#else
+        fprintf(stderr, "Error: --jit needs a build configured with -DCPU_JIT=ON\n");
+        nes_console_destroy(nes);
+        gamecart_free(&cart);
+        return 1;
+#endif
+    }
+
     if (opts.nestest_mode) {
         printf("Test official opcodes only? (y/n): ");
         fflush(stdout);
@@ -341,10 +383,10 @@ int main(int argc, char *argv[]) {
 
         cpu->PC = NESTEST_START_PC;
         cpu->SP = NESTEST_INITIAL_SP;
-        cpu->STATUS = NESTEST_INITIAL_STATUS;
+        cpu_set_status(cpu, NESTEST_INITIAL_STATUS);
         if (!opts.quiet) {
             printf("\nNestest mode: PC=$%04X, SP=$%02X, P=$%02X\n",
-                   cpu->PC, cpu->SP, cpu->STATUS);
+                   cpu->PC, cpu->SP, cpu_get_status(cpu));
             printf("Testing: %s opcodes\n",
                    opts.official_only ? "official only" : "all (official + unofficial)");
         }
@@ -366,6 +408,7 @@ int main(int argc, char *argv[]) {
         output_file = fopen(opts.output_path, "w");
         if (!output_file) {
             fprintf(stderr, "Failed to open output file: %s\n", opts.output_path);
+            nes_console_destroy(nes);
             gamecart_free(&cart);
             return 1;
         }
@@ -391,6 +434,7 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Failed to allocate trace buffer\n");
             if (compare_file) fclose(compare_file);
             if (output_file != stdout) fclose(output_file);
+            nes_console_destroy(nes);
             gamecart_free(&cart);
             return 1;
         }
@@ -477,7 +521,7 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        run_instruction(cpu);
+        step_instruction(cpu, opts.jit);
         instruction_count++;
 
         if (opts.nestest_mode) {
@@ -564,6 +608,7 @@ int main(int argc, char *argv[]) {
     if (output_file != stdout) {
         fclose(output_file);
     }
+    nes_console_destroy(nes);
     gamecart_free(&cart);
     return exit_code;
 }
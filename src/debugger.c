@@ -393,7 +393,7 @@ static void draw_panel(debugger_s *debugger_context, int x, int y, int w, int h,
 
 
 static void format_instruction_bytes(debugger_s *debugger_context, char *buffer, size_t size) {
-    cpu_instruction_s *instr = get_instruction(debugger_context->cpu, bus_read(debugger_context->bus, debugger_context->cpu->PC));
+    const cpu_instruction_s *instr = get_instruction(bus_read(debugger_context->bus, debugger_context->cpu->PC));
     byte_t bytes[3] = {0};
     bytes[0] = bus_read(debugger_context->bus, debugger_context->cpu->PC);
     if (instr->length > 1) bytes[1] = bus_read(debugger_context->bus, debugger_context->cpu->PC + 1);
@@ -464,7 +464,7 @@ static void draw_registers(debugger_s *debugger_context) {
     int flag_x = x + flags_label_width;
     for (int i = 0; i < 8; i++) {
         byte_t mask = 0x80 >> i;
-        bool set = (debugger_context->cpu->STATUS & mask) != 0;
+        bool set = (cpu_get_status(debugger_context->cpu) & mask) != 0;
         char flag_char[2] = {flags[i], '\0'};
         draw_text(debugger_context, flag_x, y, flag_char, set ? COLOR_FLAG_ON : COLOR_FLAG_OFF);
         flag_x += flag_char_spacing;
@@ -477,12 +477,25 @@ static void draw_registers(debugger_s *debugger_context) {
     const int cycles_value_x = 112;
 
     draw_text(debugger_context, x, y, "Status:", COLOR_LABEL);
-    snprintf(buf, sizeof(buf), "%02X", debugger_context->cpu->STATUS);
+    snprintf(buf, sizeof(buf), "%02X", cpu_get_status(debugger_context->cpu));
     draw_text(debugger_context, x + status_value_x, y, buf, COLOR_VALUE);
 
     draw_text(debugger_context, x + cycles_label_x, y, "Cycles:", COLOR_LABEL);
     snprintf(buf, sizeof(buf), "%zu", debugger_context->cpu->cycles);
     draw_text(debugger_context, x + cycles_label_x + cycles_value_x, y, buf, COLOR_VALUE);
+
+    
+    y += LINE_HEIGHT + 8;
+    const int rewind_value_x = 112;
+
+    draw_text(debugger_context, x, y, "Rewind:", COLOR_LABEL);
+    if (debugger_context->history) {
+        snprintf(buf, sizeof(buf), "%zu snaps, %.1f us/frame",
+                 rewind_buffer_snapshots(debugger_context->history), debugger_context->capture_us);
+        draw_text(debugger_context, x + rewind_value_x, y, buf, COLOR_VALUE);
+    } else {
+        draw_text(debugger_context, x + rewind_value_x, y, "off", COLOR_FLAG_OFF);
+    }
 }
 
 
@@ -506,7 +519,7 @@ static void draw_instruction(debugger_s *debugger_context) {
 
     
     y += LINE_HEIGHT;
-    cpu_instruction_s *instr = get_instruction(debugger_context->cpu, bus_read(debugger_context->bus, debugger_context->cpu->PC));
+    const cpu_instruction_s *instr = get_instruction(bus_read(debugger_context->bus, debugger_context->cpu->PC));
     draw_text(debugger_context, x, y, "Mnemonic:", COLOR_LABEL);
     draw_text(debugger_context, x + INSTR_LABEL_WIDTH, y, instr->name ? instr->name : "???", COLOR_VALUE);
 
@@ -611,17 +624,7 @@ static void update_screen_texture(debugger_s *debugger_context) {
     int pitch;
 
     if (SDL_LockTexture(debugger_context->screen_texture, NULL, &pixels, &pitch) == 0) {
-        uint32_t *framebuffer = ppu_get_framebuffer(debugger_context->bus->ppu);
-
-        
-        for (int y = 0; y < PPU_SCREEN_HEIGHT; y++) {
-            memcpy(
-                (uint8_t *)pixels + y * pitch,
-                framebuffer + y * PPU_SCREEN_WIDTH,
-                PPU_SCREEN_WIDTH * sizeof(uint32_t)
-            );
-        }
-
+        ppu_framebuffer_to_argb(debugger_context->bus->ppu, pixels, (size_t)pitch);
         SDL_UnlockTexture(debugger_context->screen_texture);
     }
 }
@@ -644,28 +647,20 @@ static void update_pattern_texture(debugger_s *debugger_context) {
 
         
         for (int table = 0; table < 2; table++) {
-            word_t table_base = table * 0x1000;
             int x_offset = table * 128;
 
             for (int tile_y = 0; tile_y < 16; tile_y++) {
                 for (int tile_x = 0; tile_x < 16; tile_x++) {
                     int tile_index = tile_y * 16 + tile_x;
-                    word_t tile_addr = table_base + tile_index * 16;
+                    const byte_t *tile = ppu_get_pattern_tile(ppu, table * 256 + tile_index);
 
-                    
                     for (int row = 0; row < 8; row++) {
-                        byte_t plane0 = ppu_vram_read(ppu, tile_addr + row);
-                        byte_t plane1 = ppu_vram_read(ppu, tile_addr + row + 8);
+                        int py = tile_y * 8 + row;
+                        uint32_t *row_pixels = (uint32_t *)((uint8_t *)pixels + py * pitch);
+                        uint32_t *dst = &row_pixels[x_offset + tile_x * 8];
 
                         for (int col = 0; col < 8; col++) {
-                            int bit = 7 - col;
-                            int color_index = ((plane0 >> bit) & 1) | (((plane1 >> bit) & 1) << 1);
-
-                            int px = x_offset + tile_x * 8 + col;
-                            int py = tile_y * 8 + row;
-
-                            uint32_t *row_pixels = (uint32_t *)((uint8_t *)pixels + py * pitch);
-                            row_pixels[px] = colors[color_index];
+                            dst[col] = colors[tile[row * 8 + col]];
                         }
                     }
                 }
@@ -832,6 +827,9 @@ static void draw_controls(debugger_s *debugger_context) {
     } else if (debugger_context->paused) {
         status = "PAUSED";
         status_color = COLOR_PAUSED;
+    } else if (debugger_context->rewinding) {
+        status = "REWIND";
+        status_color = COLOR_PAUSED;
     } else {
         status = "RUNNING";
         status_color = COLOR_RUNNING;
@@ -852,7 +850,7 @@ static void draw_controls(debugger_s *debugger_context) {
 static void reset_to_init_state(debugger_s *debugger_context) {
     debugger_context->cpu->PC = debugger_context->init_state.PC;
     debugger_context->cpu->SP = debugger_context->init_state.SP;
-    debugger_context->cpu->STATUS = debugger_context->init_state.STATUS;
+    cpu_set_status(debugger_context->cpu, debugger_context->init_state.STATUS);
     debugger_context->cpu->A = debugger_context->init_state.A;
     debugger_context->cpu->X = debugger_context->init_state.X;
     debugger_context->cpu->Y = debugger_context->init_state.Y;
@@ -863,6 +861,13 @@ static void reset_to_init_state(debugger_s *debugger_context) {
 
 
 static void handle_input(debugger_s *debugger_context, SDL_Event *event) {
+    if (event->type == SDL_KEYUP) {
+        if (event->key.keysym.sym == SDLK_BACKSPACE) {
+            debugger_context->rewinding = false;
+        }
+        return;
+    }
+
     if (event->type == SDL_KEYDOWN) {
         
         if (debugger_context->illegal_opcode) {
@@ -995,6 +1000,12 @@ static void handle_input(debugger_s *debugger_context, SDL_Event *event) {
                 debugger_context->play_mode = !debugger_context->play_mode;
                 break;
 
+            case SDLK_BACKSPACE:
+                
+                debugger_context->quit_requested = false;
+                debugger_context->rewinding = debugger_context->history != NULL;
+                break;
+
             case SDLK_v:
                 
                 debugger_context->quit_requested = false;
@@ -1124,10 +1135,12 @@ static void render(debugger_s *debugger_context) {
     SDL_RenderPresent(debugger_context->renderer);
 }
 
-bool debugger_init(debugger_s *debugger_context, cpu_s *cpu, bus_s *bus) {
+bool debugger_init(debugger_s *debugger_context, nes_console_s *nes) {
+    cpu_s *cpu = nes->cpu;
     memset(debugger_context, 0, sizeof(*debugger_context));
+    debugger_context->nes = nes;
     debugger_context->cpu = cpu;
-    debugger_context->bus = bus;
+    debugger_context->bus = nes->bus;
     debugger_context->running = true;
     debugger_context->paused = true;
     debugger_context->step_requested = false;
@@ -1144,7 +1157,7 @@ bool debugger_init(debugger_s *debugger_context, cpu_s *cpu, bus_s *bus) {
     
     debugger_context->init_state.PC = cpu->PC;
     debugger_context->init_state.SP = cpu->SP;
-    debugger_context->init_state.STATUS = cpu->STATUS;
+    debugger_context->init_state.STATUS = cpu_get_status(cpu);
     debugger_context->init_state.A = cpu->A;
     debugger_context->init_state.X = cpu->X;
     debugger_context->init_state.Y = cpu->Y;
@@ -1227,26 +1240,30 @@ bool debugger_init(debugger_s *debugger_context, cpu_s *cpu, bus_s *bus) {
         return false;
     }
 
-    return true;
-}
-
-
-static void execute_with_ppu(debugger_s *debugger_context) {
     
-    size_t cycles_before = debugger_context->cpu->cycles;
+    debugger_context->history = rewind_buffer_create(nes, DEBUGGER_REWIND_CAPACITY, REWIND_DEFAULT_INTERVAL);
+    if (!debugger_context->history) {
+        fprintf(stderr, "Rewind disabled: out of memory\n");
+    }
+    debugger_context->run_ahead_state_size = nes_save_state_size(nes);
+    debugger_context->run_ahead_state = malloc(debugger_context->run_ahead_state_size);
 
-    
-    run_instruction(debugger_context->cpu);
+    return true;
+}
 
-    
-    size_t cpu_cycles = debugger_context->cpu->cycles - cycles_before;
 
-    
-    for (size_t i = 0; i < cpu_cycles * 3; i++) {
-        ppu_tick(debugger_context->bus->ppu);
+// Keeps a moving average of the capture cost for the registers panel
+static void capture_snapshot(debugger_s *debugger_context) {
+    if (!debugger_context->history) {
+        return;
     }
+    uint64_t start = SDL_GetPerformanceCounter();
+    rewind_buffer_capture(debugger_context->history, debugger_context->nes);
+    double us = (double)(SDL_GetPerformanceCounter() - start) * 1e6 / (double)SDL_GetPerformanceFrequency();
+    debugger_context->capture_us = debugger_context->capture_us * 0.9 + us * 0.1;
 }
 
+
 void debugger_run(debugger_s *debugger_context) {
     SDL_Event event;
     bool frame_updated = false;
@@ -1266,33 +1283,33 @@ void debugger_run(debugger_s *debugger_context) {
         
         if (!debugger_context->illegal_opcode) {
             
-            if (!debugger_context->paused) {
-                
-                int max_instructions = 100000;
-                for (int i = 0; i < max_instructions; i++) {
-                    
-                    byte_t opcode = bus_read(debugger_context->bus, debugger_context->cpu->PC);
-                    if (is_illegal_opcode(debugger_context->cpu, opcode)) {
-                        debugger_context->illegal_opcode = true;
-                        debugger_context->paused = true;
-                        break;
-                    }
-
-                    execute_with_ppu(debugger_context);
-
-                    
-                    if (ppu_frame_complete(debugger_context->bus->ppu)) {
-                        frame_updated = true;
-                        break;
-                    }
+            if (!debugger_context->paused && debugger_context->rewinding) {
+                // The framebuffer isn't part of a snapshot: run a frame from
+                // it to have something to show
+                if (rewind_buffer_step_back(debugger_context->history, debugger_context->nes)) {
+                    nes_run_frame(debugger_context->nes);
+                    frame_updated = true;
+                }
+            } else if (!debugger_context->paused) {
+                unsigned frames_ahead = debugger_context->run_ahead_state ? debugger_context->run_ahead_frames : 0;
+                int result = nes_run_frame_ahead(debugger_context->nes, frames_ahead,
+                                                 debugger_context->run_ahead_state,
+                                                 debugger_context->run_ahead_state_size);
+                if (result & STEP_RESULT_ILLEGAL_OPCODE) {
+                    debugger_context->illegal_opcode = true;
+                    debugger_context->paused = true;
+                }
+                if (result & STEP_RESULT_FRAME_COMPLETE) {
+                    frame_updated = true;
+                    capture_snapshot(debugger_context);
                 }
             } else if (debugger_context->step_requested) {
                 
                 byte_t opcode = bus_read(debugger_context->bus, debugger_context->cpu->PC);
-                if (is_illegal_opcode(debugger_context->cpu, opcode)) {
+                if (is_illegal_opcode(opcode)) {
                     debugger_context->illegal_opcode = true;
                 } else {
-                    execute_with_ppu(debugger_context);
+                    nes_step(debugger_context->nes);
                     frame_updated = true;
                 }
                 debugger_context->step_requested = false;
@@ -1315,6 +1332,10 @@ void debugger_run(debugger_s *debugger_context) {
 }
 
 void debugger_cleanup(debugger_s *debugger_context) {
+    rewind_buffer_destroy(debugger_context->history);
+    debugger_context->history = NULL;
+    free(debugger_context->run_ahead_state);
+    debugger_context->run_ahead_state = NULL;
     if (debugger_context->pattern_texture) {
         SDL_DestroyTexture(debugger_context->pattern_texture);
         debugger_context->pattern_texture = NULL;
@@ -1350,6 +1371,7 @@ int main(int argc, char *argv[]) {
     bool play_mode = false;
     bool show_rom_info = false;
     bool test_rom_mode = false;
+    unsigned run_ahead_frames = 0;
 
     
     for (int i = 1; i < argc; i++) {
@@ -1358,6 +1380,9 @@ int main(int argc, char *argv[]) {
             i++;
         } else if (strcmp(argv[i], "--play") == 0) {
             play_mode = true;
+        } else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+            run_ahead_frames = (unsigned)strtoul(argv[i + 1], NULL, 10);
+            i++;
         } else if (strcmp(argv[i], "--rom-info") == 0) {
             show_rom_info = true;
         } else if (strcmp(argv[i], "--test-rom") == 0) {
@@ -1368,6 +1393,7 @@ int main(int argc, char *argv[]) {
             printf("  --rom <path>  Load ROM from path\n");
             printf("  --test-rom    Load nestest.nes with automation state (PC=$C000, SP=$FD, P=$24)\n");
             printf("  --play        Start in full-screen play mode\n");
+            printf("  --run-ahead <frames>  Show the frame this many frames ahead of the emulated one\n");
             printf("  --rom-info    Print ROM header information\n");
             printf("  --help, -h    Show this help message\n");
             return 0;
@@ -1386,6 +1412,7 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "  --rom <path>  Load ROM from path\n");
         fprintf(stderr, "  --test-rom    Load nestest.nes with automation state (PC=$C000, SP=$FD, P=$24)\n");
         fprintf(stderr, "  --play        Start in full-screen play mode\n");
+        fprintf(stderr, "  --run-ahead <frames>  Show the frame this many frames ahead of the emulated one\n");
         fprintf(stderr, "  --rom-info    Print ROM header information\n");
         fprintf(stderr, "  --help, -h    Show this help message\n");
         return 1;
@@ -1404,8 +1431,12 @@ int main(int argc, char *argv[]) {
     }
 
     
-    nes_console_s *nes = nes_get_instance();
-    nes_init(nes);
+    nes_console_s *nes = nes_console_create();
+    if (!nes) {
+        fprintf(stderr, "Failed to create console\n");
+        gamecart_free(&cart);
+        return 1;
+    }
     cpu_s *cpu = nes->cpu;
     bus_s *bus = nes->bus;
 
@@ -1426,8 +1457,8 @@ int main(int argc, char *argv[]) {
     if (test_rom_mode) {
         cpu->PC = NESTEST_START_PC;
         cpu->SP = NESTEST_INITIAL_SP;
-        cpu->STATUS = NESTEST_INITIAL_STATUS;
-        printf("Test ROM mode: PC=$%04X, SP=$%02X, P=$%02X\n", cpu->PC, cpu->SP, cpu->STATUS);
+        cpu_set_status(cpu, NESTEST_INITIAL_STATUS);
+        printf("Test ROM mode: PC=$%04X, SP=$%02X, P=$%02X\n", cpu->PC, cpu->SP, cpu_get_status(cpu));
     } else {
         word_t reset_vector = bus_read_word(bus, 0xFFFC);
         cpu->PC = reset_vector;
@@ -1436,8 +1467,9 @@ int main(int argc, char *argv[]) {
 
     
     debugger_s debugger_context;
-    if (!debugger_init(&debugger_context, cpu, bus)) {
+    if (!debugger_init(&debugger_context, nes)) {
         fprintf(stderr, "Failed to initialize debugger\n");
+        nes_console_destroy(nes);
         gamecart_free(&cart);
         return 1;
     }
@@ -1447,12 +1479,14 @@ int main(int argc, char *argv[]) {
         debugger_context.play_mode = true;
         debugger_context.paused = false;
     }
+    debugger_context.run_ahead_frames = run_ahead_frames;
 
-    printf("\nDebugger started. Press P to run/pause, SPACE to step, D to toggle debug view, Q/ESC to quit.\n");
+    printf("\nDebugger started. Press P to run/pause, SPACE to step, hold BACKSPACE to rewind, D to toggle debug view, Q/ESC to quit.\n");
     debugger_run(&debugger_context);
 
     
     debugger_cleanup(&debugger_context);
+    nes_console_destroy(nes);
     gamecart_free(&cart);
     return 0;
 }
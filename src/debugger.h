@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include "cpu.h"
 #include "bus.h"
+#include "nes.h"
+#include "rewind.h"
 
 #define DEBUGGER_WINDOW_WIDTH  1280
 #define DEBUGGER_WINDOW_HEIGHT 720
@@ -13,6 +15,9 @@
 #define FONT_HEIGHT 8
 #define FONT_SCALE  2
 
+// About an hour of history at one snapshot per frame
+#define DEBUGGER_REWIND_CAPACITY (32 * 1024 * 1024)
+
 typedef enum {
     MEM_VIEW_MODE_ZERO_PAGE,
     MEM_VIEW_MODE_STACK,
@@ -40,6 +45,7 @@ typedef struct {
     SDL_Texture *screen_texture;
     SDL_Texture *pattern_texture;
 
+    nes_console_s *nes;
     cpu_s *cpu;
     bus_s *bus;
 
@@ -60,9 +66,19 @@ typedef struct {
     int oam_scroll_offset;
 
     int run_speed;
+
+    // Held BACKSPACE steps back one snapshot per frame
+    rewind_buffer_s *history;
+    bool rewinding;
+    double capture_us;
+
+    // Frames run ahead of the one shown, with the state to return to
+    unsigned run_ahead_frames;
+    byte_t *run_ahead_state;
+    size_t run_ahead_state_size;
 } debugger_s;
 
-bool debugger_init(debugger_s *dbg, cpu_s *cpu, bus_s *bus);
+bool debugger_init(debugger_s *dbg, nes_console_s *nes);
 void debugger_run(debugger_s *dbg);
 void debugger_cleanup(debugger_s *dbg);
 
@@ -12,6 +12,8 @@ typedef struct gamecart_s {
     ines_rom_t rom;
     uint8_t *prg_ram;
     size_t prg_ram_size;
+    uint8_t *chr_ram;
+    size_t chr_ram_size;
     int mapper_type;
     mapper_state_s *mapper;
     mirroring_mode_e mirroring;
@@ -1,6 +1,11 @@
 #include "ines.h"
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static bool validate_header(const ines_header_t *header) {
     return header->magic[0] == 'N' &&
@@ -84,13 +89,197 @@ bool ines_load(const char *path, ines_rom_t *rom) {
     return result;
 }
 
+// Maps the open file read-only and points prg_rom/chr_rom into the
+// mapping, so loading copies nothing and pages are only read in as they
+// are touched
+static bool map_fd(int fd, const struct stat *st, ines_rom_t *rom) {
+    memset(rom, 0, sizeof(ines_rom_t));
+
+    if (!S_ISREG(st->st_mode) || (size_t)st->st_size < sizeof(ines_header_t)) {
+        return false;
+    }
+    size_t file_bytes = (size_t)st->st_size;
+    byte_t *data = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    memcpy(&rom->header, data, sizeof(ines_header_t));
+    if (!validate_header(&rom->header)) {
+        munmap(data, file_bytes);
+        return false;
+    }
+
+    decode_header(rom);
+
+    size_t offset = sizeof(ines_header_t) + (rom->has_trainer ? INES_TRAINER_SIZE : 0);
+    if (offset + rom->prg_rom_bytes + rom->chr_rom_bytes > file_bytes) {
+        munmap(data, file_bytes);
+        memset(rom, 0, sizeof(ines_rom_t));
+        return false;
+    }
+
+    rom->mapping = data;
+    rom->mapping_bytes = file_bytes;
+    rom->prg_rom = rom->prg_rom_bytes > 0 ? &data[offset] : NULL;
+    rom->chr_rom = rom->chr_rom_bytes > 0 ? &data[offset + rom->prg_rom_bytes] : NULL;
+    return true;
+}
+
+// Reads the open file from the start through its own descriptor, leaving
+// fd open
+static bool load_fd(int fd, ines_rom_t *rom) {
+    memset(rom, 0, sizeof(ines_rom_t));
+
+    int copy = dup(fd);
+    if (copy < 0) {
+        return false;
+    }
+    FILE *file = fdopen(copy, "rb");
+    if (!file) {
+        close(copy);
+        return false;
+    }
+    bool result = fseek(file, 0, SEEK_SET) == 0 && ines_load_file(file, rom);
+    fclose(file);
+    return result;
+}
+
+// Maps the file at path; see map_fd
+bool ines_map(const char *path, ines_rom_t *rom) {
+    if (!path || !rom) {
+        return false;
+    }
+
+    memset(rom, 0, sizeof(ines_rom_t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool result = fstat(fd, &st) == 0 && map_fd(fd, &st, rom);
+    close(fd);
+    return result;
+}
+
 void ines_free(ines_rom_t *rom) {
     if (rom) {
-        free(rom->prg_rom);
-        free(rom->chr_rom);
+        if (rom->mapping) {
+            munmap(rom->mapping, rom->mapping_bytes);
+        } else {
+            free(rom->prg_rom);
+            free(rom->chr_rom);
+        }
         rom->prg_rom = NULL;
         rom->chr_rom = NULL;
+        rom->mapping = NULL;
+        rom->mapping_bytes = 0;
+    }
+}
+
+typedef struct ines_image_s {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    ines_rom_t rom;
+    unsigned refs;
+    struct ines_image_s *next;
+} ines_image_s;
+
+// Guards images and every image's refs
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+static ines_image_s *images = NULL;
+
+static bool same_file(const ines_image_s *image, const struct stat *st) {
+    return image->device == st->st_dev && image->inode == st->st_ino &&
+           image->size == st->st_size &&
+           image->modified.tv_sec == st->st_mtim.tv_sec &&
+           image->modified.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+bool ines_acquire(const char *path, ines_rom_t *rom) {
+    if (!path || !rom) {
+        return false;
+    }
+
+    // The file is identified and read through one descriptor, so it can't
+    // be replaced in between
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    pthread_mutex_lock(&images_lock);
+    ines_image_s *image = images;
+    while (image && !same_file(image, &st)) {
+        image = image->next;
+    }
+    if (image) {
+        image->refs++;
+    } else {
+        image = calloc(1, sizeof(*image));
+        if (image && !map_fd(fd, &st, &image->rom) && !load_fd(fd, &image->rom)) {
+            free(image);
+            image = NULL;
+        }
+        if (image) {
+            image->device = st.st_dev;
+            image->inode = st.st_ino;
+            image->size = st.st_size;
+            image->modified = st.st_mtim;
+            image->refs = 1;
+            image->next = images;
+            images = image;
+        }
+    }
+    if (image) {
+        *rom = image->rom;
+    }
+    pthread_mutex_unlock(&images_lock);
+
+    close(fd);
+    return image != NULL;
+}
+
+// Roms that didn't come from ines_acquire are freed as by ines_free
+void ines_release(ines_rom_t *rom) {
+    if (!rom) {
+        return;
+    }
+
+    pthread_mutex_lock(&images_lock);
+    for (ines_image_s **link = &images; *link; link = &(*link)->next) {
+        ines_image_s *image = *link;
+        if (image->rom.prg_rom == rom->prg_rom && image->rom.chr_rom == rom->chr_rom) {
+            if (--image->refs == 0) {
+                *link = image->next;
+                ines_free(&image->rom);
+                free(image);
+            }
+            pthread_mutex_unlock(&images_lock);
+            memset(rom, 0, sizeof(ines_rom_t));
+            return;
+        }
+    }
+    pthread_mutex_unlock(&images_lock);
+    ines_free(rom);
+}
+
+size_t ines_cached_images(void) {
+    size_t count = 0;
+    pthread_mutex_lock(&images_lock);
+    for (const ines_image_s *image = images; image; image = image->next) {
+        count++;
     }
+    pthread_mutex_unlock(&images_lock);
+    return count;
 }
 
 void ines_print_info(const ines_rom_t *rom) {
@@ -32,11 +32,25 @@ typedef struct {
     byte_t *chr_rom;
     size_t prg_rom_bytes;
     size_t chr_rom_bytes;
+    // Read-only mapping of the whole file when loaded by ines_map; prg_rom
+    // and chr_rom point into it instead of owning copies
+    void *mapping;
+    size_t mapping_bytes;
 } ines_rom_t;
 
 bool ines_load(const char *path, ines_rom_t *rom);
 bool ines_load_file(FILE *file, ines_rom_t *rom);
+bool ines_map(const char *path, ines_rom_t *rom);
 void ines_free(ines_rom_t *rom);
+
+// Shared, refcounted images: every ines_acquire of the same file (by device
+// and inode, while its size and mtime don't change) gets the same PRG and
+// CHR memory, mapped with ines_map where possible. Each one is dropped with
+// ines_release. Consoles on different threads may load and free carts
+// concurrently.
+bool ines_acquire(const char *path, ines_rom_t *rom);
+void ines_release(ines_rom_t *rom);
+size_t ines_cached_images(void);
 void ines_print_info(const ines_rom_t *rom);
 
 #endif
@@ -0,0 +1,367 @@
+#include "mapper.h"
+#include "bus.h"
+#include "cpu.h"
+#include "gamecart.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct mapper_info_s {
+    mapper_type_e type;
+    const char *name;
+    void (*power_on)(mapper_state_s *mapper);
+    void (*update_banks)(gamecart_s *cart);
+    void (*write)(gamecart_s *cart, word_t addr, byte_t value);
+    bool scanline_counter;
+};
+
+#define PRG_16K 0x4000
+#define PRG_32K 0x8000
+#define CHR_2K  0x0800
+#define CHR_4K  0x1000
+#define CHR_8K  0x2000
+
+static size_t prg_bank_count(const gamecart_s *cart, size_t size)
+{
+    size_t count = cart->rom.prg_rom_bytes / size;
+    return count > 0 ? count : 1;
+}
+
+// Points the PRG windows covering size bytes from window at bank number
+// bank of that size. Bank numbers wrap at the end of the ROM, and a ROM
+// smaller than size repeats.
+static void map_prg(gamecart_s *cart, int window, size_t size, size_t bank)
+{
+    byte_t *mem = &cart->rom.prg_rom[(bank % prg_bank_count(cart, size)) * size];
+    for (size_t i = 0; i < size / MAPPER_PRG_WINDOW_SIZE; i++) {
+        size_t offset = (i * MAPPER_PRG_WINDOW_SIZE) % cart->rom.prg_rom_bytes;
+        cart->mapper->prg_windows[window + i] = mem + offset;
+    }
+}
+
+// Same as map_prg for CHR ROM, or CHR RAM on carts without it
+static void map_chr(gamecart_s *cart, int window, size_t size, size_t bank)
+{
+    byte_t *chr = cart->chr_ram ? cart->chr_ram : cart->rom.chr_rom;
+    size_t chr_size = cart->chr_ram ? cart->chr_ram_size : cart->rom.chr_rom_bytes;
+    size_t count = chr_size / size > 0 ? chr_size / size : 1;
+    for (size_t i = 0; i < size / MAPPER_CHR_WINDOW_SIZE; i++) {
+        size_t offset = chr_size ? ((bank % count) * size + i * MAPPER_CHR_WINDOW_SIZE) % chr_size : 0;
+        cart->mapper->chr_windows[window + i] = chr ? &chr[offset] : NULL;
+    }
+}
+
+// https://www.nesdev.org/wiki/NROM
+static void nrom_update_banks(gamecart_s *cart)
+{
+    map_prg(cart, 0, PRG_16K, 0);
+    map_prg(cart, 2, PRG_16K, 1);
+    map_chr(cart, 0, CHR_8K, 0);
+}
+
+// https://www.nesdev.org/wiki/UxROM
+static void uxrom_update_banks(gamecart_s *cart)
+{
+    map_prg(cart, 0, PRG_16K, cart->mapper->regs.latch);
+    map_prg(cart, 2, PRG_16K, prg_bank_count(cart, PRG_16K) - 1);
+    map_chr(cart, 0, CHR_8K, 0);
+}
+
+// https://www.nesdev.org/wiki/CNROM
+static void cnrom_update_banks(gamecart_s *cart)
+{
+    map_prg(cart, 0, PRG_16K, 0);
+    map_prg(cart, 2, PRG_16K, 1);
+    map_chr(cart, 0, CHR_8K, cart->mapper->regs.latch);
+}
+
+static void latch_write(gamecart_s *cart, word_t addr, byte_t value)
+{
+    (void)addr;
+    cart->mapper->regs.latch = value;
+}
+
+// https://www.nesdev.org/wiki/MMC1#Registers
+static void mmc1_power_on(mapper_state_s *mapper)
+{
+    mapper->regs.mmc1.control = 0x0C;
+}
+
+static void mmc1_update_banks(gamecart_s *cart)
+{
+    static const mirroring_mode_e mirroring[4] = {
+        MIRROR_SINGLE_LOW, MIRROR_SINGLE_HIGH, MIRROR_VERTICAL, MIRROR_HORIZONTAL,
+    };
+    const mapper_state_s *mapper = cart->mapper;
+    byte_t control = mapper->regs.mmc1.control;
+    byte_t prg_bank = mapper->regs.mmc1.prg_bank & 0x0F;
+
+    cart->mirroring = mirroring[control & 0x03];
+
+    switch ((control >> 2) & 0x03) {
+    case 0:
+    case 1:
+        map_prg(cart, 0, PRG_32K, prg_bank >> 1);
+        break;
+    case 2:
+        map_prg(cart, 0, PRG_16K, 0);
+        map_prg(cart, 2, PRG_16K, prg_bank);
+        break;
+    case 3:
+        map_prg(cart, 0, PRG_16K, prg_bank);
+        map_prg(cart, 2, PRG_16K, prg_bank_count(cart, PRG_16K) - 1);
+        break;
+    }
+
+    if (control & 0x10) {
+        map_chr(cart, 0, CHR_4K, mapper->regs.mmc1.chr_bank[0]);
+        map_chr(cart, 4, CHR_4K, mapper->regs.mmc1.chr_bank[1]);
+    } else {
+        map_chr(cart, 0, CHR_8K, mapper->regs.mmc1.chr_bank[0] >> 1);
+    }
+}
+
+// Registers are loaded one bit at a time through a 5-bit shift register;
+// the fifth write picks the register from address bits 13-14
+static void mmc1_write(gamecart_s *cart, word_t addr, byte_t value)
+{
+    mapper_state_s *mapper = cart->mapper;
+    if (value & 0x80) {
+        mapper->regs.mmc1.shift = 0;
+        mapper->regs.mmc1.shift_count = 0;
+        mapper->regs.mmc1.control |= 0x0C;
+        return;
+    }
+
+    mapper->regs.mmc1.shift |= (byte_t)((value & 1) << mapper->regs.mmc1.shift_count);
+    if (++mapper->regs.mmc1.shift_count < 5) {
+        return;
+    }
+
+    byte_t data = mapper->regs.mmc1.shift;
+    switch ((addr >> 13) & 0x03) {
+    case 0: mapper->regs.mmc1.control = data; break;
+    case 1: mapper->regs.mmc1.chr_bank[0] = data; break;
+    case 2: mapper->regs.mmc1.chr_bank[1] = data; break;
+    case 3: mapper->regs.mmc1.prg_bank = data; break;
+    }
+    mapper->regs.mmc1.shift = 0;
+    mapper->regs.mmc1.shift_count = 0;
+}
+
+// https://www.nesdev.org/wiki/MMC3#Registers
+static void mmc3_power_on(mapper_state_s *mapper)
+{
+    static const byte_t banks[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+    memcpy(mapper->regs.mmc3.banks, banks, sizeof(banks));
+}
+
+static void mmc3_update_banks(gamecart_s *cart)
+{
+    const mapper_state_s *mapper = cart->mapper;
+    const byte_t *banks = mapper->regs.mmc3.banks;
+    size_t second_last = prg_bank_count(cart, MAPPER_PRG_WINDOW_SIZE) - 2;
+
+    if (cart->mirroring != MIRROR_FOUR_SCREEN) {
+        cart->mirroring = (mapper->regs.mmc3.mirroring & 1) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL;
+    }
+
+    bool prg_swap = mapper->regs.mmc3.bank_select & 0x40;
+    map_prg(cart, 0, MAPPER_PRG_WINDOW_SIZE, prg_swap ? second_last : banks[6]);
+    map_prg(cart, 1, MAPPER_PRG_WINDOW_SIZE, banks[7]);
+    map_prg(cart, 2, MAPPER_PRG_WINDOW_SIZE, prg_swap ? banks[6] : second_last);
+    map_prg(cart, 3, MAPPER_PRG_WINDOW_SIZE, second_last + 1);
+
+    // R0/R1 select 2KB banks in 1KB units; A12 inversion swaps the halves
+    int inverted = (mapper->regs.mmc3.bank_select & 0x80) ? 4 : 0;
+    map_chr(cart, inverted + 0, CHR_2K, banks[0] >> 1);
+    map_chr(cart, inverted + 2, CHR_2K, banks[1] >> 1);
+    for (int i = 0; i < 4; i++) {
+        map_chr(cart, (4 - inverted) + i, MAPPER_CHR_WINDOW_SIZE, banks[2 + i]);
+    }
+}
+
+static void mmc3_write(gamecart_s *cart, word_t addr, byte_t value)
+{
+    mapper_state_s *mapper = cart->mapper;
+    bool odd = addr & 1;
+
+    switch (addr & 0xE000) {
+    case 0x8000:
+        if (odd) {
+            mapper->regs.mmc3.banks[mapper->regs.mmc3.bank_select & 0x07] = value;
+        } else {
+            mapper->regs.mmc3.bank_select = value;
+        }
+        break;
+    case 0xA000:
+        // Odd: PRG RAM protect, not emulated
+        if (!odd) {
+            mapper->regs.mmc3.mirroring = value;
+        }
+        break;
+    case 0xC000:
+        if (odd) {
+            mapper->regs.mmc3.irq_reload = true;
+        } else {
+            mapper->regs.mmc3.irq_latch = value;
+        }
+        break;
+    case 0xE000:
+        mapper->regs.mmc3.irq_enabled = odd;
+        if (!odd) {
+            mapper->regs.mmc3.irq_asserted = false;
+        }
+        break;
+    }
+}
+
+static const mapper_info_s mappers[] = {
+    {MAPPER_NROM,  "NROM",  NULL,           nrom_update_banks,  NULL,        false},
+    {MAPPER_MMC1,  "MMC1",  mmc1_power_on,  mmc1_update_banks,  mmc1_write,  false},
+    {MAPPER_UXROM, "UxROM", NULL,           uxrom_update_banks, latch_write, false},
+    {MAPPER_CNROM, "CNROM", NULL,           cnrom_update_banks, latch_write, false},
+    {MAPPER_MMC3,  "MMC3",  mmc3_power_on,  mmc3_update_banks,  mmc3_write,  true},
+};
+
+static const mapper_info_s *find_mapper(int mapper_type)
+{
+    for (size_t i = 0; i < sizeof(mappers) / sizeof(mappers[0]); i++) {
+        if ((int)mappers[i].type == mapper_type) {
+            return &mappers[i];
+        }
+    }
+    return NULL;
+}
+
+bool mapper_supported(int mapper_type)
+{
+    return find_mapper(mapper_type) != NULL;
+}
+
+bool mapper_create(gamecart_s *cart)
+{
+    assert(cart != NULL);
+    const mapper_info_s *info = find_mapper(cart->mapper_type);
+    if (!info || !cart->rom.prg_rom || cart->rom.prg_rom_bytes == 0) {
+        return false;
+    }
+    mapper_state_s *mapper = calloc(1, sizeof(*mapper));
+    if (!mapper) {
+        return false;
+    }
+    mapper->info = info;
+    if (info->power_on) {
+        info->power_on(mapper);
+    }
+    cart->mapper = mapper;
+    mapper_update_banks(cart);
+    return true;
+}
+
+void mapper_destroy(gamecart_s *cart)
+{
+    assert(cart != NULL);
+    free(cart->mapper);
+    cart->mapper = NULL;
+}
+
+const char *mapper_name(const gamecart_s *cart)
+{
+    assert(cart != NULL);
+    return cart->mapper ? cart->mapper->info->name : "none";
+}
+
+void mapper_update_banks(gamecart_s *cart)
+{
+    assert(cart != NULL && cart->mapper != NULL);
+    cart->mapper->info->update_banks(cart);
+}
+
+// Bank switches rebuild the bus page tables only when PRG actually moved;
+// CHR banks that didn't change keep their decoded tiles in the PPU
+void mapper_write(bus_s *bus, word_t addr, byte_t value)
+{
+    assert(bus != NULL && bus->cart != NULL && bus->cart->mapper != NULL);
+    gamecart_s *cart = bus->cart;
+    mapper_state_s *mapper = cart->mapper;
+    if (!mapper->info->write) {
+        return;
+    }
+
+    byte_t *old_prg[MAPPER_PRG_WINDOWS];
+    memcpy(old_prg, mapper->prg_windows, sizeof(old_prg));
+    mirroring_mode_e old_mirroring = cart->mirroring;
+
+    mapper->info->write(cart, addr, value);
+    mapper_update_banks(cart);
+
+    if (memcmp(old_prg, mapper->prg_windows, sizeof(old_prg)) != 0) {
+        bus_map_pages(bus);
+    }
+    bus_map_chr(bus);
+    if (cart->mirroring != old_mirroring && bus->ppu) {
+        bus_set_mirroring(bus, cart->mirroring);
+    }
+    if (mapper->info->scanline_counter) {
+        mapper_schedule_irq(bus);
+    }
+}
+
+bool mapper_has_scanline_counter(const gamecart_s *cart)
+{
+    assert(cart != NULL);
+    return cart->mapper && cart->mapper->info->scanline_counter;
+}
+
+bool mapper_irq_asserted(const gamecart_s *cart)
+{
+    return cart && mapper_has_scanline_counter(cart) && cart->mapper->regs.mmc3.irq_asserted;
+}
+
+// https://www.nesdev.org/wiki/MMC3#IRQ_Specifics
+// Called by the PPU for every rendered line
+void mapper_clock_scanline(void *context)
+{
+    bus_s *bus = context;
+    mapper_state_s *mapper = bus->cart->mapper;
+    if (mapper->regs.mmc3.irq_counter == 0 || mapper->regs.mmc3.irq_reload) {
+        mapper->regs.mmc3.irq_counter = mapper->regs.mmc3.irq_latch;
+        mapper->regs.mmc3.irq_reload = false;
+    } else {
+        mapper->regs.mmc3.irq_counter--;
+    }
+    if (mapper->regs.mmc3.irq_counter == 0 && mapper->regs.mmc3.irq_enabled) {
+        mapper->regs.mmc3.irq_asserted = true;
+    }
+}
+
+// The counter's next zero is predicted as if rendering stays on. Rendering
+// being off only delays the zero, so the event may come early, in which
+// case the handler finds the line clear and calls this again; it is never
+// late. Must be called with the PPU synced.
+void mapper_schedule_irq(bus_s *bus)
+{
+    assert(bus != NULL);
+    gamecart_s *cart = bus->cart;
+    if (!cart || !mapper_has_scanline_counter(cart) || !bus->ppu) {
+        return;
+    }
+
+    mapper_state_s *mapper = cart->mapper;
+    if (mapper->regs.mmc3.irq_asserted) {
+        bus_schedule(bus, SCHEDULER_EVENT_MAPPER_IRQ, bus->ppu_sync_cycle);
+        return;
+    }
+    if (!mapper->regs.mmc3.irq_enabled) {
+        scheduler_cancel(&bus->scheduler, SCHEDULER_EVENT_MAPPER_IRQ);
+        return;
+    }
+
+    unsigned clocks = mapper->regs.mmc3.irq_counter;
+    if (clocks == 0 || mapper->regs.mmc3.irq_reload) {
+        clocks = mapper->regs.mmc3.irq_latch + 1u;
+    }
+    size_t dots = ppu_dots_until_scanline_hook(bus->ppu, clocks);
+    bus_schedule(bus, SCHEDULER_EVENT_MAPPER_IRQ, bus->ppu_sync_cycle + (dots + 2) / 3);
+}
@@ -0,0 +1,86 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include "cpu_defs.h"
+#include "ppu.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct gamecart_s gamecart_s;
+typedef struct bus bus_s;
+
+// https://www.nesdev.org/wiki/Mapper
+// Bank switching repoints fixed-size windows: four 8KB PRG windows over
+// $8000-$FFFF and eight 1KB CHR windows over PPU $0000-$1FFF. The bus page
+// tables and the PPU's CHR banks are rebuilt from them after a register
+// write, so reads never depend on which mapper the cart has.
+#define MAPPER_PRG_WINDOW_SIZE 0x2000
+#define MAPPER_PRG_WINDOWS     4
+#define MAPPER_CHR_WINDOW_SIZE PPU_CHR_BANK_SIZE
+#define MAPPER_CHR_WINDOWS     PPU_CHR_BANKS
+
+typedef enum {
+    MAPPER_NROM  = 0,
+    MAPPER_MMC1  = 1,
+    MAPPER_UXROM = 2,
+    MAPPER_CNROM = 3,
+    MAPPER_MMC3  = 4,
+} mapper_type_e;
+
+typedef struct mapper_info_s mapper_info_s;
+
+struct mapper_state_s {
+    const mapper_info_s *info;
+
+    byte_t *prg_windows[MAPPER_PRG_WINDOWS];
+    byte_t *chr_windows[MAPPER_CHR_WINDOWS];
+
+    // Registers; the windows and mirroring are derived from these alone
+    union {
+        // UxROM and CNROM: the last value written to $8000-$FFFF
+        byte_t latch;
+
+        // https://www.nesdev.org/wiki/MMC1
+        struct {
+            byte_t shift;
+            byte_t shift_count;
+            byte_t control;
+            byte_t chr_bank[2];
+            byte_t prg_bank;
+        } mmc1;
+
+        // https://www.nesdev.org/wiki/MMC3
+        struct {
+            byte_t bank_select;
+            byte_t banks[8];
+            byte_t mirroring;
+            byte_t irq_latch;
+            byte_t irq_counter;
+            bool irq_reload;
+            bool irq_enabled;
+            bool irq_asserted;
+        } mmc3;
+    } regs;
+};
+
+bool mapper_supported(int mapper_type);
+// Allocates cart->mapper for cart->mapper_type and maps its power-on banks
+bool mapper_create(gamecart_s *cart);
+void mapper_destroy(gamecart_s *cart);
+const char *mapper_name(const gamecart_s *cart);
+
+// Recomputes the windows and mirroring from the registers
+void mapper_update_banks(gamecart_s *cart);
+// Register write at $8000-$FFFF
+void mapper_write(bus_s *bus, word_t addr, byte_t value);
+
+// Scanline IRQs (MMC3). mapper_schedule_irq arms SCHEDULER_EVENT_MAPPER_IRQ
+// for the next cycle the line could be asserted; the event handler catches
+// the PPU up and checks mapper_irq_asserted.
+bool mapper_has_scanline_counter(const gamecart_s *cart);
+bool mapper_irq_asserted(const gamecart_s *cart);
+void mapper_schedule_irq(bus_s *bus);
+// ppu_s scanline_hook; context is the bus
+void mapper_clock_scanline(void *context);
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "nes.h"
+#include "gamecart.h"
+#include "mapper.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
+
+#define TEST_PRG_ROM_SIZE (128 * 1024)
+#define TEST_CHR_ROM_SIZE (32 * 1024)
+#define TEST_PRG_BANKS_8K (TEST_PRG_ROM_SIZE / 0x2000)
+
+
+static nes_console_s *console = NULL;
+static gamecart_s cart;
+static byte_t prg_rom[TEST_PRG_ROM_SIZE];
+static byte_t chr_rom[TEST_CHR_ROM_SIZE];
+
+
+// Every byte of PRG holds its 8KB bank number and every byte of CHR its
+// 1KB bank number, so a read shows which bank is mapped
+static void attach_cart(int mapper_type, size_t prg_size) {
+    for (size_t i = 0; i < TEST_PRG_ROM_SIZE; i++) {
+        prg_rom[i] = (byte_t)(i / 0x2000);
+    }
+    for (size_t i = 0; i < TEST_CHR_ROM_SIZE; i++) {
+        chr_rom[i] = (byte_t)(i / 0x400);
+    }
+    cart.rom.prg_rom = prg_rom;
+    cart.rom.prg_rom_bytes = prg_size;
+    cart.rom.chr_rom = chr_rom;
+    cart.rom.chr_rom_bytes = TEST_CHR_ROM_SIZE;
+    cart.mapper_type = mapper_type;
+    cart.mirroring = MIRROR_HORIZONTAL;
+    TEST_ASSERT_TRUE(mapper_create(&cart));
+    nes_attach_cart(console, &cart);
+}
+
+static void mmc1_write(word_t addr, byte_t value) {
+    for (int bit = 0; bit < 5; bit++) {
+        bus_write(console->bus, addr, (value >> bit) & 1);
+    }
+}
+
+void setUp(void) {
+    memset(&cart, 0, sizeof(cart));
+    console = nes_console_create();
+}
+
+void tearDown(void) {
+    nes_console_destroy(console);
+    console = NULL;
+    mapper_destroy(&cart);
+}
+
+
+void test_unsupported_mapper_is_rejected(void) {
+    cart.rom.prg_rom = prg_rom;
+    cart.rom.prg_rom_bytes = TEST_PRG_ROM_SIZE;
+    cart.mapper_type = 5;
+    TEST_ASSERT_FALSE(mapper_supported(5));
+    TEST_ASSERT_FALSE(mapper_create(&cart));
+    TEST_ASSERT_NULL(cart.mapper);
+}
+
+void test_nrom_mirrors_16k_prg(void) {
+    attach_cart(MAPPER_NROM, 0x4000);
+    TEST_ASSERT_EQUAL_HEX8(0, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(1, bus_read(console->bus, 0xA000));
+    TEST_ASSERT_EQUAL_HEX8(0, bus_read(console->bus, 0xC000));
+    TEST_ASSERT_EQUAL_HEX8(1, bus_read(console->bus, 0xFFFF));
+}
+
+void test_uxrom_switches_8000_and_fixes_last_bank(void) {
+    attach_cart(MAPPER_UXROM, TEST_PRG_ROM_SIZE);
+    bus_write(console->bus, 0x8000, 3);
+    TEST_ASSERT_EQUAL_HEX8(6, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(7, bus_read(console->bus, 0xBFFF));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0xC000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 1, bus_read(console->bus, 0xFFFF));
+}
+
+void test_uxrom_bank_switch_drops_decoded_code(void) {
+    attach_cart(MAPPER_UXROM, TEST_PRG_ROM_SIZE);
+    const byte_t program[] = {
+        0x20, 0x00, 0x80,  // JSR $8000
+        0x85, 0x00,        // STA $00
+        0xA9, 0x01,        // LDA #$01
+        0x8D, 0x00, 0x80,  // STA $8000: switch to bank 1
+        0x20, 0x00, 0x80,  // JSR $8000
+        0x85, 0x01,        // STA $01
+        0x4C, 0x0F, 0xC0,  // JMP $C00F
+    };
+    const byte_t bank0[] = {0xA9, 0x11, 0x60};  // LDA #$11; RTS
+    const byte_t bank1[] = {0xA9, 0x22, 0x60};  // LDA #$22; RTS
+    memcpy(&prg_rom[TEST_PRG_ROM_SIZE - 0x4000], program, sizeof(program));
+    memcpy(&prg_rom[0x0000], bank0, sizeof(bank0));
+    memcpy(&prg_rom[0x4000], bank1, sizeof(bank1));
+
+    console->cpu->PC = 0xC000;
+    for (int i = 0; i < 16; i++) {
+        nes_step(console);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0x11, console->bus->ram[0x00]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, console->bus->ram[0x01]);
+}
+
+void test_mmc3_code_switching_its_own_bank_runs_the_new_bank(void) {
+    attach_cart(MAPPER_MMC3, TEST_PRG_ROM_SIZE);
+    // Bank 0: INC $10; LDA #1; STA $8001 (switch $8000 to bank 1); NOPs
+    // that only run if the old bank is still used; JMP $8000
+    const byte_t bank0[] = {
+        0xE6, 0x10, 0xA9, 0x01, 0x8D, 0x01, 0x80,
+        0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0x4C, 0x00, 0x80,
+    };
+    // Bank 1 at $8007: INC $11; LDA #0; STA $8000,X with X=1 (back to
+    // bank 0), which continues at bank 0's JMP $8000
+    const byte_t bank1[] = {0xE6, 0x11, 0xA9, 0x00, 0x9D, 0x00, 0x80};
+    memset(&prg_rom[0x0000], 0xEA, 0x4000);
+    memcpy(&prg_rom[0x0000], bank0, sizeof(bank0));
+    memcpy(&prg_rom[0x2007], bank1, sizeof(bank1));
+    bus_write(console->bus, 0x8000, 6);
+    bus_write(console->bus, 0x8001, 0);
+    memset(console->bus->ram, 0, BUS_RAM_SIZE);
+    console->cpu->PC = 0x8000;
+    console->cpu->X = 1;
+#if defined(CPU_JIT)
+    cpu_jit_set_threshold(console->jit, 1);
+#endif
+
+    cpu_run_cycles(console->cpu, 2000);
+    TEST_ASSERT_TRUE(console->bus->ram[0x10] > 1);
+    TEST_ASSERT_EQUAL_HEX8(console->bus->ram[0x10], console->bus->ram[0x11]);
+#if defined(CPU_JIT)
+    TEST_ASSERT_TRUE(cpu_jit_blocks_run(console->jit) > 0);
+#endif
+}
+
+void test_cnrom_switches_chr_and_redecodes_tiles(void) {
+    attach_cart(MAPPER_CNROM, 0x8000);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(console->ppu, 0)[4]);
+
+    bus_write(console->bus, 0x8000, 1);
+    TEST_ASSERT_EQUAL_HEX8(8, ppu_vram_read(console->ppu, 0x0000));
+    TEST_ASSERT_EQUAL_HEX8(15, ppu_vram_read(console->ppu, 0x1FFF));
+    // Bank 8's bytes are $08: bit 3 set in both planes, so column 4 is 3
+    TEST_ASSERT_EQUAL_UINT8(3, ppu_get_pattern_tile(console->ppu, 0)[4]);
+}
+
+void test_mmc1_loads_registers_through_shift_register(void) {
+    attach_cart(MAPPER_MMC1, TEST_PRG_ROM_SIZE);
+    TEST_ASSERT_EQUAL_HEX8(0, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0xC000));
+
+    for (int bit = 0; bit < 4; bit++) {
+        bus_write(console->bus, 0xE000, (2 >> bit) & 1);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0, bus_read(console->bus, 0x8000));
+
+    bus_write(console->bus, 0xE000, 0);
+    TEST_ASSERT_EQUAL_HEX8(4, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0xC000));
+}
+
+void test_mmc1_reset_write_restarts_shift_register(void) {
+    attach_cart(MAPPER_MMC1, TEST_PRG_ROM_SIZE);
+    bus_write(console->bus, 0xE000, 1);
+    bus_write(console->bus, 0xE000, 1);
+    bus_write(console->bus, 0xE000, 0x80);
+    mmc1_write(0xE000, 3);
+    TEST_ASSERT_EQUAL_HEX8(6, bus_read(console->bus, 0x8000));
+}
+
+void test_mmc1_control_sets_mirroring_and_chr_mode(void) {
+    attach_cart(MAPPER_MMC1, TEST_PRG_ROM_SIZE);
+    mmc1_write(0x8000, 0x1E);  // 4KB CHR, fixed last PRG bank, vertical
+    mmc1_write(0xA000, 3);
+    mmc1_write(0xC000, 6);
+    TEST_ASSERT_EQUAL(MIRROR_VERTICAL, console->ppu->mirroring);
+    TEST_ASSERT_EQUAL_HEX8(12, ppu_vram_read(console->ppu, 0x0000));
+    TEST_ASSERT_EQUAL_HEX8(24, ppu_vram_read(console->ppu, 0x1000));
+}
+
+void test_mmc3_switches_prg_and_chr_banks(void) {
+    attach_cart(MAPPER_MMC3, TEST_PRG_ROM_SIZE);
+    bus_write(console->bus, 0x8000, 6);
+    bus_write(console->bus, 0x8001, 5);
+    TEST_ASSERT_EQUAL_HEX8(5, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0xC000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 1, bus_read(console->bus, 0xE000));
+
+    bus_write(console->bus, 0x8000, 0x46);
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(5, bus_read(console->bus, 0xC000));
+
+    bus_write(console->bus, 0x8000, 2);
+    bus_write(console->bus, 0x8001, 9);
+    TEST_ASSERT_EQUAL_HEX8(9, ppu_vram_read(console->ppu, 0x1000));
+    bus_write(console->bus, 0x8000, 0x82);
+    TEST_ASSERT_EQUAL_HEX8(9, ppu_vram_read(console->ppu, 0x0000));
+    TEST_ASSERT_EQUAL_HEX8(0, ppu_vram_read(console->ppu, 0x1000));
+}
+
+// CLI, then spin at $8001; the IRQ handler at $A000 spins too
+static void load_mmc3_irq_program(void) {
+    attach_cart(MAPPER_MMC3, TEST_PRG_ROM_SIZE);
+    const byte_t program[] = {0x58, 0x4C, 0x01, 0x80};
+    const byte_t handler[] = {0x4C, 0x00, 0xA0};
+    memcpy(&prg_rom[0x0000], program, sizeof(program));
+    memcpy(&prg_rom[0x2000], handler, sizeof(handler));
+    prg_rom[TEST_PRG_ROM_SIZE - 2] = 0x00;
+    prg_rom[TEST_PRG_ROM_SIZE - 1] = 0xA0;
+    console->cpu->PC = 0x8000;
+
+    bus_write(console->bus, 0x2001, 0x18);  // Rendering on
+    bus_write(console->bus, 0xC000, 10);
+    bus_write(console->bus, 0xC001, 0);
+    bus_write(console->bus, 0xE001, 0);
+}
+
+void test_mmc3_irq_fires_after_latch_plus_one_scanlines(void) {
+    load_mmc3_irq_program();
+    TEST_ASSERT_EQUAL_INT(261, console->ppu->scanline);
+
+    // The pre-render line reloads the counter; lines 0-9 count it down
+    int steps = 0;
+    while (console->cpu->PC != 0xA000 && steps++ < 10000) {
+        nes_step(console);
+    }
+    TEST_ASSERT_EQUAL_HEX16(0xA000, console->cpu->PC);
+    TEST_ASSERT_EQUAL_INT(9, console->ppu->scanline);
+    TEST_ASSERT_TRUE(mapper_irq_asserted(&cart));
+}
+
+void test_mmc3_irq_interrupts_skipped_idle_loop(void) {
+    load_mmc3_irq_program();
+    byte_t sp = console->cpu->SP;
+
+    nes_run_frame(console);
+    TEST_ASSERT_EQUAL_HEX16(0xA000, console->cpu->PC);
+    TEST_ASSERT_EQUAL_HEX8((byte_t)(sp - 3), console->cpu->SP);
+}
+
+void test_mmc3_acknowledge_clears_irq(void) {
+    load_mmc3_irq_program();
+    while (!mapper_irq_asserted(&cart)) {
+        nes_step(console);
+    }
+    bus_write(console->bus, 0xE000, 0);
+    TEST_ASSERT_FALSE(mapper_irq_asserted(&cart));
+    TEST_ASSERT_EQUAL(SCHEDULER_NEVER, console->bus->scheduler.deadlines[SCHEDULER_EVENT_MAPPER_IRQ]);
+}
+
+void test_load_state_restores_mmc3_banks(void) {
+    attach_cart(MAPPER_MMC3, TEST_PRG_ROM_SIZE);
+    bus_write(console->bus, 0x8000, 6);
+    bus_write(console->bus, 0x8001, 5);
+    bus_write(console->bus, 0x8000, 2);
+    bus_write(console->bus, 0x8001, 9);
+    bus_write(console->bus, 0xA000, 1);
+
+    size_t size = nes_save_state_size(console);
+    byte_t *state = malloc(size);
+    TEST_ASSERT_EQUAL_UINT(size, nes_save_state(console, state, size));
+
+    bus_write(console->bus, 0x8000, 0xC6);
+    bus_write(console->bus, 0x8001, 3);
+    bus_write(console->bus, 0xA000, 0);
+    TEST_ASSERT_EQUAL_HEX8(3, bus_read(console->bus, 0xC000));
+
+    TEST_ASSERT_TRUE(nes_load_state(console, state, size));
+    TEST_ASSERT_EQUAL_HEX8(5, bus_read(console->bus, 0x8000));
+    TEST_ASSERT_EQUAL_HEX8(TEST_PRG_BANKS_8K - 2, bus_read(console->bus, 0xC000));
+    TEST_ASSERT_EQUAL_HEX8(9, ppu_vram_read(console->ppu, 0x1000));
+    TEST_ASSERT_EQUAL(MIRROR_HORIZONTAL, console->ppu->mirroring);
+    free(state);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_unsupported_mapper_is_rejected);
+    RUN_TEST(test_nrom_mirrors_16k_prg);
+    RUN_TEST(test_uxrom_switches_8000_and_fixes_last_bank);
+    RUN_TEST(test_uxrom_bank_switch_drops_decoded_code);
+    RUN_TEST(test_mmc3_code_switching_its_own_bank_runs_the_new_bank);
+    RUN_TEST(test_cnrom_switches_chr_and_redecodes_tiles);
+    RUN_TEST(test_mmc1_loads_registers_through_shift_register);
+    RUN_TEST(test_mmc1_reset_write_restarts_shift_register);
+    RUN_TEST(test_mmc1_control_sets_mirroring_and_chr_mode);
+    RUN_TEST(test_mmc3_switches_prg_and_chr_banks);
+    RUN_TEST(test_mmc3_irq_fires_after_latch_plus_one_scanlines);
+    RUN_TEST(test_mmc3_irq_interrupts_skipped_idle_loop);
+    RUN_TEST(test_mmc3_acknowledge_clears_irq);
+    RUN_TEST(test_load_state_restores_mmc3_banks);
+
+    return UNITY_END();
+}
@@ -1,32 +1,85 @@
 #include "nes.h"
 #include "gamecart.h"
+#include "mapper.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
 #include <assert.h>
+#include <stdlib.h>
 
-static nes_console_s s_nes;
+typedef struct {
+    nes_console_s console;
+    cpu_s cpu;
+    ppu_s ppu;
+    bus_s bus;
+    cpu_block_cache_s block_cache;
+} nes_console_storage_s;
 
-nes_console_s* nes_get_instance(void)
+nes_console_s* nes_console_create(void)
 {
-    return &s_nes;
+    nes_console_storage_s *storage = malloc(sizeof(*storage));
+    if (!storage) {
+        return NULL;
+    }
+
+    nes_console_s *nes = &storage->console;
+    nes->cpu = &storage->cpu;
+    nes->ppu = &storage->ppu;
+    nes->bus = &storage->bus;
+    nes->block_cache = &storage->block_cache;
+    nes->jit = NULL;
+#if defined(CPU_JIT)
+    nes->jit = cpu_jit_create(CPU_JIT_DEFAULT_THRESHOLD);
+#endif
+    nes_init(nes);
+    return nes;
+}
+
+void nes_console_destroy(nes_console_s *nes)
+{
+    if (!nes) {
+        return;
+    }
+#if defined(CPU_JIT)
+    cpu_jit_destroy(nes->jit);
+#endif
+    nes_console_storage_s *storage = (nes_console_storage_s *)nes;
+    free(storage);
+}
+
+// Arms the FRAME event for the first CPU cycle at which the PPU reaches
+// vblank
+static void schedule_frame(nes_console_s *nes)
+{
+    bus_sync_ppu(nes->bus);
+    size_t cycles = (ppu_dots_until_vblank(nes->ppu) + 2) / 3;
+    scheduler_set(&nes->bus->scheduler, SCHEDULER_EVENT_FRAME, nes->cpu->cycles + cycles);
 }
 
 void nes_init(nes_console_s *nes)
 {
-    assert(nes != NULL);
+    assert(nes != NULL && nes->cpu != NULL && nes->ppu != NULL && nes->bus != NULL);
 
-    cpu_s *cpu = cpu_get_instance();
-    ppu_s *ppu = ppu_get_instance();
-    bus_s *bus = bus_get_instance();
+    cpu_s *cpu = nes->cpu;
+    ppu_s *ppu = nes->ppu;
+    bus_s *bus = nes->bus;
 
     bus_init(bus);
     cpu_init(cpu);
     ppu_init(ppu);
 
     bus->ppu = ppu;
+    bus->cpu = cpu;
+    bus->ppu_sync_cycle = cpu->cycles;
     cpu->bus = bus;
-
-    nes->cpu = cpu;
-    nes->ppu = ppu;
-    nes->bus = bus;
+    cpu->block_cache = nes->block_cache;
+    cpu->jit = nes->jit;
+    if (cpu->block_cache) {
+        cpu_block_cache_flush(cpu->block_cache);
+        cpu->block_cache->hits = 0;
+        cpu->block_cache->misses = 0;
+    }
+    schedule_frame(nes);
 }
 
 void nes_attach_cart(nes_console_s *nes, gamecart_s *cart)
@@ -35,32 +88,138 @@ void nes_attach_cart(nes_console_s *nes, gamecart_s *cart)
     bus_attach_cart(nes->bus, cart);
 }
 
+static int service_nmi(nes_console_s *nes)
+{
+    if (!nes->ppu->nmi_pending) {
+        return STEP_RESULT_OK;
+    }
+    nes->ppu->nmi_pending = false;
+    nmi(nes->cpu);
+    return STEP_RESULT_NMI_FIRED;
+}
+
+// Runs every event whose deadline the CPU has reached, in deadline order
+static int run_due_events(nes_console_s *nes)
+{
+    cpu_s *cpu = nes->cpu;
+    bus_s *bus = nes->bus;
+    int result = STEP_RESULT_OK;
+
+    scheduler_event_e event;
+    while ((event = scheduler_pop_due(&bus->scheduler, cpu->cycles)) != SCHEDULER_EVENT_COUNT) {
+        switch (event) {
+        case SCHEDULER_EVENT_FRAME:
+            bus_sync_ppu(bus);
+            result |= service_nmi(nes);
+            if (ppu_frame_complete(nes->ppu)) {
+                result |= STEP_RESULT_FRAME_COMPLETE;
+            }
+            schedule_frame(nes);
+            break;
+        case SCHEDULER_EVENT_NMI:
+            bus_sync_ppu(bus);
+            result |= service_nmi(nes);
+            break;
+        case SCHEDULER_EVENT_OAM_DMA:
+            // The CPU is halted while the DMA unit copies the page
+            cpu->cycles += bus->oam_dma_cycles;
+            bus->oam_dma_active = false;
+            break;
+        case SCHEDULER_EVENT_MAPPER_IRQ:
+            // The scanline counter is clocked by the PPU: catch it up, then
+            // deliver the IRQ or re-arm for the counter's next zero. The line
+            // stays asserted until the handler acknowledges it.
+            bus_sync_ppu(bus);
+            if (!mapper_irq_asserted(bus->cart)) {
+                mapper_schedule_irq(bus);
+                break;
+            }
+            if (!get_flag(cpu, STATUS_FLAG_I)) {
+                irq(cpu);
+            }
+            scheduler_set(&bus->scheduler, event, cpu->cycles + 1);
+            break;
+        case SCHEDULER_EVENT_APU_IRQ:
+            // IRQ is level-triggered: while masked, keep it asserted and
+            // retry after the next instruction
+            if (get_flag(cpu, STATUS_FLAG_I)) {
+                scheduler_set(&bus->scheduler, event, cpu->cycles + 1);
+            } else {
+                irq(cpu);
+            }
+            break;
+        case SCHEDULER_EVENT_COUNT:
+            break;
+        }
+    }
+    return result;
+}
+
 int nes_step(nes_console_s *nes)
 {
     assert(nes != NULL);
 
+    run_instruction(nes->cpu);
+    int result = run_due_events(nes);
+    bus_sync_ppu(nes->bus);
+    return result;
+}
+
+int nes_run_frame(nes_console_s *nes)
+{
+    assert(nes != NULL);
+
     cpu_s *cpu = nes->cpu;
-    ppu_s *ppu = nes->ppu;
+    bus_s *bus = nes->bus;
+
+    // Re-arm from where the PPU is now, in case the console was reset or
+    // its clocks were moved since the last frame
+    schedule_frame(nes);
     int result = STEP_RESULT_OK;
 
-    size_t cycles_before = cpu->cycles;
-    run_instruction(cpu);
-    size_t cpu_cycles = cpu->cycles - cycles_before;
-    size_t ppu_cycles = cpu_cycles * 3;
+    for (;;) {
+        result |= run_due_events(nes);
+        if (result & STEP_RESULT_FRAME_COMPLETE) {
+            return result;
+        }
 
-    for (size_t i = 0; i < ppu_cycles; i++) {
-        ppu_tick(ppu);
+        // Run the CPU up to the next event; handlers that raise one sooner
+        // cut the timeslice short
+        cpu_run_result_e run = cpu_run_cycles(cpu, bus->scheduler.next - cpu->cycles);
+        if (run == CPU_RUN_RESULT_ILLEGAL_OPCODE) {
+            bus_sync_ppu(bus);
+            return result | STEP_RESULT_ILLEGAL_OPCODE;
+        }
+        if (run == CPU_RUN_RESULT_BREAKPOINT) {
+            bus_sync_ppu(bus);
+            return result | STEP_RESULT_BREAKPOINT;
+        }
     }
+}
 
-    if (ppu->nmi_pending) {
-        ppu->nmi_pending = false;
-        nmi(cpu);
-        result |= STEP_RESULT_NMI_FIRED;
+// https://docs.libretro.com/guides/runahead/
+int nes_run_frame_ahead(nes_console_s *nes, unsigned frames_ahead, void *state, size_t size)
+{
+    assert(nes != NULL);
+    if (frames_ahead == 0) {
+        return nes_run_frame(nes);
     }
 
-    if (ppu_frame_complete(ppu)) {
-        result |= STEP_RESULT_FRAME_COMPLETE;
+    ppu_s *ppu = nes->ppu;
+    ppu->skip_output = true;
+    int result = nes_run_frame(nes);
+    if (result & (STEP_RESULT_ILLEGAL_OPCODE | STEP_RESULT_BREAKPOINT) || !nes_save_state(nes, state, size)) {
+        ppu->skip_output = false;
+        return result;
     }
 
+    for (unsigned frame = 1; frame <= frames_ahead; frame++) {
+        ppu->skip_output = frame < frames_ahead;
+        if (nes_run_frame(nes) & (STEP_RESULT_ILLEGAL_OPCODE | STEP_RESULT_BREAKPOINT)) {
+            break;
+        }
+    }
+    ppu->skip_output = false;
+    nes_load_state(nes, state, size);
     return result;
 }
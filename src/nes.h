@@ -12,17 +12,42 @@ typedef enum {
     STEP_RESULT_FRAME_COMPLETE = (1 << 0),
     STEP_RESULT_NMI_FIRED      = (1 << 1),
     STEP_RESULT_ILLEGAL_OPCODE = (1 << 2),
+    STEP_RESULT_BREAKPOINT     = (1 << 3),
 } step_result_e;
 
 typedef struct {
     cpu_s *cpu;
     ppu_s *ppu;
     bus_s *bus;
+    // Optional; see cpu_block_cache_s
+    cpu_block_cache_s *block_cache;
+    // Optional; see cpu_jit.h
+    cpu_jit_s *jit;
 } nes_console_s;
 
-nes_console_s* nes_get_instance(void);
+nes_console_s* nes_console_create(void);
+void nes_console_destroy(nes_console_s *nes);
 void nes_init(nes_console_s *nes);
 void nes_attach_cart(nes_console_s *nes, gamecart_s *cart);
 int nes_step(nes_console_s *nes);
+// Runs until the PPU finishes a frame. Returns early, with
+// STEP_RESULT_ILLEGAL_OPCODE or STEP_RESULT_BREAKPOINT, when the CPU stops.
+int nes_run_frame(nes_console_s *nes);
+
+// Save states: a versioned binary snapshot of the CPU, RAM, PPU, PRG/CHR RAM
+// and mapper registers, without the framebuffer or anything derived from the
+// cart. nes_save_state returns the bytes written, or 0 if size is less than
+// nes_save_state_size. nes_load_state only accepts a state saved by the same
+// build with the same cart, and leaves the console untouched otherwise.
+size_t nes_save_state_size(const nes_console_s *nes);
+size_t nes_save_state(const nes_console_s *nes, void *buf, size_t size);
+bool nes_load_state(nes_console_s *nes, const void *buf, size_t size);
+
+// Run-ahead: runs one frame, then frames_ahead more from a save state that
+// is loaded again afterwards, so the console ends up one frame on while the
+// framebuffer shows the frame frames_ahead past it. Only the last frame
+// ahead is drawn. state must hold nes_save_state_size bytes. Returns the
+// result of the first frame; with frames_ahead 0 this is nes_run_frame.
+int nes_run_frame_ahead(nes_console_s *nes, unsigned frames_ahead, void *state, size_t size);
 
 #endif
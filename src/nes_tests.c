@@ -0,0 +1,798 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "unity.h"
+#include "nes.h"
+#include "gamecart.h"
+#if defined(CPU_JIT)
+#include "cpu_jit.h"
+#endif
+
+#define TEST_PRG_ROM_SIZE (32 * 1024)
+#define TEST_RESET_VECTOR 0x8000
+
+
+static nes_console_s *console_a = NULL;
+static nes_console_s *console_b = NULL;
+static gamecart_s cart_a;
+static gamecart_s cart_b;
+static byte_t prg_rom_a[TEST_PRG_ROM_SIZE];
+static byte_t prg_rom_b[TEST_PRG_ROM_SIZE];
+
+
+static void load_test_program(gamecart_s *cart, byte_t *prg_rom, const byte_t *program, size_t len) {
+    memset(prg_rom, 0xEA, TEST_PRG_ROM_SIZE);
+    memcpy(prg_rom, program, len);
+    prg_rom[0x7FFC] = TEST_RESET_VECTOR & 0xFF;
+    prg_rom[0x7FFD] = TEST_RESET_VECTOR >> 8;
+
+    memset(cart, 0, sizeof(*cart));
+    cart->rom.prg_rom = prg_rom;
+    cart->rom.prg_rom_bytes = TEST_PRG_ROM_SIZE;
+    cart->mirroring = MIRROR_HORIZONTAL;
+}
+
+void setUp(void) {
+    console_a = nes_console_create();
+    console_b = nes_console_create();
+}
+
+void tearDown(void) {
+    nes_console_destroy(console_a);
+    nes_console_destroy(console_b);
+    console_a = NULL;
+    console_b = NULL;
+}
+
+
+void test_console_create_wires_components(void) {
+    TEST_ASSERT_TRUE(console_a != NULL);
+    TEST_ASSERT_TRUE(console_a->cpu->bus == console_a->bus);
+    TEST_ASSERT_TRUE(console_a->bus->ppu == console_a->ppu);
+}
+
+void test_consoles_own_separate_components(void) {
+    TEST_ASSERT_TRUE(console_a->cpu != console_b->cpu);
+    TEST_ASSERT_TRUE(console_a->ppu != console_b->ppu);
+    TEST_ASSERT_TRUE(console_a->bus != console_b->bus);
+}
+
+void test_consoles_have_independent_ram(void) {
+    bus_write(console_a->bus, 0x0010, 0xAA);
+    bus_write(console_b->bus, 0x0010, 0x55);
+
+    TEST_ASSERT_EQUAL_HEX8(0xAA, bus_read(console_a->bus, 0x0010));
+    TEST_ASSERT_EQUAL_HEX8(0x55, bus_read(console_b->bus, 0x0010));
+}
+
+void test_consoles_have_independent_ppu_state(void) {
+    bus_write(console_a->bus, 0x2000, PPUCTRL_NMI_ENABLE);
+
+    TEST_ASSERT_EQUAL_HEX8(PPUCTRL_NMI_ENABLE, console_a->ppu->ctrl_register);
+    TEST_ASSERT_EQUAL_HEX8(0x00, console_b->ppu->ctrl_register);
+}
+
+void test_consoles_execute_independently(void) {
+    const byte_t program_a[] = {0xA9, 0x11, 0x85, 0x10};
+    const byte_t program_b[] = {0xA9, 0x22, 0x85, 0x10};
+    load_test_program(&cart_a, prg_rom_a, program_a, sizeof(program_a));
+    load_test_program(&cart_b, prg_rom_b, program_b, sizeof(program_b));
+    nes_attach_cart(console_a, &cart_a);
+    nes_attach_cart(console_b, &cart_b);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+    console_b->cpu->PC = TEST_RESET_VECTOR;
+
+    nes_step(console_a);
+    nes_step(console_b);
+    nes_step(console_a);
+    nes_step(console_b);
+
+    TEST_ASSERT_EQUAL_HEX8(0x11, bus_read(console_a->bus, 0x0010));
+    TEST_ASSERT_EQUAL_HEX8(0x22, bus_read(console_b->bus, 0x0010));
+    TEST_ASSERT_EQUAL_HEX16(TEST_RESET_VECTOR + 4, console_a->cpu->PC);
+    TEST_ASSERT_EQUAL_HEX16(TEST_RESET_VECTOR + 4, console_b->cpu->PC);
+}
+
+void test_bus_ram_is_mirrored(void) {
+    bus_write(console_a->bus, 0x0812, 0x5A);
+
+    TEST_ASSERT_EQUAL_HEX8(0x5A, bus_read(console_a->bus, 0x0012));
+    TEST_ASSERT_EQUAL_HEX8(0x5A, bus_read(console_a->bus, 0x1812));
+}
+
+void test_bus_maps_16k_prg_rom_twice(void) {
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    cart_a.rom.prg_rom_bytes = 16 * 1024;
+    prg_rom_a[0x0123] = 0x77;
+    nes_attach_cart(console_a, &cart_a);
+
+    TEST_ASSERT_EQUAL_HEX8(0x77, bus_read(console_a->bus, 0x8123));
+    TEST_ASSERT_EQUAL_HEX8(0x77, bus_read(console_a->bus, 0xC123));
+}
+
+void test_bus_prg_rom_is_read_only(void) {
+    const byte_t program[] = {0xA9};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+
+    bus_write(console_a->bus, 0x8000, 0x00);
+
+    TEST_ASSERT_EQUAL_HEX8(0xA9, bus_read(console_a->bus, 0x8000));
+}
+
+void test_bus_prg_ram_read_write(void) {
+    byte_t prg_ram[0x2000] = {0};
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    cart_a.prg_ram = prg_ram;
+    cart_a.prg_ram_size = sizeof(prg_ram);
+    nes_attach_cart(console_a, &cart_a);
+
+    bus_write(console_a->bus, 0x6ABC, 0x42);
+
+    TEST_ASSERT_EQUAL_HEX8(0x42, prg_ram[0x0ABC]);
+    TEST_ASSERT_EQUAL_HEX8(0x42, bus_read(console_a->bus, 0x6ABC));
+}
+
+void test_bus_unmapped_reads_return_zero(void) {
+    TEST_ASSERT_EQUAL_HEX8(0x00, bus_read(console_a->bus, 0x4016));
+    TEST_ASSERT_EQUAL_HEX8(0x00, bus_read(console_a->bus, 0x5000));
+    TEST_ASSERT_EQUAL_HEX8(0x00, bus_read(console_a->bus, 0x8000));
+}
+
+void test_cpu_run_cycles_spends_budget(void) {
+    const byte_t program[] = {0x4C, 0x00, 0x80};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+    size_t start = console_a->cpu->cycles;
+
+    cpu_run_result_e result = cpu_run_cycles(console_a->cpu, 100);
+
+    TEST_ASSERT_EQUAL(CPU_RUN_RESULT_BUDGET_SPENT, result);
+    TEST_ASSERT_TRUE(console_a->cpu->cycles - start >= 100);
+    TEST_ASSERT_TRUE(console_a->cpu->cycles - start < 103);
+}
+
+void test_cpu_run_cycles_stops_before_illegal_opcode(void) {
+    const byte_t program[] = {0xEA, 0xEA, 0x02};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    cpu_run_result_e result = cpu_run_cycles(console_a->cpu, 1000);
+
+    TEST_ASSERT_EQUAL(CPU_RUN_RESULT_ILLEGAL_OPCODE, result);
+    TEST_ASSERT_EQUAL_HEX16(TEST_RESET_VECTOR + 2, console_a->cpu->PC);
+}
+
+void test_cpu_run_cycles_stops_on_breakpoint(void) {
+    static byte_t breakpoints[CPU_BREAKPOINT_BITMAP_SIZE];
+    const byte_t program[] = {0xEA, 0xEA, 0xEA, 0x4C, 0x00, 0x80};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    memset(breakpoints, 0, sizeof(breakpoints));
+    breakpoints[(TEST_RESET_VECTOR + 2) >> 3] |= 1 << ((TEST_RESET_VECTOR + 2) & 7);
+    console_a->cpu->breakpoints = breakpoints;
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    TEST_ASSERT_EQUAL(CPU_RUN_RESULT_BREAKPOINT, cpu_run_cycles(console_a->cpu, 1000));
+    TEST_ASSERT_EQUAL_HEX16(TEST_RESET_VECTOR + 2, console_a->cpu->PC);
+
+    // Resuming from the breakpoint runs on until it comes round again
+    TEST_ASSERT_EQUAL(CPU_RUN_RESULT_BREAKPOINT, cpu_run_cycles(console_a->cpu, 1000));
+    TEST_ASSERT_EQUAL_HEX16(TEST_RESET_VECTOR + 2, console_a->cpu->PC);
+}
+
+void test_nes_run_frame_runs_one_frame(void) {
+    const byte_t program[] = {0x4C, 0x00, 0x80};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    TEST_ASSERT_TRUE(nes_run_frame(console_a) & STEP_RESULT_FRAME_COMPLETE);
+    size_t start = console_a->cpu->cycles;
+    TEST_ASSERT_TRUE(nes_run_frame(console_a) & STEP_RESULT_FRAME_COMPLETE);
+    size_t frame_cycles = console_a->cpu->cycles - start;
+
+    // 341 * 262 / 3 = 29780.67 CPU cycles per frame
+    TEST_ASSERT_TRUE(frame_cycles >= 29778 && frame_cycles <= 29784);
+}
+
+void test_nes_run_frame_fires_nmi(void) {
+    const byte_t program[] = {0x4C, 0x00, 0x80};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    prg_rom_a[0x7FFA] = 0x00;
+    prg_rom_a[0x7FFB] = 0x90;
+    prg_rom_a[0x1000] = 0x4C;
+    prg_rom_a[0x1001] = 0x00;
+    prg_rom_a[0x1002] = 0x90;
+    nes_attach_cart(console_a, &cart_a);
+    bus_write(console_a->bus, 0x2000, PPUCTRL_NMI_ENABLE);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    int result = nes_run_frame(console_a);
+
+    TEST_ASSERT_TRUE(result & STEP_RESULT_NMI_FIRED);
+    TEST_ASSERT_TRUE(result & STEP_RESULT_FRAME_COMPLETE);
+    TEST_ASSERT_EQUAL_HEX16(0x9000, console_a->cpu->PC);
+}
+
+void test_ppu_catches_up_on_register_access(void) {
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+    int scanline = console_a->ppu->scanline;
+
+    // NOPs never touch the PPU, so it stays where it was
+    cpu_run_cycles(console_a->cpu, 1000);
+    TEST_ASSERT_EQUAL_INT(scanline, console_a->ppu->scanline);
+
+    bus_read(console_a->bus, 0x2002);
+    size_t dots = (console_a->cpu->cycles - 7) * 3;
+    TEST_ASSERT_EQUAL_INT((261 * 341 + dots) / 341 % 262, console_a->ppu->scanline);
+    TEST_ASSERT_EQUAL_INT((261 * 341 + dots) % 341, console_a->ppu->cycle);
+}
+
+void test_nes_step_keeps_ppu_in_sync(void) {
+    const byte_t program[] = {0xEA, 0xEA, 0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    nes_step(console_a);
+    nes_step(console_a);
+
+    // Two NOPs: 4 CPU cycles, 12 dots into the pre-render line
+    TEST_ASSERT_EQUAL_INT(261, console_a->ppu->scanline);
+    TEST_ASSERT_EQUAL_INT(12, console_a->ppu->cycle);
+}
+
+
+void test_scheduler_pops_events_in_deadline_order(void) {
+    scheduler_s scheduler;
+    scheduler_init(&scheduler);
+    scheduler_set(&scheduler, SCHEDULER_EVENT_MAPPER_IRQ, 300);
+    scheduler_set(&scheduler, SCHEDULER_EVENT_OAM_DMA, 100);
+    scheduler_set(&scheduler, SCHEDULER_EVENT_NMI, 200);
+    scheduler_cancel(&scheduler, SCHEDULER_EVENT_NMI);
+
+    TEST_ASSERT_TRUE(scheduler.next == 100);
+    TEST_ASSERT_EQUAL_INT(SCHEDULER_EVENT_COUNT, scheduler_pop_due(&scheduler, 99));
+    TEST_ASSERT_EQUAL_INT(SCHEDULER_EVENT_OAM_DMA, scheduler_pop_due(&scheduler, 1000));
+    TEST_ASSERT_EQUAL_INT(SCHEDULER_EVENT_MAPPER_IRQ, scheduler_pop_due(&scheduler, 1000));
+    TEST_ASSERT_EQUAL_INT(SCHEDULER_EVENT_COUNT, scheduler_pop_due(&scheduler, 1000));
+    TEST_ASSERT_TRUE(scheduler.next == SCHEDULER_NEVER);
+}
+
+void test_oam_dma_stalls_cpu(void) {
+    // LDA #$02; STA $4014
+    const byte_t program[] = {0xA9, 0x02, 0x8D, 0x14, 0x40};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    nes_step(console_a);
+    size_t start = console_a->cpu->cycles;
+    nes_step(console_a);
+
+    // 4 cycles for the store, then 513 (or 514 on an odd cycle) halted
+    size_t stall = console_a->cpu->cycles - start - 4;
+    TEST_ASSERT_TRUE(stall == 513 || stall == 514);
+    TEST_ASSERT_FALSE(console_a->bus->oam_dma_active);
+    TEST_ASSERT_EQUAL_HEX16(0x8005, console_a->cpu->PC);
+}
+
+void test_nmi_enabled_during_vblank_fires_after_write(void) {
+    // JMP $8000 until vblank, then LDA #$80; STA $2000 at $8010
+    const byte_t program[] = {0x4C, 0x00, 0x80};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    prg_rom_a[0x0010] = 0xA9;
+    prg_rom_a[0x0011] = 0x80;
+    prg_rom_a[0x0012] = 0x8D;
+    prg_rom_a[0x0013] = 0x00;
+    prg_rom_a[0x0014] = 0x20;
+    prg_rom_a[0x7FFA] = 0x00;
+    prg_rom_a[0x7FFB] = 0x90;
+    nes_attach_cart(console_a, &cart_a);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    TEST_ASSERT_TRUE(nes_run_frame(console_a) & STEP_RESULT_FRAME_COMPLETE);
+    console_a->cpu->PC = 0x8010;
+
+    TEST_ASSERT_FALSE(nes_step(console_a) & STEP_RESULT_NMI_FIRED);
+    TEST_ASSERT_TRUE(nes_step(console_a) & STEP_RESULT_NMI_FIRED);
+    TEST_ASSERT_EQUAL_HEX16(0x9000, console_a->cpu->PC);
+}
+
+void test_block_cache_drops_code_rewritten_in_ram(void) {
+    // JSR $0300; LDA #$20; STA $0B03 (mirror of $0303); JSR $0300
+    const byte_t program[] = {0x20, 0x00, 0x03, 0xA9, 0x20, 0x8D, 0x03, 0x0B, 0x20, 0x00, 0x03};
+    // $0300: LDA #$11; STA $10; RTS
+    const byte_t routine[] = {0xA9, 0x11, 0x85, 0x10, 0x60};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    memcpy(&console_a->bus->ram[0x0300], routine, sizeof(routine));
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+
+    for (int i = 0; i < 4; i++) {
+        nes_step(console_a);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0x11, console_a->bus->ram[0x10]);
+
+    for (int i = 0; i < 6; i++) {
+        nes_step(console_a);
+    }
+    // The store's zero page address is decoded ahead of time
+    TEST_ASSERT_EQUAL_HEX8(0x11, console_a->bus->ram[0x20]);
+    TEST_ASSERT_EQUAL_HEX16(0x800B, console_a->cpu->PC);
+    TEST_ASSERT_TRUE(console_a->block_cache->hits > 0);
+}
+
+void test_block_cache_does_not_read_io_while_decoding(void) {
+    // Executing from $2002 reads PPUSTATUS once, as the opcode
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    load_test_program(&cart_b, prg_rom_b, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    nes_attach_cart(console_b, &cart_b);
+    console_b->cpu->block_cache = NULL;
+    ppu_set_status_flag(console_a->ppu, PPUSTATUS_VBLANK, true);
+    ppu_set_status_flag(console_b->ppu, PPUSTATUS_VBLANK, true);
+    console_a->cpu->PC = 0x2002;
+    console_b->cpu->PC = 0x2002;
+
+    nes_step(console_a);
+    nes_step(console_b);
+
+    TEST_ASSERT_EQUAL_HEX8(console_b->cpu->current_opcode, console_a->cpu->current_opcode);
+    TEST_ASSERT_EQUAL_HEX16(console_b->cpu->PC, console_a->cpu->PC);
+    TEST_ASSERT_TRUE(console_a->cpu->cycles == console_b->cpu->cycles);
+}
+
+#if defined(CPU_JIT)
+void test_jit_runs_in_lockstep_with_interpreter(void) {
+    const byte_t program[] = {
+        0xA2, 0x00,             // $8000: LDX #$00
+        0xA0, 0x10,             //        LDY #$10
+        0x8A,                   // $8004: TXA
+        0x18,                   //        CLC
+        0x69, 0x03,             //        ADC #$03
+        0x95, 0x20,             //        STA $20,X
+        0x9D, 0xF8, 0x03,       //        STA $03F8,X
+        0x20, 0x20, 0x80,       //        JSR $8020
+        0xE8,                   //        INX
+        0x88,                   //        DEY
+        0xD0, 0xF0,             //        BNE $8004
+        0x4C, 0x00, 0x80,       //        JMP $8000
+    };
+    // $8020: INC $40; LDA $03F8,Y; RTS
+    const byte_t routine[] = {0xE6, 0x40, 0xB9, 0xF8, 0x03, 0x60};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    load_test_program(&cart_b, prg_rom_b, program, sizeof(program));
+    memcpy(&prg_rom_a[0x20], routine, sizeof(routine));
+    memcpy(&prg_rom_b[0x20], routine, sizeof(routine));
+
+    nes_attach_cart(console_a, &cart_a);
+    nes_attach_cart(console_b, &cart_b);
+    memset(console_a->bus->ram, 0, BUS_RAM_SIZE);
+    memset(console_b->bus->ram, 0, BUS_RAM_SIZE);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+    console_b->cpu->PC = TEST_RESET_VECTOR;
+    cpu_jit_set_threshold(console_a->jit, 1);
+    console_b->cpu->jit = NULL;
+
+    // Uneven budgets end blocks part way through as well as at their end;
+    // the indexed accesses cross a page once X and Y reach 8
+    for (int i = 0; i < 500; i++) {
+        size_t budget = 1 + i % 13;
+        cpu_run_cycles(console_a->cpu, budget);
+        cpu_run_cycles(console_b->cpu, budget);
+
+        TEST_ASSERT_EQUAL_HEX16(console_b->cpu->PC, console_a->cpu->PC);
+        TEST_ASSERT_EQUAL_HEX8(console_b->cpu->A, console_a->cpu->A);
+        TEST_ASSERT_EQUAL_HEX8(console_b->cpu->X, console_a->cpu->X);
+        TEST_ASSERT_EQUAL_HEX8(console_b->cpu->Y, console_a->cpu->Y);
+        TEST_ASSERT_EQUAL_HEX8(console_b->cpu->SP, console_a->cpu->SP);
+        TEST_ASSERT_EQUAL_HEX8(cpu_get_status(console_b->cpu), cpu_get_status(console_a->cpu));
+        TEST_ASSERT_TRUE(console_a->cpu->cycles == console_b->cpu->cycles);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(console_b->bus->ram, console_a->bus->ram, BUS_RAM_SIZE);
+    TEST_ASSERT_TRUE(cpu_jit_blocks_run(console_a->jit) > 0);
+}
+#endif
+
+static void run_idle_loop_program_on_both(const byte_t *program, size_t len, int frames) {
+    load_test_program(&cart_a, prg_rom_a, program, len);
+    load_test_program(&cart_b, prg_rom_b, program, len);
+    nes_attach_cart(console_a, &cart_a);
+    nes_attach_cart(console_b, &cart_b);
+    memset(console_a->bus->ram, 0, BUS_RAM_SIZE);
+    memset(console_b->bus->ram, 0, BUS_RAM_SIZE);
+    console_a->cpu->PC = TEST_RESET_VECTOR;
+    console_b->cpu->PC = TEST_RESET_VECTOR;
+    console_b->cpu->idle_loop_skip = false;
+
+    for (int i = 0; i < frames; i++) {
+        nes_run_frame(console_a);
+        nes_run_frame(console_b);
+    }
+}
+
+void test_idle_loop_skip_matches_execution_of_vblank_poll(void) {
+    // loop: BIT $2002 / BPL loop / INC $10 / JMP loop
+    const byte_t program[] = {0x2C, 0x02, 0x20, 0x10, 0xFB, 0xE6, 0x10, 0x4C, 0x00, 0x80};
+    run_idle_loop_program_on_both(program, sizeof(program), 3);
+
+    TEST_ASSERT_TRUE(console_a->cpu->idle_cycles_skipped > 0);
+    TEST_ASSERT_EQUAL_UINT(0, console_b->cpu->idle_cycles_skipped);
+    TEST_ASSERT_EQUAL_UINT(console_b->cpu->cycles, console_a->cpu->cycles);
+    TEST_ASSERT_EQUAL_HEX16(console_b->cpu->PC, console_a->cpu->PC);
+    TEST_ASSERT_EQUAL_HEX8(console_b->bus->ram[0x10], console_a->bus->ram[0x10]);
+    // Each vblank is seen early in the following frame
+    TEST_ASSERT_EQUAL_HEX8(2, console_a->bus->ram[0x10]);
+}
+
+void test_idle_loop_skip_leaves_loops_that_write_alone(void) {
+    // loop: INC $10 / JMP loop
+    const byte_t program[] = {0xE6, 0x10, 0x4C, 0x00, 0x80};
+    run_idle_loop_program_on_both(program, sizeof(program), 1);
+
+    TEST_ASSERT_EQUAL_UINT(0, console_a->cpu->idle_cycles_skipped);
+    TEST_ASSERT_EQUAL_HEX8(console_b->bus->ram[0x10], console_a->bus->ram[0x10]);
+}
+
+void test_idle_loop_skip_sees_nmi_handler_writes(void) {
+    // nmi: INC $10 / NOP * pad / RTI
+    // start: LDA #$80 / STA $2000
+    // loop: LDA $10 / BEQ loop / INC $11 / LDA #0 / STA $10 / JMP loop
+    // The handler sits below the loop so RTI is not itself a backward jump.
+    // Padding it moves where in the loop later NMIs land, so some of them
+    // interrupt between the load and the branch.
+    for (int pad = 0; pad < 8; pad++) {
+        byte_t program[32];
+        size_t len = 0;
+        program[len++] = 0xE6;
+        program[len++] = 0x10;
+        for (int i = 0; i < pad; i++) {
+            program[len++] = 0xEA;
+        }
+        program[len++] = 0x40;
+        word_t start = TEST_RESET_VECTOR + len;
+        word_t loop = start + 5;
+        const byte_t main_code[] = {
+            0xA9, 0x80, 0x8D, 0x00, 0x20,
+            0xA5, 0x10, 0xF0, 0xFC, 0xE6, 0x11, 0xA9, 0x00, 0x85, 0x10, 0x4C, loop & 0xFF, loop >> 8,
+        };
+        memcpy(&program[len], main_code, sizeof(main_code));
+        len += sizeof(main_code);
+
+        tearDown();
+        setUp();
+        load_test_program(&cart_a, prg_rom_a, program, len);
+        load_test_program(&cart_b, prg_rom_b, program, len);
+        prg_rom_a[0x7FFA] = prg_rom_b[0x7FFA] = TEST_RESET_VECTOR & 0xFF;
+        prg_rom_a[0x7FFB] = prg_rom_b[0x7FFB] = TEST_RESET_VECTOR >> 8;
+        nes_attach_cart(console_a, &cart_a);
+        nes_attach_cart(console_b, &cart_b);
+        memset(console_a->bus->ram, 0, BUS_RAM_SIZE);
+        memset(console_b->bus->ram, 0, BUS_RAM_SIZE);
+        console_a->cpu->PC = start;
+        console_b->cpu->PC = start;
+        console_b->cpu->idle_loop_skip = false;
+
+        for (int frame = 0; frame < 12; frame++) {
+            nes_run_frame(console_a);
+            nes_run_frame(console_b);
+            TEST_ASSERT_EQUAL_HEX8(console_b->bus->ram[0x11], console_a->bus->ram[0x11]);
+            TEST_ASSERT_EQUAL_UINT(console_b->cpu->cycles, console_a->cpu->cycles);
+            TEST_ASSERT_EQUAL_HEX16(console_b->cpu->PC, console_a->cpu->PC);
+        }
+        TEST_ASSERT_TRUE(console_a->cpu->idle_cycles_skipped > 0);
+    }
+}
+
+// Writes an NROM image with prg_banks 16KB PRG banks, the first starting
+// with marker, to a new file replacing path
+static void write_test_rom(const char *path, byte_t prg_banks, byte_t marker) {
+    char tmp_path[] = "/tmp/nes_tests_rom_XXXXXX";
+    int fd = mkstemp(tmp_path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    FILE *file = fdopen(fd, "wb");
+    const byte_t header[16] = {'N', 'E', 'S', 0x1A, prg_banks, 1};
+    fwrite(header, 1, sizeof(header), file);
+    for (size_t i = 0; i < prg_banks * 0x4000u + 0x2000u; i++) {
+        fputc(i == 0 ? marker : 0xEA, file);
+    }
+    fclose(file);
+    TEST_ASSERT_EQUAL_INT(0, rename(tmp_path, path));
+}
+
+void test_carts_loaded_from_one_file_share_rom_image(void) {
+    char path[] = "/tmp/nes_tests_rom.nes";
+    write_test_rom(path, 1, 0x42);
+    size_t images = ines_cached_images();
+
+    gamecart_s first, second;
+    TEST_ASSERT_TRUE(gamecart_load(path, &first));
+    TEST_ASSERT_TRUE(gamecart_load(path, &second));
+    TEST_ASSERT_TRUE(first.rom.mapping != NULL);
+    TEST_ASSERT_TRUE(first.rom.prg_rom == second.rom.prg_rom);
+    TEST_ASSERT_TRUE(first.rom.chr_rom == second.rom.chr_rom);
+    TEST_ASSERT_EQUAL_UINT(images + 1, ines_cached_images());
+
+    gamecart_free(&first);
+    TEST_ASSERT_EQUAL_UINT(images + 1, ines_cached_images());
+    TEST_ASSERT_EQUAL_HEX8(0x42, second.rom.prg_rom[0]);
+    gamecart_free(&second);
+    TEST_ASSERT_EQUAL_UINT(images, ines_cached_images());
+    unlink(path);
+}
+
+void test_replaced_rom_file_is_loaded_again(void) {
+    char path[] = "/tmp/nes_tests_rom.nes";
+    write_test_rom(path, 1, 0x42);
+    gamecart_s first, second;
+    TEST_ASSERT_TRUE(gamecart_load(path, &first));
+
+    write_test_rom(path, 2, 0x43);
+    TEST_ASSERT_TRUE(gamecart_load(path, &second));
+    TEST_ASSERT_TRUE(first.rom.prg_rom != second.rom.prg_rom);
+    TEST_ASSERT_EQUAL_HEX8(0x42, first.rom.prg_rom[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x43, second.rom.prg_rom[0]);
+    TEST_ASSERT_TRUE(second.rom.prg_rom_bytes == 0x8000);
+
+    gamecart_free(&first);
+    gamecart_free(&second);
+    unlink(path);
+}
+
+#define SHARED_ROM_THREADS 4
+#define SHARED_ROM_LOADS 200
+
+static void *load_and_free_carts(void *path) {
+    for (int i = 0; i < SHARED_ROM_LOADS; i++) {
+        gamecart_s cart;
+        if (!gamecart_load(path, &cart)) {
+            return NULL;
+        }
+        gamecart_free(&cart);
+    }
+    return path;
+}
+
+void test_carts_share_rom_image_across_threads(void) {
+    char path[] = "/tmp/nes_tests_rom.nes";
+    write_test_rom(path, 1, 0x42);
+    size_t images = ines_cached_images();
+
+    gamecart_s held;
+    TEST_ASSERT_TRUE(gamecart_load(path, &held));
+    pthread_t threads[SHARED_ROM_THREADS];
+    for (int i = 0; i < SHARED_ROM_THREADS; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, load_and_free_carts, path));
+    }
+    for (int i = 0; i < SHARED_ROM_THREADS; i++) {
+        void *result;
+        TEST_ASSERT_EQUAL_INT(0, pthread_join(threads[i], &result));
+        TEST_ASSERT_TRUE(result == path);
+    }
+    TEST_ASSERT_EQUAL_UINT(images + 1, ines_cached_images());
+    TEST_ASSERT_EQUAL_HEX8(0x42, held.rom.prg_rom[0]);
+
+    gamecart_free(&held);
+    TEST_ASSERT_EQUAL_UINT(images, ines_cached_images());
+    unlink(path);
+}
+
+// Turns on rendering and NMI, then loops writing RAM and PRG RAM; the NMI
+// handler writes a new backdrop colour, so every frame looks different
+static void load_save_state_program(nes_console_s *console, gamecart_s *cart, byte_t *prg_rom,
+                                    byte_t *prg_ram, size_t prg_ram_size) {
+    const byte_t program[] = {
+        0xA9, 0x1E,             // $8000: LDA #$1E
+        0x8D, 0x01, 0x20,       //        STA $2001
+        0xA9, 0x80,             //        LDA #$80
+        0x8D, 0x00, 0x20,       //        STA $2000
+        0xE6, 0x10,             // $800A: INC $10
+        0xA6, 0x10,             //        LDX $10
+        0xFE, 0x00, 0x02,       //        INC $0200,X
+        0x8A,                   //        TXA
+        0x9D, 0x00, 0x60,       //        STA $6000,X
+        0x4C, 0x0A, 0x80,       //        JMP $800A
+    };
+    const byte_t handler[] = {
+        0xE6, 0x11,             // $9000: INC $11
+        0xA9, 0x3F,             //        LDA #$3F
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #$00
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA5, 0x11,             //        LDA $11
+        0x8D, 0x07, 0x20,       //        STA $2007
+        0x40,                   //        RTI
+    };
+    load_test_program(cart, prg_rom, program, sizeof(program));
+    memcpy(&prg_rom[0x1000], handler, sizeof(handler));
+    prg_rom[0x7FFA] = 0x00;
+    prg_rom[0x7FFB] = 0x90;
+    cart->prg_ram = prg_ram;
+    cart->prg_ram_size = prg_ram_size;
+    nes_attach_cart(console, cart);
+    console->cpu->PC = TEST_RESET_VECTOR;
+}
+
+void test_load_state_replays_identically(void) {
+    static byte_t prg_ram[0x2000];
+    static byte_t prg_ram_after[0x2000];
+    static byte_t ram_after[BUS_RAM_SIZE];
+    static byte_t framebuffer_after[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    memset(prg_ram, 0, sizeof(prg_ram));
+    load_save_state_program(console_a, &cart_a, prg_rom_a, prg_ram, sizeof(prg_ram));
+    nes_run_frame(console_a);
+    nes_run_frame(console_a);
+
+    size_t size = nes_save_state_size(console_a);
+    byte_t *state = malloc(size);
+    TEST_ASSERT_EQUAL_UINT(size, nes_save_state(console_a, state, size));
+    size_t saved_cycles = console_a->cpu->cycles;
+    word_t saved_pc = console_a->cpu->PC;
+
+    for (int i = 0; i < 3; i++) {
+        nes_run_frame(console_a);
+    }
+    size_t cycles_after = console_a->cpu->cycles;
+    word_t pc_after = console_a->cpu->PC;
+    memcpy(ram_after, console_a->bus->ram, sizeof(ram_after));
+    memcpy(prg_ram_after, prg_ram, sizeof(prg_ram_after));
+    memcpy(framebuffer_after, console_a->ppu->framebuffer, sizeof(framebuffer_after));
+
+    TEST_ASSERT_TRUE(nes_load_state(console_a, state, size));
+    TEST_ASSERT_EQUAL_UINT(saved_cycles, console_a->cpu->cycles);
+    TEST_ASSERT_EQUAL_HEX16(saved_pc, console_a->cpu->PC);
+
+    for (int i = 0; i < 3; i++) {
+        nes_run_frame(console_a);
+    }
+    TEST_ASSERT_EQUAL_UINT(cycles_after, console_a->cpu->cycles);
+    TEST_ASSERT_EQUAL_HEX16(pc_after, console_a->cpu->PC);
+    TEST_ASSERT_EQUAL_MEMORY(ram_after, console_a->bus->ram, sizeof(ram_after));
+    TEST_ASSERT_EQUAL_MEMORY(prg_ram_after, prg_ram, sizeof(prg_ram_after));
+    TEST_ASSERT_EQUAL_MEMORY(framebuffer_after, console_a->ppu->framebuffer, sizeof(framebuffer_after));
+    free(state);
+}
+
+void test_load_state_drops_code_decoded_from_ram(void) {
+    // $0300: LDA #$11; STA $10; JMP $0304
+    const byte_t routine[] = {0xA9, 0x11, 0x85, 0x10, 0x4C, 0x04, 0x03};
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    memcpy(&console_a->bus->ram[0x0300], routine, sizeof(routine));
+    console_a->cpu->PC = 0x0300;
+
+    size_t size = nes_save_state_size(console_a);
+    byte_t *state = malloc(size);
+    TEST_ASSERT_EQUAL_UINT(size, nes_save_state(console_a, state, size));
+
+    // Decode LDX #$11 from the same address, then go back
+    bus_write(console_a->bus, 0x0300, 0xA2);
+    nes_step(console_a);
+    nes_step(console_a);
+    TEST_ASSERT_EQUAL_HEX8(0x11, console_a->cpu->X);
+    TEST_ASSERT_EQUAL_HEX8(0x00, console_a->bus->ram[0x10]);
+
+    TEST_ASSERT_TRUE(nes_load_state(console_a, state, size));
+    nes_step(console_a);
+    nes_step(console_a);
+    TEST_ASSERT_EQUAL_HEX8(0x11, console_a->bus->ram[0x10]);
+    free(state);
+}
+
+void test_load_state_rejects_mismatched_states(void) {
+    const byte_t program[] = {0xEA};
+    load_test_program(&cart_a, prg_rom_a, program, sizeof(program));
+    nes_attach_cart(console_a, &cart_a);
+    load_test_program(&cart_b, prg_rom_b, program, sizeof(program));
+    cart_b.rom.prg_rom_bytes = 16 * 1024;
+    nes_attach_cart(console_b, &cart_b);
+    console_a->cpu->PC = 0x1234;
+
+    size_t size = nes_save_state_size(console_a);
+    byte_t *state = malloc(size);
+    TEST_ASSERT_EQUAL_UINT(0, nes_save_state(console_a, state, size - 1));
+    TEST_ASSERT_EQUAL_UINT(size, nes_save_state(console_a, state, size));
+
+    TEST_ASSERT_FALSE(nes_load_state(console_a, state, size - 1));
+    // A cart with a different PRG ROM size
+    word_t pc_b = console_b->cpu->PC;
+    TEST_ASSERT_FALSE(nes_load_state(console_b, state, size));
+    TEST_ASSERT_EQUAL_HEX16(pc_b, console_b->cpu->PC);
+    state[0] ^= 0xFF;
+    TEST_ASSERT_FALSE(nes_load_state(console_a, state, size));
+    state[0] ^= 0xFF;
+    state[4] ^= 0xFF;
+    TEST_ASSERT_FALSE(nes_load_state(console_a, state, size));
+    state[4] ^= 0xFF;
+
+    console_a->cpu->PC = 0x8000;
+    TEST_ASSERT_TRUE(nes_load_state(console_a, state, size));
+    TEST_ASSERT_EQUAL_HEX16(0x1234, console_a->cpu->PC);
+    free(state);
+}
+
+void test_run_ahead_shows_future_frame_and_keeps_state(void) {
+    static byte_t prg_ram_a[0x2000];
+    static byte_t prg_ram_b[0x2000];
+    memset(prg_ram_a, 0, sizeof(prg_ram_a));
+    memset(prg_ram_b, 0, sizeof(prg_ram_b));
+    load_save_state_program(console_a, &cart_a, prg_rom_a, prg_ram_a, sizeof(prg_ram_a));
+    load_save_state_program(console_b, &cart_b, prg_rom_b, prg_ram_b, sizeof(prg_ram_b));
+    memset(console_a->bus->ram, 0, BUS_RAM_SIZE);
+    memset(console_b->bus->ram, 0, BUS_RAM_SIZE);
+    size_t size = nes_save_state_size(console_a);
+    byte_t *state = malloc(size);
+
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(nes_run_frame_ahead(console_a, 2, state, size) & STEP_RESULT_FRAME_COMPLETE);
+        nes_run_frame(console_b);
+    }
+    TEST_ASSERT_EQUAL_UINT(console_b->cpu->cycles, console_a->cpu->cycles);
+    TEST_ASSERT_EQUAL_HEX16(console_b->cpu->PC, console_a->cpu->PC);
+    TEST_ASSERT_EQUAL_MEMORY(console_b->bus->ram, console_a->bus->ram, BUS_RAM_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(prg_ram_b, prg_ram_a, sizeof(prg_ram_a));
+    TEST_ASSERT_FALSE(console_a->ppu->skip_output);
+
+    nes_run_frame(console_b);
+    nes_run_frame(console_b);
+    TEST_ASSERT_EQUAL_MEMORY(console_b->ppu->framebuffer, console_a->ppu->framebuffer,
+                             sizeof(console_a->ppu->framebuffer));
+    free(state);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_console_create_wires_components);
+    RUN_TEST(test_consoles_own_separate_components);
+    RUN_TEST(test_consoles_have_independent_ram);
+    RUN_TEST(test_consoles_have_independent_ppu_state);
+    RUN_TEST(test_consoles_execute_independently);
+
+    RUN_TEST(test_bus_ram_is_mirrored);
+    RUN_TEST(test_bus_maps_16k_prg_rom_twice);
+    RUN_TEST(test_bus_prg_rom_is_read_only);
+    RUN_TEST(test_bus_prg_ram_read_write);
+    RUN_TEST(test_bus_unmapped_reads_return_zero);
+
+    RUN_TEST(test_cpu_run_cycles_spends_budget);
+    RUN_TEST(test_cpu_run_cycles_stops_before_illegal_opcode);
+    RUN_TEST(test_cpu_run_cycles_stops_on_breakpoint);
+    RUN_TEST(test_nes_run_frame_runs_one_frame);
+    RUN_TEST(test_nes_run_frame_fires_nmi);
+    RUN_TEST(test_ppu_catches_up_on_register_access);
+    RUN_TEST(test_nes_step_keeps_ppu_in_sync);
+    RUN_TEST(test_scheduler_pops_events_in_deadline_order);
+    RUN_TEST(test_oam_dma_stalls_cpu);
+    RUN_TEST(test_nmi_enabled_during_vblank_fires_after_write);
+    RUN_TEST(test_block_cache_drops_code_rewritten_in_ram);
+    RUN_TEST(test_block_cache_does_not_read_io_while_decoding);
+#if defined(CPU_JIT)
+    RUN_TEST(test_jit_runs_in_lockstep_with_interpreter);
+#endif
+    RUN_TEST(test_idle_loop_skip_matches_execution_of_vblank_poll);
+    RUN_TEST(test_idle_loop_skip_leaves_loops_that_write_alone);
+    RUN_TEST(test_idle_loop_skip_sees_nmi_handler_writes);
+    RUN_TEST(test_carts_loaded_from_one_file_share_rom_image);
+    RUN_TEST(test_replaced_rom_file_is_loaded_again);
+    RUN_TEST(test_carts_share_rom_image_across_threads);
+    RUN_TEST(test_load_state_replays_identically);
+    RUN_TEST(test_load_state_drops_code_decoded_from_ram);
+    RUN_TEST(test_load_state_rejects_mismatched_states);
+    RUN_TEST(test_run_ahead_shows_future_frame_and_keeps_state);
+
+    return UNITY_END();
+}
@@ -2,13 +2,6 @@
 #include <string.h>
 #include <assert.h>
 
-static ppu_s s_ppu;
-
-ppu_s* ppu_get_instance(void)
-{
-    return &s_ppu;
-}
-
 
 static const uint32_t NES_PALETTE[64] = {
     0xFF666666, 0xFF002A88, 0xFF1412A7, 0xFF3B00A4, 0xFF5C007E, 0xFF6E0040, 0xFF6C0600, 0xFF561D00,
@@ -76,11 +69,81 @@ void ppu_init(ppu_s *ppu)
 }
 
 
+// Maps the first 8KB of chr_rom, repeating it when smaller
 void ppu_load_chr_rom(ppu_s *ppu, byte_t *chr_rom, size_t size)
 {
     assert(ppu != NULL);
-    ppu->chr_rom = chr_rom;
-    ppu->chr_rom_size = size;
+    for (int bank = 0; bank < PPU_CHR_BANKS; bank++) {
+        bool mapped = chr_rom != NULL && size > 0;
+        ppu->chr_banks[bank] = mapped ? &chr_rom[((size_t)bank * PPU_CHR_BANK_SIZE) % size] : NULL;
+    }
+    ppu->chr_writable = false;
+    ppu_invalidate_pattern_cache(ppu);
+}
+
+// For when CHR memory changed behind the PPU's back
+void ppu_invalidate_pattern_cache(ppu_s *ppu)
+{
+    assert(ppu != NULL);
+    memset(ppu->pattern_valid, 0, sizeof(ppu->pattern_valid));
+}
+
+void ppu_load_chr_ram(ppu_s *ppu, byte_t *chr_ram, size_t size)
+{
+    ppu_load_chr_rom(ppu, chr_ram, size);
+    ppu->chr_writable = true;
+}
+
+
+#define PATTERN_VALID_BYTES_PER_BANK (PPU_CHR_BANK_SIZE / 16 / 8)
+
+static void invalidate_chr_bank(ppu_s *ppu, int bank)
+{
+    memset(&ppu->pattern_valid[bank * PATTERN_VALID_BYTES_PER_BANK], 0, PATTERN_VALID_BYTES_PER_BANK);
+}
+
+// Points 1KB bank (0-7) of the pattern tables at mem. Only the tiles of a
+// bank that actually changed are decoded again.
+void ppu_set_chr_bank(ppu_s *ppu, int bank, byte_t *mem)
+{
+    assert(ppu != NULL);
+    assert(bank >= 0 && bank < PPU_CHR_BANKS);
+    if (ppu->chr_banks[bank] != mem) {
+        ppu->chr_banks[bank] = mem;
+        invalidate_chr_bank(ppu, bank);
+    }
+}
+
+static void decode_pattern_tile(ppu_s *ppu, int tile)
+{
+    byte_t *pixels = ppu->pattern_cache[tile];
+
+    for (int row = 0; row < 8; row++) {
+        word_t addr = (word_t)(tile * 16 + row);
+        byte_t lo = ppu_vram_read(ppu, addr);
+        byte_t hi = ppu_vram_read(ppu, addr + 8);
+        for (int col = 0; col < 8; col++) {
+            int bit = 7 - col;
+            pixels[row * 8 + col] = (((hi >> bit) & 1) << 1) | ((lo >> bit) & 1);
+        }
+    }
+    ppu->pattern_valid[tile >> 3] |= (byte_t)(1 << (tile & 7));
+}
+
+static inline const byte_t *pattern_tile(ppu_s *ppu, int tile)
+{
+    if (!(ppu->pattern_valid[tile >> 3] & (1 << (tile & 7)))) {
+        decode_pattern_tile(ppu, tile);
+    }
+    return ppu->pattern_cache[tile];
+}
+
+// Tile 0-511: $0000-$0FFF holds 0-255 and $1000-$1FFF 256-511
+const byte_t *ppu_get_pattern_tile(ppu_s *ppu, int tile)
+{
+    assert(ppu != NULL);
+    assert(tile >= 0 && tile < PPU_PATTERN_TILES);
+    return pattern_tile(ppu, tile);
 }
 
 void ppu_set_mirroring(ppu_s *ppu, mirroring_mode_e mode)
@@ -129,10 +192,8 @@ byte_t ppu_vram_read(ppu_s *ppu, word_t addr)
 
     if (addr < 0x2000) {
         
-        if (ppu->chr_rom != NULL && ppu->chr_rom_size > 0) {
-            return ppu->chr_rom[addr % ppu->chr_rom_size];
-        }
-        return 0;
+        const byte_t *bank = ppu->chr_banks[(addr >> 10) & (PPU_CHR_BANKS - 1)];
+        return bank ? bank[addr % PPU_CHR_BANK_SIZE] : 0;
     }
     else if (addr < 0x3F00) {
         
@@ -160,7 +221,18 @@ void ppu_vram_write(ppu_s *ppu, word_t addr, byte_t value)
     addr &= 0x3FFF;
 
     if (addr < 0x2000) {
-        
+        byte_t *bank = ppu->chr_banks[(addr >> 10) & (PPU_CHR_BANKS - 1)];
+        if (ppu->chr_writable && bank) {
+            bank[addr % PPU_CHR_BANK_SIZE] = value;
+            // The same 1KB of CHR RAM may be mapped more than once
+            word_t offset = addr % PPU_CHR_BANK_SIZE;
+            for (int alias = 0; alias < PPU_CHR_BANKS; alias++) {
+                if (ppu->chr_banks[alias] == bank) {
+                    word_t alias_addr = (word_t)(alias * PPU_CHR_BANK_SIZE + offset);
+                    ppu->pattern_valid[alias_addr >> 7] &= (byte_t)~(1 << ((alias_addr >> 4) & 7));
+                }
+            }
+        }
         return;
     }
     else if (addr < 0x3F00) {
@@ -330,81 +402,157 @@ void ppu_write(ppu_s *ppu, ppu_register_e reg, byte_t value)
 #define PPU_PRERENDER_SCANLINE   261
 
 
-static void render_pixel(ppu_s *ppu)
+// https://www.nesdev.org/wiki/PPU_scrolling#Tile_and_attribute_fetching
+// Returns the decoded row of the tile at v.
+static const byte_t *fetch_bg_tile(ppu_s *ppu, word_t v, byte_t *palette)
 {
-    int x = ppu->cycle - 1;
-    int y = ppu->scanline;
+    byte_t tile_index = ppu_vram_read(ppu, 0x2000 | (v & 0x0FFF));
+    int tile = ((ppu->ctrl_register & PPUCTRL_BG_TABLE) ? 256 : 0) + tile_index;
 
-    if (x < 0 || x >= PPU_SCREEN_WIDTH || y < 0 || y >= PPU_SCREEN_HEIGHT) {
-        return;
+    word_t attr_addr = 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+    int attr_shift = ((v >> 4) & 0x04) | (v & 0x02);
+    *palette = (ppu_vram_read(ppu, attr_addr) >> attr_shift) & 0x03;
+
+    return &pattern_tile(ppu, tile)[((v >> 12) & 0x07) * 8];
+}
+
+
+static word_t next_tile_addr(word_t v)
+{
+    if ((v & 0x001F) == 31) {
+        return (v & ~0x001F) ^ 0x0400;
     }
+    return v + 1;
+}
 
-    uint32_t pixel_color = NES_PALETTE[ppu->palette[0] & 0x3F];
 
-    
-    bool bg_enabled = ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE);
-    bool bg_left_enabled = ppu_get_mask_flag(ppu, PPUMASK_BG_LEFT);
+// Decodes the 8 pixels of the tile slot starting at the current dot. With
+// fine X scroll they straddle the tile at v and the one after it; the second
+// is kept so the next slot reuses it, leaving one fetch per tile.
+static void load_bg_tile_slot(ppu_s *ppu, bool line_start)
+{
+    word_t v = ppu->vram_addr;
+    byte_t current[8];
+    byte_t palette;
 
-    if (bg_enabled && (x >= 8 || bg_left_enabled)) {
-        
-        word_t v = ppu->vram_addr;
-        int coarse_x = v & 0x1F;
-        int coarse_y = (v >> 5) & 0x1F;
-        int fine_y = (v >> 12) & 0x07;
-        int nametable = (v >> 10) & 0x03;
-        int fine_x_scroll = ppu->fine_x;
+    if (!line_start && ppu->bg_next_valid && ppu->bg_next_addr == v) {
+        memcpy(current, ppu->bg_next_row, sizeof(current));
+        palette = ppu->bg_next_palette;
+    } else {
+        memcpy(current, fetch_bg_tile(ppu, v, &palette), sizeof(current));
+    }
 
-        
-        int tile_x = (x + fine_x_scroll) % 8;
+    ppu->bg_next_addr = next_tile_addr(v);
+    memcpy(ppu->bg_next_row, fetch_bg_tile(ppu, ppu->bg_next_addr, &ppu->bg_next_palette),
+           sizeof(ppu->bg_next_row));
+    ppu->bg_next_valid = true;
 
-        
-        word_t nt_addr = 0x2000 | (nametable << 10) | (coarse_y << 5) | coarse_x;
-        byte_t tile_index = ppu_vram_read(ppu, nt_addr);
+    for (int i = 0; i < 8; i++) {
+        int offset = i + ppu->fine_x;
+        byte_t pixel = offset < 8 ? current[offset] : ppu->bg_next_row[offset - 8];
+        byte_t pixel_palette = offset < 8 ? palette : ppu->bg_next_palette;
+        ppu->bg_pixels[i] = pixel ? (byte_t)((pixel_palette << 2) | pixel) : 0;
+    }
+}
 
-        
-        word_t pattern_base = (ppu->ctrl_register & PPUCTRL_BG_TABLE) ? 0x1000 : 0x0000;
-        word_t pattern_addr = pattern_base + (tile_index * 16) + fine_y;
 
-        
-        byte_t pattern_lo = ppu_vram_read(ppu, pattern_addr);
-        byte_t pattern_hi = ppu_vram_read(ppu, pattern_addr + 8);
+// Sprite line buffer entries: palette index $10-$1F plus priority and
+// sprite 0 bits
+#define PPU_SPRITE_PIXEL_INDEX   0x1F
+#define PPU_SPRITE_PIXEL_BEHIND  0x20
+#define PPU_SPRITE_PIXEL_ZERO    0x40
 
-        
-        int bit = 7 - tile_x;
-        byte_t pixel_lo = (pattern_lo >> bit) & 1;
-        byte_t pixel_hi = (pattern_hi >> bit) & 1;
-        byte_t pixel_value = (pixel_hi << 1) | pixel_lo;
+// https://www.nesdev.org/wiki/PPU_OAM#Byte_2
+#define SPRITE_ATTR_PALETTE  0x03
+#define SPRITE_ATTR_BEHIND   0x20
+#define SPRITE_ATTR_FLIP_H   0x40
+#define SPRITE_ATTR_FLIP_V   0x80
 
-        
-        if (pixel_value != 0) {
-            
-            word_t attr_addr = 0x23C0 | (nametable << 10) | ((coarse_y / 4) << 3) | (coarse_x / 4);
-            byte_t attr_byte = ppu_vram_read(ppu, attr_addr);
 
-            
-            int attr_shift = ((coarse_y & 2) << 1) | (coarse_x & 2);
-            byte_t palette_num = (attr_byte >> attr_shift) & 0x03;
+// https://www.nesdev.org/wiki/PPU_sprite_evaluation
+// OAM Y is one less than the first line a sprite covers. Finds up to 8
+// sprites on the line, then draws them into sprite_line once so the dot loop
+// only has to merge. Lower OAM indices win where sprites overlap.
+static void evaluate_sprites(ppu_s *ppu)
+{
+    int line = ppu->scanline;
+    int height = (ppu->ctrl_register & PPUCTRL_SPRITE_SIZE) ? 16 : 8;
+    int found = 0;
+    bool sprite_zero = false;
+
+    for (int i = 0; i < OAM_SIZE; i += 4) {
+        int row = line - 1 - ppu->oam[i];
+        if (row < 0 || row >= height) {
+            continue;
+        }
+        if (found == SPRITES_PER_LINE) {
+            ppu_set_status_flag(ppu, PPUSTATUS_OVERFLOW, true);
+            break;
+        }
+        if (i == 0) {
+            sprite_zero = true;
+        }
+        memcpy(&ppu->secondary_oam[found * 4], &ppu->oam[i], 4);
+        found++;
+    }
+    ppu->sprite_count = (byte_t)found;
+    ppu->sprite_zero_on_line = sprite_zero;
 
-            
-            word_t pal_addr = 0x3F00 + (palette_num << 2) + pixel_value;
-            byte_t color_index = ppu_vram_read(ppu, pal_addr);
+    memset(ppu->sprite_line, 0, sizeof(ppu->sprite_line));
+
+    for (int n = 0; n < found; n++) {
+        const byte_t *sprite = &ppu->secondary_oam[n * 4];
+        byte_t tile = sprite[1];
+        byte_t attr = sprite[2];
+        int x = sprite[3];
+        int row = line - 1 - sprite[0];
+
+        if (attr & SPRITE_ATTR_FLIP_V) {
+            row = height - 1 - row;
+        }
+
+        int pattern;
+        if (height == 16) {
+            // https://www.nesdev.org/wiki/PPU_OAM#Byte_1
+            pattern = ((tile & 0x01) ? 256 : 0) + (tile & 0xFE);
+            if (row >= 8) {
+                pattern++;
+                row -= 8;
+            }
+        } else {
+            pattern = ((ppu->ctrl_register & PPUCTRL_SPRITE_TABLE) ? 256 : 0) + tile;
+        }
+        const byte_t *pixels = &pattern_tile(ppu, pattern)[row * 8];
+        bool flip_h = (attr & SPRITE_ATTR_FLIP_H) != 0;
+
+        byte_t flags = 0x10 | ((attr & SPRITE_ATTR_PALETTE) << 2);
+        if (attr & SPRITE_ATTR_BEHIND) {
+            flags |= PPU_SPRITE_PIXEL_BEHIND;
+        }
+        if (n == 0 && sprite_zero) {
+            flags |= PPU_SPRITE_PIXEL_ZERO;
+        }
 
-            pixel_color = NES_PALETTE[color_index & 0x3F];
+        for (int i = 0; i < 8 && x + i < PPU_SCREEN_WIDTH; i++) {
+            byte_t pixel = pixels[flip_h ? 7 - i : i];
+            if (pixel && ppu->sprite_line[x + i] == 0) {
+                ppu->sprite_line[x + i] = flags | pixel;
+            }
         }
     }
+}
 
-    
-    ppu->framebuffer[y * PPU_SCREEN_WIDTH + x] = pixel_color;
+
+static bool rendering_enabled(const ppu_s *ppu)
+{
+    return (ppu->mask_register & (PPUMASK_BG_ENABLE | PPUMASK_SPRITE_ENABLE)) != 0;
 }
 
 
+// The scroll helpers below only run while rendering is enabled; callers
+// check PPUMASK once per span.
 static void increment_scroll_x(ppu_s *ppu)
 {
-    if (!ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE) &&
-        !ppu_get_mask_flag(ppu, PPUMASK_SPRITE_ENABLE)) {
-        return;
-    }
-
     if ((ppu->vram_addr & 0x001F) == 31) {
         
         ppu->vram_addr &= ~0x001F;
@@ -417,11 +565,6 @@ static void increment_scroll_x(ppu_s *ppu)
 
 static void increment_scroll_y(ppu_s *ppu)
 {
-    if (!ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE) &&
-        !ppu_get_mask_flag(ppu, PPUMASK_SPRITE_ENABLE)) {
-        return;
-    }
-
     if ((ppu->vram_addr & 0x7000) != 0x7000) {
         
         ppu->vram_addr += 0x1000;
@@ -447,100 +590,364 @@ static void increment_scroll_y(ppu_s *ppu)
 
 static void copy_horizontal_bits(ppu_s *ppu)
 {
-    if (!ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE) &&
-        !ppu_get_mask_flag(ppu, PPUMASK_SPRITE_ENABLE)) {
-        return;
-    }
-    
     ppu->vram_addr = (ppu->vram_addr & ~0x041F) | (ppu->temp_addr & 0x041F);
 }
 
 
 static void copy_vertical_bits(ppu_s *ppu)
 {
-    if (!ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE) &&
-        !ppu_get_mask_flag(ppu, PPUMASK_SPRITE_ENABLE)) {
-        return;
-    }
-    
     ppu->vram_addr = (ppu->vram_addr & ~0x7BE0) | (ppu->temp_addr & 0x7BE0);
 }
 
 
-void ppu_tick(ppu_s *ppu)
-{
-    assert(ppu != NULL);
+#define PPU_SCANLINE_HOOK_DOT 260
 
-    
-    ppu->cycle++;
-    if (ppu->cycle >= PPU_CYCLES_PER_SCANLINE) {
-        ppu->cycle = 0;
-        ppu->scanline++;
-        if (ppu->scanline >= PPU_SCANLINES_PER_FRAME) {
-            ppu->scanline = 0;
+// The background fetches and scroll increments of dots first..last, without
+// producing pixels; ends in the same state as drawing them would
+static void fetch_span(ppu_s *ppu, int first, int last, bool bg_enabled)
+{
+    for (int dot = first; dot <= last; dot++) {
+        if (bg_enabled && ((dot - 1) & 7) == 0) {
+            load_bg_tile_slot(ppu, dot == 1);
+        }
+        if (dot % 8 == 0) {
+            increment_scroll_x(ppu);
         }
     }
+}
 
-    
-    if (ppu->scanline >= 0 && ppu->scanline < 240) {
-        
-        if (ppu->cycle >= 1 && ppu->cycle <= 256) {
-            render_pixel(ppu);
+static bool span_contains(int first, int last, int dot)
+{
+    return first <= dot && dot <= last;
+}
 
-            
-            if (ppu->cycle % 8 == 0) {
-                increment_scroll_x(ppu);
+
+// Runs dots first..last of the current scanline. Nothing the CPU can see
+// changes inside a span, so idle dots are skipped and per-line events run once.
+static void run_scanline_span(ppu_s *ppu, int first, int last)
+{
+    int scanline = ppu->scanline;
+
+    if (scanline >= 0 && scanline < PPU_SCREEN_HEIGHT) {
+        if (rendering_enabled(ppu)) {
+            if (span_contains(first, last, 1)) {
+                evaluate_sprites(ppu);
             }
-        }
 
-        
-        if (ppu->cycle == 256) {
-            increment_scroll_y(ppu);
-        }
+            int end = last < PPU_SCREEN_WIDTH ? last : PPU_SCREEN_WIDTH;
+            bool bg_enabled = ppu_get_mask_flag(ppu, PPUMASK_BG_ENABLE);
+            bool sprites_enabled = ppu_get_mask_flag(ppu, PPUMASK_SPRITE_ENABLE) && ppu->sprite_count > 0;
+            bool sprite_zero_may_hit = bg_enabled && sprites_enabled && ppu->sprite_zero_on_line &&
+                                       !ppu_get_status_flag(ppu, PPUSTATUS_SPRITE0_HIT);
+            int bg_start = ppu_get_mask_flag(ppu, PPUMASK_BG_LEFT) ? 0 : 8;
+            int sprite_start = ppu_get_mask_flag(ppu, PPUMASK_SPRITE_LEFT) ? 0 : 8;
+            byte_t color_mask = (ppu->mask_register & PPUMASK_GRAYSCALE) ? 0x30 : 0x3F;
+            byte_t *row = &ppu->framebuffer[scanline * PPU_SCREEN_WIDTH];
+            if (ppu->skip_output && !sprite_zero_may_hit) {
+                fetch_span(ppu, first, end, bg_enabled);
+            } else {
+                ppu->line_emphasis[scanline] = ppu->mask_register >> 5;
+                for (int dot = first; dot <= end; dot++) {
+                    int x = dot - 1;
+                    byte_t index = 0;
+                    if (bg_enabled) {
+                        if ((x & 7) == 0) {
+                            load_bg_tile_slot(ppu, x == 0);
+                        }
+                        if (x >= bg_start) {
+                            index = ppu->bg_pixels[x & 7];
+                        }
+                    }
+                    byte_t sprite = (sprites_enabled && x >= sprite_start) ? ppu->sprite_line[x] : 0;
+                    if (sprite) {
+                        // https://www.nesdev.org/wiki/PPU_OAM#Sprite_zero_hits
+                        if ((sprite & PPU_SPRITE_PIXEL_ZERO) && index && x != 255) {
+                            ppu_set_status_flag(ppu, PPUSTATUS_SPRITE0_HIT, true);
+                        }
+                        if (!index || !(sprite & PPU_SPRITE_PIXEL_BEHIND)) {
+                            index = sprite & PPU_SPRITE_PIXEL_INDEX;
+                        }
+                    }
+                    row[x] = ppu->palette[index] & color_mask;
+                    if (dot % 8 == 0) {
+                        increment_scroll_x(ppu);
+                    }
+                }
+            }
 
-        
-        if (ppu->cycle == 257) {
-            copy_horizontal_bits(ppu);
+            if (span_contains(first, last, 256)) {
+                increment_scroll_y(ppu);
+            }
+            if (span_contains(first, last, 257)) {
+                copy_horizontal_bits(ppu);
+            }
+            if (ppu->scanline_hook && span_contains(first, last, PPU_SCANLINE_HOOK_DOT)) {
+                ppu->scanline_hook(ppu->scanline_hook_context);
+            }
+        } else {
+            if (span_contains(first, last, 1)) {
+                ppu->sprite_count = 0;
+                ppu->sprite_zero_on_line = false;
+            }
+            int start = first < 1 ? 1 : first;
+            int end = last < PPU_SCREEN_WIDTH ? last : PPU_SCREEN_WIDTH;
+            byte_t color_mask = (ppu->mask_register & PPUMASK_GRAYSCALE) ? 0x30 : 0x3F;
+            byte_t *row = &ppu->framebuffer[scanline * PPU_SCREEN_WIDTH];
+            if (!ppu->skip_output) {
+                ppu->line_emphasis[scanline] = ppu->mask_register >> 5;
+                if (start <= end) {
+                    memset(&row[start - 1], ppu->palette[0] & color_mask, end - start + 1);
+                }
+            }
         }
     }
-
-    
-    if (ppu->scanline == PPU_PRERENDER_SCANLINE) {
-        
-        if (ppu->cycle == 1) {
+    else if (scanline == PPU_VBLANK_SCANLINE) {
+        if (span_contains(first, last, 1)) {
+            ppu_set_status_flag(ppu, PPUSTATUS_VBLANK, true);
+            ppu->frame_complete = true;
+            if (ppu->ctrl_register & PPUCTRL_NMI_ENABLE) {
+                ppu->nmi_pending = true;
+            }
+        }
+    }
+    else if (scanline == PPU_PRERENDER_SCANLINE) {
+        if (span_contains(first, last, 1)) {
             ppu_set_status_flag(ppu, PPUSTATUS_VBLANK, false);
             ppu_set_status_flag(ppu, PPUSTATUS_SPRITE0_HIT, false);
             ppu_set_status_flag(ppu, PPUSTATUS_OVERFLOW, false);
         }
 
-        
-        if (ppu->cycle >= 280 && ppu->cycle <= 304) {
-            copy_vertical_bits(ppu);
+        if (rendering_enabled(ppu)) {
+            if (span_contains(first, last, 257)) {
+                copy_horizontal_bits(ppu);
+            }
+            if (first <= 304 && last >= 280) {
+                copy_vertical_bits(ppu);
+            }
+            if (ppu->scanline_hook && span_contains(first, last, PPU_SCANLINE_HOOK_DOT)) {
+                ppu->scanline_hook(ppu->scanline_hook_context);
+            }
         }
+    }
 
-        
-        if (ppu->cycle == 257) {
-            copy_horizontal_bits(ppu);
+    ppu->cycle = last;
+}
+
+
+// Nothing happens on lines 240-260 apart from the vblank flag at 241/1,
+// so stretches of them are skipped in one step up to the dot before the
+// next event.
+static size_t skip_idle_dots(ppu_s *ppu, size_t dots)
+{
+    if (ppu->scanline < PPU_SCREEN_HEIGHT || ppu->scanline >= PPU_PRERENDER_SCANLINE) {
+        return 0;
+    }
+
+    long position = (long)ppu->scanline * PPU_CYCLES_PER_SCANLINE + ppu->cycle;
+    long vblank = (long)PPU_VBLANK_SCANLINE * PPU_CYCLES_PER_SCANLINE + 1;
+    long prerender = (long)PPU_PRERENDER_SCANLINE * PPU_CYCLES_PER_SCANLINE + 1;
+    long next_event = position < vblank ? vblank : prerender;
+
+    size_t idle = (size_t)(next_event - position - 1);
+    size_t skipped = dots < idle ? dots : idle;
+    position += (long)skipped;
+    ppu->scanline = (int16_t)(position / PPU_CYCLES_PER_SCANLINE);
+    ppu->cycle = (uint16_t)(position % PPU_CYCLES_PER_SCANLINE);
+    return skipped;
+}
+
+
+void ppu_run(ppu_s *ppu, size_t dots)
+{
+    assert(ppu != NULL);
+
+    while (dots > 0) {
+        size_t skipped = skip_idle_dots(ppu, dots);
+        if (skipped > 0) {
+            dots -= skipped;
+            continue;
+        }
+
+        if (ppu->cycle >= PPU_CYCLES_PER_SCANLINE - 1) {
+            // Dot 0 of every scanline is idle
+            ppu->cycle = 0;
+            ppu->scanline++;
+            if (ppu->scanline >= PPU_SCANLINES_PER_FRAME) {
+                ppu->scanline = 0;
+            }
+            dots--;
+            continue;
         }
+
+        int first = ppu->cycle + 1;
+        size_t line_dots = (PPU_CYCLES_PER_SCANLINE - 1) - ppu->cycle;
+        int last = dots < line_dots ? ppu->cycle + (int)dots : PPU_CYCLES_PER_SCANLINE - 1;
+
+        run_scanline_span(ppu, first, last);
+        dots -= last - first + 1;
     }
+}
+
 
-    
-    if (ppu->scanline == PPU_VBLANK_SCANLINE && ppu->cycle == 1) {
-        ppu_set_status_flag(ppu, PPUSTATUS_VBLANK, true);
-        ppu->frame_complete = true;
-        if (ppu->ctrl_register & PPUCTRL_NMI_ENABLE) {
-            ppu->nmi_pending = true;
+void ppu_tick(ppu_s *ppu)
+{
+    ppu_run(ppu, 1);
+}
+
+
+// Dots from the current position until dot of line has been run
+static size_t dots_until(const ppu_s *ppu, int line, int dot)
+{
+    const long frame_dots = PPU_CYCLES_PER_SCANLINE * PPU_SCANLINES_PER_FRAME;
+    long position = (long)ppu->scanline * PPU_CYCLES_PER_SCANLINE + ppu->cycle;
+    long target = (long)line * PPU_CYCLES_PER_SCANLINE + dot;
+    long dots = target - position;
+    if (dots <= 0) {
+        dots += frame_dots;
+    }
+    return (size_t)dots;
+}
+
+
+size_t ppu_dots_until_vblank(const ppu_s *ppu)
+{
+    assert(ppu != NULL);
+    return dots_until(ppu, PPU_VBLANK_SCANLINE, 1);
+}
+
+
+// Dots until the count-th scanline_hook call from now (count >= 1), if
+// rendering stays enabled
+size_t ppu_dots_until_scanline_hook(const ppu_s *ppu, unsigned count)
+{
+    assert(ppu != NULL && count > 0);
+
+    int line = ppu->scanline;
+    long dots = PPU_SCANLINE_HOOK_DOT - ppu->cycle;
+    if (dots <= 0) {
+        line++;
+        dots += PPU_CYCLES_PER_SCANLINE;
+    }
+    for (;;) {
+        line %= PPU_SCANLINES_PER_FRAME;
+        if (line < PPU_SCREEN_HEIGHT || line == PPU_PRERENDER_SCANLINE) {
+            if (--count == 0) {
+                return (size_t)dots;
+            }
+        }
+        line++;
+        dots += PPU_CYCLES_PER_SCANLINE;
+    }
+}
+
+
+// Lower bound on the dots before the PPU can change PPUSTATUS by itself,
+// assuming the CPU doesn't touch PPU registers or OAM in the meantime.
+size_t ppu_dots_until_status_change(const ppu_s *ppu)
+{
+    assert(ppu != NULL);
+
+    size_t dots = dots_until(ppu, PPU_VBLANK_SCANLINE, 1);
+    size_t prerender = dots_until(ppu, PPU_PRERENDER_SCANLINE, 1);
+    if (prerender < dots) {
+        dots = prerender;
+    }
+    if (!rendering_enabled(ppu)) {
+        return dots;
+    }
+
+    int height = (ppu->ctrl_register & PPUCTRL_SPRITE_SIZE) ? 16 : 8;
+    byte_t sprites_on_line[PPU_SCREEN_HEIGHT] = {0};
+    for (int i = 0; i < OAM_SIZE; i += 4) {
+        for (int line = ppu->oam[i] + 1; line <= ppu->oam[i] + height && line < PPU_SCREEN_HEIGHT; line++) {
+            sprites_on_line[line]++;
         }
     }
+
+    bool sprite0_possible = !(ppu->status_register & PPUSTATUS_SPRITE0_HIT) &&
+                            (ppu->mask_register & PPUMASK_BG_ENABLE) &&
+                            (ppu->mask_register & PPUMASK_SPRITE_ENABLE);
+    bool overflow_possible = !(ppu->status_register & PPUSTATUS_OVERFLOW);
+    int sprite0_first = ppu->oam[0] + 1;
+    int sprite0_last = ppu->oam[0] + height;
+
+    for (int line = 0; line < PPU_SCREEN_HEIGHT; line++) {
+        bool event = overflow_possible && sprites_on_line[line] > SPRITES_PER_LINE;
+        if (sprite0_possible && line >= sprite0_first && line <= sprite0_last) {
+            // Sprite 0 can hit anywhere on the line, including the rest of
+            // the one being drawn
+            if (line == ppu->scanline) {
+                return 1;
+            }
+            event = true;
+        }
+        if (event) {
+            size_t until = dots_until(ppu, line, 1);
+            if (until < dots) {
+                dots = until;
+            }
+        }
+    }
+    return dots;
 }
 
 
-uint32_t *ppu_get_framebuffer(ppu_s *ppu)
+byte_t *ppu_get_framebuffer(ppu_s *ppu)
 {
     assert(ppu != NULL);
     return ppu->framebuffer;
 }
 
+
+// https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits
+// Each set emphasis bit dims the other two channels to about 82%.
+static void build_emphasis_palette(byte_t emphasis, uint32_t *table)
+{
+    for (int i = 0; i < 64; i++) {
+        uint32_t color = NES_PALETTE[i];
+        uint32_t r = (color >> 16) & 0xFF;
+        uint32_t g = (color >> 8) & 0xFF;
+        uint32_t b = color & 0xFF;
+
+        if (emphasis & 0x06) r = r * 209 / 256;
+        if (emphasis & 0x05) g = g * 209 / 256;
+        if (emphasis & 0x03) b = b * 209 / 256;
+
+        table[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+
+// Only frontends that display the frame pay for the conversion. The inner
+// loop is a plain table lookup per byte so the compiler can vectorize it.
+void ppu_framebuffer_to_argb(const ppu_s *ppu, uint32_t *pixels, size_t pitch)
+{
+    assert(ppu != NULL);
+    assert(pixels != NULL);
+    assert(pitch >= PPU_SCREEN_WIDTH * sizeof(uint32_t));
+
+    uint32_t emphasized[64];
+    int table_emphasis = -1;
+
+    for (int y = 0; y < PPU_SCREEN_HEIGHT; y++) {
+        const uint32_t *table = NES_PALETTE;
+        byte_t emphasis = ppu->line_emphasis[y];
+        if (emphasis) {
+            if (emphasis != table_emphasis) {
+                build_emphasis_palette(emphasis, emphasized);
+                table_emphasis = emphasis;
+            }
+            table = emphasized;
+        }
+
+        const byte_t *src = &ppu->framebuffer[y * PPU_SCREEN_WIDTH];
+        uint32_t *dst = (uint32_t *)((uint8_t *)pixels + y * pitch);
+        for (int x = 0; x < PPU_SCREEN_WIDTH; x++) {
+            dst[x] = table[src[x] & 0x3F];
+        }
+    }
+}
+
 bool ppu_frame_complete(ppu_s *ppu)
 {
     assert(ppu != NULL);
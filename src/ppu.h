@@ -100,10 +100,17 @@ typedef enum {
 //   Byte 3: X position
 //
 #define OAM_SIZE 256
+#define SECONDARY_OAM_SIZE 32
+#define SPRITES_PER_LINE   8
 #define PPU_VRAM_SIZE     2048
 #define PPU_PALETTE_SIZE  32
 #define PPU_SCREEN_WIDTH  256
 #define PPU_SCREEN_HEIGHT 240
+#define PPU_CHR_SIZE      0x2000
+#define PPU_PATTERN_TILES (PPU_CHR_SIZE / 16)
+// CHR is mapped in 1KB banks, the smallest unit mappers switch
+#define PPU_CHR_BANK_SIZE 0x0400
+#define PPU_CHR_BANKS     (PPU_CHR_SIZE / PPU_CHR_BANK_SIZE)
 
 // https://www.nesdev.org/wiki/Mirroring
 typedef enum {
@@ -129,20 +136,61 @@ typedef struct {
     byte_t oam[OAM_SIZE];
     byte_t vram[PPU_VRAM_SIZE];
     byte_t palette[PPU_PALETTE_SIZE];
-
-    byte_t *chr_rom;
-    size_t chr_rom_size;
     mirroring_mode_e mirroring;
 
     uint16_t cycle;
     int16_t scanline;
     bool nmi_pending;
-
-    uint32_t framebuffer[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
     bool frame_complete;
+
+    // Background pipeline: palette indices (0 = transparent) for the 8 dots
+    // of the current tile slot, plus the prefetched tile that follows it
+    byte_t bg_pixels[8];
+    word_t bg_next_addr;
+    byte_t bg_next_row[8];
+    byte_t bg_next_palette;
+    bool bg_next_valid;
+
+    // https://www.nesdev.org/wiki/PPU_sprite_evaluation
+    // Sprites found for the current line, and their pixels merged into a
+    // line buffer (see PPU_SPRITE_PIXEL_* in ppu.c; 0 = transparent)
+    byte_t secondary_oam[SECONDARY_OAM_SIZE];
+    byte_t sprite_count;
+    bool sprite_zero_on_line;
+    byte_t sprite_line[PPU_SCREEN_WIDTH];
+
+    // Everything above is saved in save states as one block (see
+    // PPU_SAVED_BYTES); everything below comes from the cart or is output
+
+    // Memory behind each 1KB of $0000-$1FFF, or NULL for none
+    byte_t *chr_banks[PPU_CHR_BANKS];
+    bool chr_writable;
+
+    // https://www.nesdev.org/wiki/PPU_pattern_tables
+    // Tiles of $0000-$1FFF expanded to one 2-bit colour per byte, 8 rows of
+    // 8. A tile is decoded on first use after a CHR load or write to it.
+    byte_t pattern_cache[PPU_PATTERN_TILES][64];
+    byte_t pattern_valid[PPU_PATTERN_TILES / 8];
+
+    // https://www.nesdev.org/wiki/MMC3#IRQ_Specifics
+    // Called at dot 260 of every rendered line, where PPU A12 rises when
+    // sprites use the $1000 pattern table; NULL when the cart doesn't count
+    // scanlines
+    void (*scanline_hook)(void *context);
+    void *scanline_hook_context;
+
+    // For frames nobody will see, e.g. run-ahead: lines are fetched and
+    // scrolled as usual, but pixels are only composed on lines where sprite
+    // 0 could still hit, so the framebuffer holds a stale picture
+    bool skip_output;
+
+    // NES colour indices ($00-$3F); ppu_framebuffer_to_argb converts them,
+    // applying the emphasis bits of PPUMASK latched for each line
+    byte_t framebuffer[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    byte_t line_emphasis[PPU_SCREEN_HEIGHT];
 } ppu_s;
 
-ppu_s* ppu_get_instance(void);
+#define PPU_SAVED_BYTES offsetof(ppu_s, chr_banks)
 
 bool ppu_get_ctrl_flag(ppu_s *ppu, ppu_ctrl_flag_e flag);
 void ppu_set_ctrl_flag(ppu_s *ppu, ppu_ctrl_flag_e flag, bool value);
@@ -156,11 +204,20 @@ void ppu_reset(ppu_s *ppu);
 byte_t ppu_read(ppu_s *ppu, ppu_register_e reg);
 void ppu_write(ppu_s *ppu, ppu_register_e reg, byte_t value);
 void ppu_load_chr_rom(ppu_s *ppu, byte_t *chr_rom, size_t size);
+void ppu_load_chr_ram(ppu_s *ppu, byte_t *chr_ram, size_t size);
+void ppu_set_chr_bank(ppu_s *ppu, int bank, byte_t *mem);
+void ppu_invalidate_pattern_cache(ppu_s *ppu);
+const byte_t *ppu_get_pattern_tile(ppu_s *ppu, int tile);
 void ppu_set_mirroring(ppu_s *ppu, mirroring_mode_e mode);
 byte_t ppu_vram_read(ppu_s *ppu, word_t addr);
 void ppu_vram_write(ppu_s *ppu, word_t addr, byte_t value);
 void ppu_tick(ppu_s *ppu);
-uint32_t *ppu_get_framebuffer(ppu_s *ppu);
+void ppu_run(ppu_s *ppu, size_t dots);
+size_t ppu_dots_until_vblank(const ppu_s *ppu);
+size_t ppu_dots_until_status_change(const ppu_s *ppu);
+size_t ppu_dots_until_scanline_hook(const ppu_s *ppu, unsigned count);
+byte_t *ppu_get_framebuffer(ppu_s *ppu);
+void ppu_framebuffer_to_argb(const ppu_s *ppu, uint32_t *pixels, size_t pitch);
 bool ppu_frame_complete(ppu_s *ppu);
 
 #endif
@@ -688,6 +688,70 @@ void test_chr_rom_read(void) {
 }
 
 
+void test_pattern_tile_decodes_both_planes(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    test_chr_rom[0x1010 + 2] = 0x81;  // Tile 257, row 2, low plane
+    test_chr_rom[0x1018 + 2] = 0x01;  // High plane
+    ppu_load_chr_rom(sut, test_chr_rom, sizeof(test_chr_rom));
+
+    const byte_t *tile = ppu_get_pattern_tile(sut, 257);
+
+    TEST_ASSERT_EQUAL_UINT8(1, tile[2 * 8 + 0]);
+    TEST_ASSERT_EQUAL_UINT8(0, tile[2 * 8 + 1]);
+    TEST_ASSERT_EQUAL_UINT8(3, tile[2 * 8 + 7]);
+    TEST_ASSERT_EQUAL_UINT8(0, tile[0]);
+}
+
+void test_chr_rom_writes_are_ignored(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    ppu_load_chr_rom(sut, test_chr_rom, sizeof(test_chr_rom));
+
+    ppu_vram_write(sut, 0x0010, 0xFF);
+
+    TEST_ASSERT_EQUAL_HEX8(0x00, test_chr_rom[0x0010]);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 1)[0]);
+}
+
+void test_chr_ram_write_redecodes_only_that_tile(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    ppu_load_chr_ram(sut, test_chr_rom, sizeof(test_chr_rom));
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 1)[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 2)[0]);
+
+    ppu_vram_write(sut, 0x0010, 0xFF);
+    test_chr_rom[0x0020] = 0xFF;  // Behind the PPU's back: stays cached
+
+    TEST_ASSERT_EQUAL_HEX8(0xFF, ppu_vram_read(sut, 0x0010));
+    TEST_ASSERT_EQUAL_UINT8(1, ppu_get_pattern_tile(sut, 1)[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 2)[0]);
+}
+
+void test_chr_bank_switch_redecodes_only_that_bank(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    memset(&test_chr_rom[0x1C00], 0xFF, 8);
+    ppu_load_chr_rom(sut, test_chr_rom, sizeof(test_chr_rom));
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 0)[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 64)[0]);
+    test_chr_rom[0x0000] = 0xFF;  // Bank 0 isn't switched: stays cached
+
+    ppu_set_chr_bank(sut, 1, &test_chr_rom[0x1C00]);
+
+    TEST_ASSERT_EQUAL_HEX8(0xFF, ppu_vram_read(sut, 0x0400));
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 0)[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, ppu_get_pattern_tile(sut, 64)[0]);
+}
+
+void test_chr_ram_write_redecodes_every_bank_mapping_it(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    ppu_load_chr_ram(sut, test_chr_rom, sizeof(test_chr_rom));
+    ppu_set_chr_bank(sut, 4, test_chr_rom);
+    TEST_ASSERT_EQUAL_UINT8(0, ppu_get_pattern_tile(sut, 256)[0]);
+
+    ppu_vram_write(sut, 0x0000, 0xFF);
+
+    TEST_ASSERT_EQUAL_UINT8(1, ppu_get_pattern_tile(sut, 256)[0]);
+}
+
 void test_ppu_cycle_increments(void) {
     TEST_ASSERT_EQUAL_INT(0, sut->cycle);
     ppu_tick(sut);
@@ -777,6 +841,245 @@ void test_nmi_not_triggered_when_nmi_disabled(void) {
     TEST_ASSERT_TRUE(ppu_get_status_flag(sut, PPUSTATUS_VBLANK));
 }
 
+static ppu_s reference_ppu;
+
+static void setup_scrolled_background(ppu_s *p) {
+    for (int i = 0; i < (int)sizeof(test_chr_rom); i++) {
+        test_chr_rom[i] = (byte_t)(i * 7 + (i >> 4));
+    }
+    ppu_load_chr_rom(p, test_chr_rom, sizeof(test_chr_rom));
+    for (int i = 0; i < PPU_VRAM_SIZE; i++) {
+        p->vram[i] = (byte_t)(i * 13);
+    }
+    for (int i = 0; i < PPU_PALETTE_SIZE; i++) {
+        p->palette[i] = (byte_t)(i * 3);
+    }
+    p->mask_register = PPUMASK_BG_ENABLE | PPUMASK_BG_LEFT;
+    p->temp_addr = 0x0123;
+    p->fine_x = 3;
+}
+
+void test_ppu_run_matches_single_ticks(void) {
+    ppu_init(&reference_ppu);
+    setup_scrolled_background(&reference_ppu);
+    setup_scrolled_background(sut);
+
+    const size_t frame_dots = 341 * 262;
+    for (size_t i = 0; i < frame_dots + 1000; i++) {
+        ppu_tick(&reference_ppu);
+    }
+    // Uneven chunks so spans start and stop mid-scanline
+    size_t remaining = frame_dots + 1000;
+    for (size_t chunk = 1; remaining > 0; chunk = chunk * 3 % 997 + 1) {
+        size_t dots = chunk < remaining ? chunk : remaining;
+        ppu_run(sut, dots);
+        remaining -= dots;
+    }
+
+    TEST_ASSERT_EQUAL_INT(reference_ppu.scanline, sut->scanline);
+    TEST_ASSERT_EQUAL_INT(reference_ppu.cycle, sut->cycle);
+    TEST_ASSERT_EQUAL_HEX16(reference_ppu.vram_addr, sut->vram_addr);
+    TEST_ASSERT_EQUAL_HEX8(reference_ppu.status_register, sut->status_register);
+    TEST_ASSERT_TRUE(memcmp(reference_ppu.framebuffer, sut->framebuffer, sizeof(sut->framebuffer)) == 0);
+}
+
+void test_skip_output_runs_like_drawing_without_pixels(void) {
+    ppu_init(&reference_ppu);
+    setup_scrolled_background(&reference_ppu);
+    setup_scrolled_background(sut);
+    for (ppu_s *p = &reference_ppu; p; p = (p == sut) ? NULL : sut) {
+        memset(p->oam, 0xFF, OAM_SIZE);
+        p->oam[0] = 50;  // Sprite 0 on lines 51-58, over the background
+        p->oam[1] = 0x01;
+        p->oam[3] = 100;
+        p->mask_register |= PPUMASK_SPRITE_ENABLE | PPUMASK_SPRITE_LEFT;
+    }
+    sut->skip_output = true;
+
+    // Stop before the pre-render line clears the hit
+    ppu_run(&reference_ppu, 341 * 130);
+    ppu_run(sut, 341 * 130);
+
+    TEST_ASSERT_TRUE(ppu_get_status_flag(&reference_ppu, PPUSTATUS_SPRITE0_HIT));
+    TEST_ASSERT_EQUAL_MEMORY(&reference_ppu, sut, PPU_SAVED_BYTES);
+    const byte_t *line = &sut->framebuffer[100 * PPU_SCREEN_WIDTH];
+    const byte_t *reference_line = &reference_ppu.framebuffer[100 * PPU_SCREEN_WIDTH];
+    byte_t blank[PPU_SCREEN_WIDTH] = {0};
+    TEST_ASSERT_EQUAL_MEMORY(blank, line, PPU_SCREEN_WIDTH);
+    TEST_ASSERT_TRUE(memcmp(blank, reference_line, PPU_SCREEN_WIDTH) != 0);
+}
+
+void test_fine_x_scroll_reaches_into_next_tile(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    memset(&test_chr_rom[16], 0xFF, 8);  // Tile 1: colour 1 on every row
+    ppu_load_chr_rom(sut, test_chr_rom, sizeof(test_chr_rom));
+    sut->vram[1] = 0x01;
+    sut->palette[0] = 0x0F;
+    sut->palette[1] = 0x30;
+    sut->mask_register = PPUMASK_BG_ENABLE | PPUMASK_BG_LEFT;
+    sut->fine_x = 3;
+
+    ppu_run(sut, 341 + 256);  // Pre-render line, then visible line 0
+
+    byte_t backdrop = sut->framebuffer[0];
+    TEST_ASSERT_EQUAL_HEX8(backdrop, sut->framebuffer[4]);
+    TEST_ASSERT_NOT_EQUAL(backdrop, sut->framebuffer[5]);
+    TEST_ASSERT_EQUAL_HEX8(sut->framebuffer[5], sut->framebuffer[12]);
+    TEST_ASSERT_EQUAL_HEX8(backdrop, sut->framebuffer[13]);
+}
+
+static void setup_sprite_test(void) {
+    memset(test_chr_rom, 0, sizeof(test_chr_rom));
+    memset(&test_chr_rom[0x20], 0xFF, 8);  // Tile 2: colour 1 on every row
+    ppu_load_chr_rom(sut, test_chr_rom, sizeof(test_chr_rom));
+    memset(sut->oam, 0xFF, OAM_SIZE);  // Park every sprite below the screen
+    sut->palette[0] = 0x0F;
+    sut->palette[1] = 0x20;
+    sut->palette[0x11] = 0x16;
+    sut->mask_register = PPUMASK_SPRITE_ENABLE | PPUMASK_SPRITE_LEFT;
+}
+
+static void place_sprite(int n, byte_t y, byte_t tile, byte_t attr, byte_t x) {
+    sut->oam[n * 4 + 0] = y;
+    sut->oam[n * 4 + 1] = tile;
+    sut->oam[n * 4 + 2] = attr;
+    sut->oam[n * 4 + 3] = x;
+}
+
+// From the pre-render line at dot 0 to the last visible dot of line
+static void run_through_line(int line) {
+    ppu_run(sut, 341 * (line + 1) + 256);
+}
+
+void test_sprite_drawn_one_line_below_oam_y(void) {
+    setup_sprite_test();
+    place_sprite(0, 9, 0x02, 0x00, 20);
+
+    run_through_line(10);
+
+    byte_t backdrop = sut->framebuffer[0];
+    byte_t *line9 = &sut->framebuffer[9 * PPU_SCREEN_WIDTH];
+    byte_t *line10 = &sut->framebuffer[10 * PPU_SCREEN_WIDTH];
+    TEST_ASSERT_EQUAL_HEX8(backdrop, line9[20]);
+    TEST_ASSERT_EQUAL_HEX8(backdrop, line10[19]);
+    TEST_ASSERT_NOT_EQUAL(backdrop, line10[20]);
+    TEST_ASSERT_EQUAL_HEX8(line10[20], line10[27]);
+    TEST_ASSERT_EQUAL_HEX8(backdrop, line10[28]);
+}
+
+void test_sprite_overflow_set_by_ninth_sprite_on_line(void) {
+    setup_sprite_test();
+    for (int n = 0; n < 8; n++) {
+        place_sprite(n, 9, 0x02, 0x00, (byte_t)(n * 16));
+    }
+    run_through_line(10);
+    TEST_ASSERT_FALSE(ppu_get_status_flag(sut, PPUSTATUS_OVERFLOW));
+    TEST_ASSERT_EQUAL_INT(8, sut->sprite_count);
+
+    ppu_init(sut);
+    setup_sprite_test();
+    for (int n = 0; n < 9; n++) {
+        place_sprite(n, 9, 0x02, 0x00, (byte_t)(n * 16));
+    }
+    run_through_line(10);
+    TEST_ASSERT_TRUE(ppu_get_status_flag(sut, PPUSTATUS_OVERFLOW));
+    TEST_ASSERT_EQUAL_INT(8, sut->sprite_count);
+
+    // The ninth sprite is not drawn
+    byte_t *line10 = &sut->framebuffer[10 * PPU_SCREEN_WIDTH];
+    TEST_ASSERT_EQUAL_HEX8(sut->framebuffer[0], line10[8 * 16]);
+}
+
+void test_sprite_zero_hit_needs_opaque_background(void) {
+    setup_sprite_test();
+    place_sprite(0, 9, 0x02, 0x00, 40);
+    sut->mask_register |= PPUMASK_BG_ENABLE | PPUMASK_BG_LEFT;
+
+    run_through_line(10);
+    TEST_ASSERT_FALSE(ppu_get_status_flag(sut, PPUSTATUS_SPRITE0_HIT));
+
+    ppu_init(sut);
+    setup_sprite_test();
+    place_sprite(0, 9, 0x02, 0x00, 40);
+    sut->mask_register |= PPUMASK_BG_ENABLE | PPUMASK_BG_LEFT;
+    memset(sut->vram, 0x02, 0x3C0);  // Opaque background everywhere
+
+    run_through_line(10);
+    TEST_ASSERT_TRUE(ppu_get_status_flag(sut, PPUSTATUS_SPRITE0_HIT));
+}
+
+void test_sprite_behind_background_only_shows_through_transparent_pixels(void) {
+    setup_sprite_test();
+    place_sprite(0, 9, 0x02, 0x20, 4);
+    sut->mask_register |= PPUMASK_BG_ENABLE | PPUMASK_BG_LEFT;
+    sut->vram[(10 / 8) * 32 + 0] = 0x02;  // Opaque tile under the sprite's left half
+
+    run_through_line(10);
+
+    byte_t backdrop = sut->framebuffer[0];
+    byte_t *line10 = &sut->framebuffer[10 * PPU_SCREEN_WIDTH];
+    TEST_ASSERT_NOT_EQUAL(backdrop, line10[0]);
+    TEST_ASSERT_EQUAL_HEX8(line10[0], line10[4]);
+    TEST_ASSERT_NOT_EQUAL(backdrop, line10[8]);
+    TEST_ASSERT_NOT_EQUAL(line10[0], line10[8]);
+}
+
+void test_8x16_sprite_takes_bank_from_tile_index(void) {
+    setup_sprite_test();
+    memset(&test_chr_rom[0x1030], 0xFF, 8);  // Tile $13: bottom half of $03
+    sut->ctrl_register = PPUCTRL_SPRITE_SIZE;
+    place_sprite(0, 9, 0x03, 0x00, 20);
+
+    run_through_line(18);
+
+    byte_t backdrop = sut->framebuffer[0];
+    TEST_ASSERT_EQUAL_HEX8(backdrop, sut->framebuffer[10 * PPU_SCREEN_WIDTH + 20]);
+    TEST_ASSERT_NOT_EQUAL(backdrop, sut->framebuffer[18 * PPU_SCREEN_WIDTH + 20]);
+}
+
+void test_framebuffer_to_argb_applies_line_emphasis(void) {
+    static uint32_t argb[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    sut->framebuffer[0] = 0x30;
+    sut->framebuffer[PPU_SCREEN_WIDTH] = 0x30;
+    sut->line_emphasis[1] = PPUMASK_EMPHASIZE_R >> 5;
+
+    ppu_framebuffer_to_argb(sut, argb, PPU_SCREEN_WIDTH * sizeof(uint32_t));
+
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFEFF, argb[0]);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFCFD0, argb[PPU_SCREEN_WIDTH]);
+}
+
+void test_ppu_run_skips_vblank_lines_to_prerender_event(void) {
+    sut->scanline = 241;
+    sut->cycle = 1;
+    ppu_set_status_flag(sut, PPUSTATUS_VBLANK, true);
+
+    ppu_run(sut, 341 * 20 - 1);
+    TEST_ASSERT_EQUAL_INT(261, sut->scanline);
+    TEST_ASSERT_EQUAL_INT(0, sut->cycle);
+    TEST_ASSERT_TRUE(ppu_get_status_flag(sut, PPUSTATUS_VBLANK));
+
+    ppu_run(sut, 1);
+    TEST_ASSERT_EQUAL_INT(1, sut->cycle);
+    TEST_ASSERT_FALSE(ppu_get_status_flag(sut, PPUSTATUS_VBLANK));
+}
+
+void test_ppu_dots_until_vblank(void) {
+    sut->scanline = 241;
+    sut->cycle = 0;
+    TEST_ASSERT_EQUAL_INT(1, ppu_dots_until_vblank(sut));
+
+    sut->cycle = 1;
+    TEST_ASSERT_EQUAL_INT(341 * 262, ppu_dots_until_vblank(sut));
+
+    sut->scanline = 261;
+    sut->cycle = 0;
+    TEST_ASSERT_EQUAL_INT(341 * 242 + 1, ppu_dots_until_vblank(sut));
+
+    ppu_run(sut, ppu_dots_until_vblank(sut));
+    TEST_ASSERT_TRUE(ppu_get_status_flag(sut, PPUSTATUS_VBLANK));
+}
+
 
 static bus_s test_bus;
 
@@ -1031,6 +1334,11 @@ int main(void) {
 
     
     RUN_TEST(test_chr_rom_read);
+    RUN_TEST(test_pattern_tile_decodes_both_planes);
+    RUN_TEST(test_chr_rom_writes_are_ignored);
+    RUN_TEST(test_chr_ram_write_redecodes_only_that_tile);
+    RUN_TEST(test_chr_bank_switch_redecodes_only_that_bank);
+    RUN_TEST(test_chr_ram_write_redecodes_every_bank_mapping_it);
 
     
     RUN_TEST(test_ppu_cycle_increments);
@@ -1040,6 +1348,19 @@ int main(void) {
     RUN_TEST(test_vblank_flag_cleared_at_prerender);
     RUN_TEST(test_nmi_triggered_when_vblank_and_nmi_enabled);
     RUN_TEST(test_nmi_not_triggered_when_nmi_disabled);
+    RUN_TEST(test_ppu_run_matches_single_ticks);
+    RUN_TEST(test_skip_output_runs_like_drawing_without_pixels);
+    RUN_TEST(test_fine_x_scroll_reaches_into_next_tile);
+    RUN_TEST(test_ppu_dots_until_vblank);
+    RUN_TEST(test_ppu_run_skips_vblank_lines_to_prerender_event);
+    RUN_TEST(test_framebuffer_to_argb_applies_line_emphasis);
+
+    
+    RUN_TEST(test_sprite_drawn_one_line_below_oam_y);
+    RUN_TEST(test_sprite_overflow_set_by_ninth_sprite_on_line);
+    RUN_TEST(test_sprite_zero_hit_needs_opaque_background);
+    RUN_TEST(test_sprite_behind_background_only_shows_through_transparent_pixels);
+    RUN_TEST(test_8x16_sprite_takes_bank_from_tile_index);
 
     
     RUN_TEST(test_oam_dma_copies_256_bytes);
@@ -0,0 +1,280 @@
+#include "rewind.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A delta is a sequence of tokens, each a u16 count of bytes to leave alone,
+// a u16 count of literal bytes and the literals, which are XORed into the
+// state. Equal runs shorter than a token header are folded into the literal.
+#define DELTA_TOKEN_BYTES (2 * sizeof(uint16_t))
+#define DELTA_MIN_SKIP    DELTA_TOKEN_BYTES
+#define DELTA_MAX_SKIP    UINT16_MAX
+#define DELTA_MAX_LITERAL (UINT16_MAX - DELTA_MIN_SKIP)
+
+// Every frame moves the CPU cycle count, the scheduler and the PPU, so a
+// delta is never just a few bytes; the index is sized on that assumption
+// and evicts early if it is wrong
+#define REWIND_MIN_DELTA_BYTES 32
+
+typedef struct {
+    size_t offset;
+    size_t size;
+} rewind_delta_s;
+
+struct rewind_buffer_s {
+    size_t state_size;
+    unsigned interval;
+    unsigned frames_until_capture;
+
+    // Newest snapshot, whole, and scratch for capturing the next one
+    byte_t *latest;
+    byte_t *incoming;
+    bool has_latest;
+    byte_t *encoded;
+
+    // Deltas back from latest, oldest first, in a ring of bytes indexed by
+    // a ring of rewind_delta_s
+    byte_t *ring;
+    size_t ring_size;
+    size_t ring_used;
+    rewind_delta_s *deltas;
+    size_t max_deltas;
+    size_t oldest;
+    size_t count;
+};
+
+rewind_buffer_s *rewind_buffer_create(const nes_console_s *nes, size_t capacity_bytes, unsigned interval)
+{
+    assert(nes != NULL && interval > 0);
+    rewind_buffer_s *history = calloc(1, sizeof(*history));
+    if (!history) {
+        return NULL;
+    }
+    history->state_size = nes_save_state_size(nes);
+    history->interval = interval;
+    history->frames_until_capture = 1;
+    history->ring_size = capacity_bytes;
+    history->max_deltas = capacity_bytes / REWIND_MIN_DELTA_BYTES + 1;
+
+    // Worst case, alternating single changed bytes and minimal skips, a
+    // delta needs one token per DELTA_MIN_SKIP + 1 bytes of state
+    size_t max_encoded = history->state_size +
+                         (history->state_size / (DELTA_MIN_SKIP + 1) + 2) * DELTA_TOKEN_BYTES;
+    history->latest = malloc(history->state_size);
+    history->incoming = malloc(history->state_size);
+    history->encoded = malloc(max_encoded);
+    history->ring = malloc(capacity_bytes);
+    history->deltas = malloc(history->max_deltas * sizeof(*history->deltas));
+    if (!history->latest || !history->incoming || !history->encoded || !history->ring || !history->deltas) {
+        rewind_buffer_destroy(history);
+        return NULL;
+    }
+    return history;
+}
+
+void rewind_buffer_destroy(rewind_buffer_s *history)
+{
+    if (!history) {
+        return;
+    }
+    free(history->latest);
+    free(history->incoming);
+    free(history->encoded);
+    free(history->ring);
+    free(history->deltas);
+    free(history);
+}
+
+// Length of the run of equal bytes at the start of a and b, up to max;
+// most of a state is unchanged from one frame to the next, so compare a
+// word at a time
+static size_t equal_run(const byte_t *a, const byte_t *b, size_t max)
+{
+    size_t n = 0;
+    while (n + sizeof(uint64_t) <= max) {
+        uint64_t x, y;
+        memcpy(&x, a + n, sizeof(x));
+        memcpy(&y, b + n, sizeof(y));
+        if (x != y) {
+            break;
+        }
+        n += sizeof(uint64_t);
+    }
+    while (n < max && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+static void put_u16(byte_t *out, size_t value)
+{
+    uint16_t v = (uint16_t)value;
+    memcpy(out, &v, sizeof(v));
+}
+
+static size_t get_u16(const byte_t *in)
+{
+    uint16_t v;
+    memcpy(&v, in, sizeof(v));
+    return v;
+}
+
+// Encodes newer XOR older into out; returns its length
+static size_t encode_delta(const byte_t *newer, const byte_t *older, size_t size, byte_t *out)
+{
+    size_t pos = 0;
+    size_t len = 0;
+    while (pos < size) {
+        size_t rest = size - pos;
+        size_t skip = equal_run(&newer[pos], &older[pos], rest < DELTA_MAX_SKIP ? rest : DELTA_MAX_SKIP);
+        pos += skip;
+
+        size_t literal = 0;
+        while (pos + literal < size && literal < DELTA_MAX_LITERAL) {
+            rest = size - pos - literal;
+            size_t equal = equal_run(&newer[pos + literal], &older[pos + literal],
+                                     rest < DELTA_MIN_SKIP ? rest : DELTA_MIN_SKIP);
+            if (equal == DELTA_MIN_SKIP || equal == rest) {
+                break;
+            }
+            literal += equal + 1;
+        }
+        if (literal == 0 && pos == size) {
+            break;
+        }
+
+        put_u16(&out[len], skip);
+        put_u16(&out[len + 2], literal);
+        len += DELTA_TOKEN_BYTES;
+        for (size_t i = 0; i < literal; i++) {
+            out[len + i] = newer[pos + i] ^ older[pos + i];
+        }
+        len += literal;
+        pos += literal;
+    }
+    return len;
+}
+
+// XORs a delta into state, turning one end of it into the other
+static void apply_delta(byte_t *state, const byte_t *delta, size_t len)
+{
+    size_t pos = 0;
+    const byte_t *end = delta + len;
+    while (delta < end) {
+        pos += get_u16(delta);
+        size_t literal = get_u16(delta + 2);
+        delta += DELTA_TOKEN_BYTES;
+        for (size_t i = 0; i < literal; i++) {
+            state[pos + i] ^= delta[i];
+        }
+        delta += literal;
+        pos += literal;
+    }
+}
+
+static rewind_delta_s *delta_at(rewind_buffer_s *history, size_t index)
+{
+    return &history->deltas[(history->oldest + index) % history->max_deltas];
+}
+
+static void drop_oldest(rewind_buffer_s *history)
+{
+    history->ring_used -= history->deltas[history->oldest].size;
+    history->oldest = (history->oldest + 1) % history->max_deltas;
+    history->count--;
+}
+
+static bool overlaps(const rewind_delta_s *delta, size_t offset, size_t size)
+{
+    return delta->offset < offset + size && offset < delta->offset + delta->size;
+}
+
+// Appends after the newest delta, wrapping to the start of the ring when it
+// doesn't fit, and evicts the oldest deltas in the way
+static void push_delta(rewind_buffer_s *history, const byte_t *data, size_t size)
+{
+    if (size > history->ring_size) {
+        // Nothing older than latest can be reached any more
+        while (history->count > 0) {
+            drop_oldest(history);
+        }
+        return;
+    }
+
+    size_t offset = 0;
+    if (history->count > 0) {
+        const rewind_delta_s *newest = delta_at(history, history->count - 1);
+        offset = newest->offset + newest->size;
+        if (offset + size > history->ring_size) {
+            // Deltas past the newest are older than the ones at the start
+            while (history->count > 0 && history->deltas[history->oldest].offset >= offset) {
+                drop_oldest(history);
+            }
+            offset = 0;
+        }
+    }
+    while (history->count > 0 &&
+           (history->count == history->max_deltas || overlaps(&history->deltas[history->oldest], offset, size))) {
+        drop_oldest(history);
+    }
+
+    memcpy(&history->ring[offset], data, size);
+    history->count++;
+    rewind_delta_s *delta = delta_at(history, history->count - 1);
+    delta->offset = offset;
+    delta->size = size;
+    history->ring_used += size;
+}
+
+void rewind_buffer_capture(rewind_buffer_s *history, const nes_console_s *nes)
+{
+    assert(history != NULL && nes != NULL);
+    if (--history->frames_until_capture > 0) {
+        return;
+    }
+    history->frames_until_capture = history->interval;
+
+    size_t size = nes_save_state(nes, history->incoming, history->state_size);
+    assert(size == history->state_size);
+    if (history->has_latest) {
+        size_t len = encode_delta(history->incoming, history->latest, size, history->encoded);
+        push_delta(history, history->encoded, len);
+    }
+
+    byte_t *previous = history->latest;
+    history->latest = history->incoming;
+    history->incoming = previous;
+    history->has_latest = true;
+}
+
+bool rewind_buffer_step_back(rewind_buffer_s *history, nes_console_s *nes)
+{
+    assert(history != NULL && nes != NULL);
+    if (!history->has_latest || !nes_load_state(nes, history->latest, history->state_size)) {
+        return false;
+    }
+
+    if (history->count > 0) {
+        rewind_delta_s *newest = delta_at(history, history->count - 1);
+        apply_delta(history->latest, &history->ring[newest->offset], newest->size);
+        history->ring_used -= newest->size;
+        history->count--;
+    } else {
+        history->has_latest = false;
+    }
+    history->frames_until_capture = history->interval;
+    return true;
+}
+
+size_t rewind_buffer_snapshots(const rewind_buffer_s *history)
+{
+    assert(history != NULL);
+    return history->has_latest ? history->count + 1 : 0;
+}
+
+size_t rewind_buffer_bytes_used(const rewind_buffer_s *history)
+{
+    assert(history != NULL);
+    return history->ring_used;
+}
@@ -0,0 +1,36 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "nes.h"
+
+// History of save states for stepping a console backwards.
+//
+// Every interval frames rewind_buffer_capture takes a save state. The newest
+// is kept whole; older ones are kept as deltas, each the newer state XORed
+// with the one before it and run-length encoded, so a snapshot costs roughly
+// the bytes that changed since the previous one. Deltas live in a fixed-size
+// ring and the oldest are evicted to make room.
+
+#define REWIND_DEFAULT_INTERVAL 1
+
+typedef struct rewind_buffer_s rewind_buffer_s;
+
+// The buffer only holds states of nes's current cart; create a new one after
+// attaching another
+rewind_buffer_s *rewind_buffer_create(const nes_console_s *nes, size_t capacity_bytes, unsigned interval);
+void rewind_buffer_destroy(rewind_buffer_s *history);
+
+// Call once per emulated frame
+void rewind_buffer_capture(rewind_buffer_s *history, const nes_console_s *nes);
+// Loads the newest snapshot into nes and forgets it, so repeated calls walk
+// back through history. Returns false when there is nothing left.
+bool rewind_buffer_step_back(rewind_buffer_s *history, nes_console_s *nes);
+
+// Snapshots that rewind_buffer_step_back can still return to
+size_t rewind_buffer_snapshots(const rewind_buffer_s *history);
+// Bytes of the ring holding deltas
+size_t rewind_buffer_bytes_used(const rewind_buffer_s *history);
+
+#endif
@@ -0,0 +1,171 @@
+#include <string.h>
+#include "unity.h"
+#include "nes.h"
+#include "gamecart.h"
+#include "rewind.h"
+
+#define TEST_PRG_ROM_SIZE (32 * 1024)
+#define TEST_FRAMES 20
+#define TEST_CAPACITY (64 * 1024)
+
+
+static nes_console_s *console = NULL;
+static rewind_buffer_s *history = NULL;
+static gamecart_s cart;
+static byte_t prg_rom[TEST_PRG_ROM_SIZE];
+static byte_t prg_ram[0x2000];
+static size_t frame_cycles[TEST_FRAMES];
+static byte_t frame_counter[TEST_FRAMES];
+
+
+// Loops writing RAM and PRG RAM while an NMI handler counts frames in $11
+static void attach_test_cart(void) {
+    const byte_t program[] = {
+        0xA9, 0x80,             // $8000: LDA #$80
+        0x8D, 0x00, 0x20,       //        STA $2000
+        0xE6, 0x10,             // $8005: INC $10
+        0xA6, 0x10,             //        LDX $10
+        0xFE, 0x00, 0x02,       //        INC $0200,X
+        0x9D, 0x00, 0x60,       //        STA $6000,X
+        0x4C, 0x05, 0x80,       //        JMP $8005
+    };
+    const byte_t handler[] = {
+        0xE6, 0x11,             // $9000: INC $11
+        0x40,                   //        RTI
+    };
+    memset(prg_rom, 0xEA, sizeof(prg_rom));
+    memcpy(prg_rom, program, sizeof(program));
+    memcpy(&prg_rom[0x1000], handler, sizeof(handler));
+    prg_rom[0x7FFA] = 0x00;
+    prg_rom[0x7FFB] = 0x90;
+    memset(prg_ram, 0, sizeof(prg_ram));
+
+    memset(&cart, 0, sizeof(cart));
+    cart.rom.prg_rom = prg_rom;
+    cart.rom.prg_rom_bytes = TEST_PRG_ROM_SIZE;
+    cart.prg_ram = prg_ram;
+    cart.prg_ram_size = sizeof(prg_ram);
+    cart.mirroring = MIRROR_HORIZONTAL;
+    nes_attach_cart(console, &cart);
+    console->cpu->PC = 0x8000;
+}
+
+// Runs frames, capturing after each, and records where every frame ended
+static void run_and_capture(int frames) {
+    for (int i = 0; i < frames; i++) {
+        nes_run_frame(console);
+        rewind_buffer_capture(history, console);
+        frame_cycles[i] = console->cpu->cycles;
+        frame_counter[i] = console->bus->ram[0x11];
+    }
+}
+
+void setUp(void) {
+    console = nes_console_create();
+    attach_test_cart();
+}
+
+void tearDown(void) {
+    rewind_buffer_destroy(history);
+    history = NULL;
+    nes_console_destroy(console);
+    console = NULL;
+}
+
+
+void test_step_back_walks_through_every_snapshot(void) {
+    history = rewind_buffer_create(console, TEST_CAPACITY, 1);
+    run_and_capture(TEST_FRAMES);
+    TEST_ASSERT_EQUAL_UINT(TEST_FRAMES, rewind_buffer_snapshots(history));
+
+    for (int i = TEST_FRAMES - 1; i >= 0; i--) {
+        TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+        TEST_ASSERT_EQUAL_UINT(frame_cycles[i], console->cpu->cycles);
+        TEST_ASSERT_EQUAL_HEX8(frame_counter[i], console->bus->ram[0x11]);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, rewind_buffer_snapshots(history));
+    TEST_ASSERT_FALSE(rewind_buffer_step_back(history, console));
+}
+
+void test_rewound_console_replays_identically(void) {
+    static byte_t ram[BUS_RAM_SIZE];
+    static byte_t saved_prg_ram[sizeof(prg_ram)];
+    history = rewind_buffer_create(console, TEST_CAPACITY, 1);
+    run_and_capture(3);
+    nes_run_frame(console);
+    nes_run_frame(console);
+    memcpy(ram, console->bus->ram, sizeof(ram));
+    memcpy(saved_prg_ram, prg_ram, sizeof(saved_prg_ram));
+    size_t cycles = console->cpu->cycles;
+
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[2], console->cpu->cycles);
+    nes_run_frame(console);
+    nes_run_frame(console);
+    TEST_ASSERT_EQUAL_UINT(cycles, console->cpu->cycles);
+    TEST_ASSERT_EQUAL_MEMORY(ram, console->bus->ram, sizeof(ram));
+    TEST_ASSERT_EQUAL_MEMORY(saved_prg_ram, prg_ram, sizeof(saved_prg_ram));
+}
+
+void test_capture_interval_skips_frames(void) {
+    history = rewind_buffer_create(console, TEST_CAPACITY, 4);
+    run_and_capture(12);
+    TEST_ASSERT_EQUAL_UINT(3, rewind_buffer_snapshots(history));
+
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[8], console->cpu->cycles);
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[4], console->cpu->cycles);
+}
+
+void test_snapshots_are_stored_as_small_deltas(void) {
+    history = rewind_buffer_create(console, TEST_CAPACITY, 1);
+    run_and_capture(TEST_FRAMES);
+    size_t per_snapshot = rewind_buffer_bytes_used(history) / (TEST_FRAMES - 1);
+    TEST_ASSERT_TRUE(per_snapshot < nes_save_state_size(console) / 4);
+}
+
+void test_full_ring_evicts_oldest_snapshots(void) {
+    history = rewind_buffer_create(console, 1024, 1);
+    run_and_capture(TEST_FRAMES);
+    size_t snapshots = rewind_buffer_snapshots(history);
+    TEST_ASSERT_TRUE(snapshots > 1 && snapshots < TEST_FRAMES);
+    TEST_ASSERT_TRUE(rewind_buffer_bytes_used(history) <= 1024);
+
+    for (size_t i = 0; i < snapshots; i++) {
+        TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+        TEST_ASSERT_EQUAL_UINT(frame_cycles[TEST_FRAMES - 1 - i], console->cpu->cycles);
+        TEST_ASSERT_EQUAL_HEX8(frame_counter[TEST_FRAMES - 1 - i], console->bus->ram[0x11]);
+    }
+    TEST_ASSERT_FALSE(rewind_buffer_step_back(history, console));
+}
+
+void test_capture_after_step_back_continues_history(void) {
+    history = rewind_buffer_create(console, TEST_CAPACITY, 1);
+    run_and_capture(5);
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[3], console->cpu->cycles);
+
+    nes_run_frame(console);
+    rewind_buffer_capture(history, console);
+    TEST_ASSERT_EQUAL_UINT(4, rewind_buffer_snapshots(history));
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[4], console->cpu->cycles);
+    TEST_ASSERT_TRUE(rewind_buffer_step_back(history, console));
+    TEST_ASSERT_EQUAL_UINT(frame_cycles[2], console->cpu->cycles);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_step_back_walks_through_every_snapshot);
+    RUN_TEST(test_rewound_console_replays_identically);
+    RUN_TEST(test_capture_interval_skips_frames);
+    RUN_TEST(test_snapshots_are_stored_as_small_deltas);
+    RUN_TEST(test_full_ring_evicts_oldest_snapshots);
+    RUN_TEST(test_capture_after_step_back_continues_history);
+
+    return UNITY_END();
+}
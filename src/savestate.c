@@ -0,0 +1,160 @@
+#include "nes.h"
+#include "gamecart.h"
+#include "mapper.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// A save state is a header followed by raw copies of each component's saved
+// prefix (see CPU_SAVED_BYTES, BUS_SAVED_BYTES and PPU_SAVED_BYTES), then
+// PRG RAM, CHR RAM and the mapper registers. Nothing is serialized field by
+// field, so saving and loading are a handful of memcpys; the flip side is
+// that states only load into a build with the same struct layouts, which
+// the section sizes in the header check. Bump the version when a saved
+// field changes meaning without changing size.
+#define SAVE_STATE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t mapper_type;
+    uint32_t prg_rom_bytes;
+    uint32_t cpu_bytes;
+    uint32_t bus_bytes;
+    uint32_t ppu_bytes;
+    uint32_t prg_ram_bytes;
+    uint32_t chr_ram_bytes;
+    uint32_t mapper_bytes;
+} save_state_header_s;
+
+static save_state_header_s describe(const nes_console_s *nes)
+{
+    const gamecart_s *cart = nes->bus->cart;
+    save_state_header_s header = {
+        .magic = {'N', 'E', 'S', 'S'},
+        .version = SAVE_STATE_VERSION,
+        .cpu_bytes = CPU_SAVED_BYTES,
+        .bus_bytes = BUS_SAVED_BYTES,
+        .ppu_bytes = PPU_SAVED_BYTES,
+    };
+    if (cart) {
+        header.mapper_type = (uint16_t)cart->mapper_type;
+        header.prg_rom_bytes = (uint32_t)cart->rom.prg_rom_bytes;
+        header.prg_ram_bytes = cart->prg_ram ? (uint32_t)cart->prg_ram_size : 0;
+        header.chr_ram_bytes = cart->chr_ram ? (uint32_t)cart->chr_ram_size : 0;
+        header.mapper_bytes = cart->mapper ? sizeof(cart->mapper->regs) : 0;
+    }
+    return header;
+}
+
+static size_t total_size(const save_state_header_s *header)
+{
+    return sizeof(*header) + header->cpu_bytes + header->bus_bytes + header->ppu_bytes +
+           header->prg_ram_bytes + header->chr_ram_bytes + header->mapper_bytes;
+}
+
+size_t nes_save_state_size(const nes_console_s *nes)
+{
+    assert(nes != NULL);
+    save_state_header_s header = describe(nes);
+    return total_size(&header);
+}
+
+size_t nes_save_state(const nes_console_s *nes, void *buf, size_t size)
+{
+    assert(nes != NULL && buf != NULL);
+    save_state_header_s header = describe(nes);
+    size_t total = total_size(&header);
+    if (size < total) {
+        return 0;
+    }
+
+    const gamecart_s *cart = nes->bus->cart;
+    byte_t *out = buf;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, nes->cpu, header.cpu_bytes);
+    out += header.cpu_bytes;
+    memcpy(out, nes->bus, header.bus_bytes);
+    out += header.bus_bytes;
+    memcpy(out, nes->ppu, header.ppu_bytes);
+    out += header.ppu_bytes;
+    if (header.prg_ram_bytes) {
+        memcpy(out, cart->prg_ram, header.prg_ram_bytes);
+        out += header.prg_ram_bytes;
+    }
+    if (header.chr_ram_bytes) {
+        memcpy(out, cart->chr_ram, header.chr_ram_bytes);
+        out += header.chr_ram_bytes;
+    }
+    if (header.mapper_bytes) {
+        memcpy(out, &cart->mapper->regs, header.mapper_bytes);
+    }
+    return total;
+}
+
+// Rebuilds what is derived from the restored state: bank windows and page
+// tables from the mapper registers, and every cache that may describe
+// memory the load just overwrote
+static void rederive_state(nes_console_s *nes)
+{
+    bus_s *bus = nes->bus;
+    gamecart_s *cart = bus->cart;
+
+    if (cart && cart->mapper) {
+        byte_t *old_prg[MAPPER_PRG_WINDOWS];
+        memcpy(old_prg, cart->mapper->prg_windows, sizeof(old_prg));
+        mapper_update_banks(cart);
+        if (memcmp(old_prg, cart->mapper->prg_windows, sizeof(old_prg)) != 0) {
+            bus_map_pages(bus);
+        }
+        bus_map_chr(bus);
+    }
+    if (cart && cart->chr_ram) {
+        ppu_invalidate_pattern_cache(nes->ppu);
+    }
+
+    cpu_s *cpu = nes->cpu;
+    cpu_invalidate_fetch_page(cpu);
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
+    if (cpu->block_cache) {
+        cpu_block_cache_invalidate_writable(cpu->block_cache);
+    }
+}
+
+bool nes_load_state(nes_console_s *nes, const void *buf, size_t size)
+{
+    assert(nes != NULL && buf != NULL);
+    save_state_header_s expected = describe(nes);
+    save_state_header_s header;
+    if (size != total_size(&expected)) {
+        return false;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (memcmp(&header, &expected, sizeof(header)) != 0) {
+        return false;
+    }
+
+    gamecart_s *cart = nes->bus->cart;
+    const byte_t *in = (const byte_t *)buf + sizeof(header);
+    memcpy(nes->cpu, in, header.cpu_bytes);
+    in += header.cpu_bytes;
+    memcpy(nes->bus, in, header.bus_bytes);
+    in += header.bus_bytes;
+    memcpy(nes->ppu, in, header.ppu_bytes);
+    in += header.ppu_bytes;
+    if (header.prg_ram_bytes) {
+        memcpy(cart->prg_ram, in, header.prg_ram_bytes);
+        in += header.prg_ram_bytes;
+    }
+    if (header.chr_ram_bytes) {
+        memcpy(cart->chr_ram, in, header.chr_ram_bytes);
+        in += header.chr_ram_bytes;
+    }
+    if (header.mapper_bytes) {
+        memcpy(&cart->mapper->regs, in, header.mapper_bytes);
+    }
+
+    rederive_state(nes);
+    return true;
+}
@@ -0,0 +1,54 @@
+#include "scheduler.h"
+#include <assert.h>
+
+static void update_next(scheduler_s *scheduler)
+{
+    size_t next = SCHEDULER_NEVER;
+    for (int i = 0; i < SCHEDULER_EVENT_COUNT; i++) {
+        if (scheduler->deadlines[i] < next) {
+            next = scheduler->deadlines[i];
+        }
+    }
+    scheduler->next = next;
+}
+
+void scheduler_init(scheduler_s *scheduler)
+{
+    assert(scheduler != NULL);
+    for (int i = 0; i < SCHEDULER_EVENT_COUNT; i++) {
+        scheduler->deadlines[i] = SCHEDULER_NEVER;
+    }
+    scheduler->next = SCHEDULER_NEVER;
+}
+
+void scheduler_set(scheduler_s *scheduler, scheduler_event_e event, size_t cycle)
+{
+    assert(scheduler != NULL);
+    assert(event < SCHEDULER_EVENT_COUNT);
+    scheduler->deadlines[event] = cycle;
+    update_next(scheduler);
+}
+
+void scheduler_cancel(scheduler_s *scheduler, scheduler_event_e event)
+{
+    scheduler_set(scheduler, event, SCHEDULER_NEVER);
+}
+
+scheduler_event_e scheduler_pop_due(scheduler_s *scheduler, size_t now)
+{
+    assert(scheduler != NULL);
+    if (scheduler->next > now) {
+        return SCHEDULER_EVENT_COUNT;
+    }
+
+    // Ties go to the lower slot, so FRAME (and its NMI) comes first
+    scheduler_event_e due = SCHEDULER_EVENT_COUNT;
+    for (int i = 0; i < SCHEDULER_EVENT_COUNT; i++) {
+        if (scheduler->deadlines[i] <= now &&
+            (due == SCHEDULER_EVENT_COUNT || scheduler->deadlines[i] < scheduler->deadlines[due])) {
+            due = (scheduler_event_e)i;
+        }
+    }
+    scheduler_cancel(scheduler, due);
+    return due;
+}
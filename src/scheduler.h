@@ -0,0 +1,33 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Timed events on the CPU cycle clock. Each event has one slot holding its
+// next deadline; the earliest is cached in next so the CPU loop only has to
+// compare its cycle count against a single value.
+typedef enum {
+    SCHEDULER_EVENT_FRAME,       // PPU reaches vblank
+    SCHEDULER_EVENT_NMI,         // NMI raised outside the vblank edge
+    SCHEDULER_EVENT_OAM_DMA,     // CPU stall for an OAM DMA
+    SCHEDULER_EVENT_MAPPER_IRQ,
+    SCHEDULER_EVENT_APU_IRQ,
+    SCHEDULER_EVENT_COUNT,
+} scheduler_event_e;
+
+#define SCHEDULER_NEVER SIZE_MAX
+
+typedef struct {
+    size_t deadlines[SCHEDULER_EVENT_COUNT];
+    size_t next;
+} scheduler_s;
+
+void scheduler_init(scheduler_s *scheduler);
+void scheduler_set(scheduler_s *scheduler, scheduler_event_e event, size_t cycle);
+void scheduler_cancel(scheduler_s *scheduler, scheduler_event_e event);
+// Removes and returns the earliest event due at or before now, or
+// SCHEDULER_EVENT_COUNT when none is due
+scheduler_event_e scheduler_pop_due(scheduler_s *scheduler, size_t now);
+
+#endif